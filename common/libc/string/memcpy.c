@@ -34,12 +34,16 @@
 
 #ifdef _KERNEL
 #include <types.h>
+#include <endian.h>
 #include <lib.h>
 #else
 #include <stdint.h>
 #include <string.h>
+#include <sys/endian.h>
 #endif
 
+#include "wordcopy.h"
+
 /*
  * C standard function - copy a block of memory.
  */
@@ -47,39 +51,83 @@
 void *
 memcpy(void *dst, const void *src, size_t len)
 {
-	size_t i;
+	unsigned char *d = dst;
+	const unsigned char *s = src;
 
 	/*
 	 * memcpy does not support overlapping buffers, so always do it
 	 * forwards. (Don't change this without adjusting memmove.)
 	 *
-	 * For speedy copying, optimize the common case where both pointers
-	 * and the length are word-aligned, and copy word-at-a-time instead
-	 * of byte-at-a-time. Otherwise, copy by bytes.
+	 * Short copies aren't worth setting up for; do them by bytes.
+	 * Otherwise copy bytes until the destination is word-aligned,
+	 * then copy by words, and finish off the tail by bytes.
+	 *
+	 * If the source is then also aligned, the word loop is a plain
+	 * load/store, unrolled four times. If it isn't, we load aligned
+	 * words from the source and shift adjacent pairs together, so
+	 * a misaligned source still costs one load per word instead of
+	 * one per byte. The aligned loads may pick up a few bytes on
+	 * either side of the source region, but never outside the words
+	 * that contain it, so they can't fault on a page the byte loop
+	 * wouldn't have touched.
 	 *
-	 * The alignment logic below should be portable. We rely on
-	 * the compiler to be reasonably intelligent about optimizing
-	 * the divides and modulos out. Fortunately, it is.
+	 * copyin and copyout come through here too, so this is also
+	 * the path for moving data between the kernel and user space.
 	 */
 
-	if ((uintptr_t)dst % sizeof(long) == 0 &&
-	    (uintptr_t)src % sizeof(long) == 0 &&
-	    len % sizeof(long) == 0) {
+	if (len >= 2 * WORDSIZE) {
+		unsigned long *dw;
+		const unsigned long *sw;
+		unsigned long w0, w1;
+		unsigned shift;
+
+		while ((uintptr_t)d % WORDSIZE != 0) {
+			*d++ = *s++;
+			len--;
+		}
 
-		long *d = dst;
-		const long *s = src;
+		dw = (unsigned long *)d;
+		shift = ((uintptr_t)s % WORDSIZE) * 8;
 
-		for (i=0; i<len/sizeof(long); i++) {
-			d[i] = s[i];
+		if (shift == 0) {
+			sw = (const unsigned long *)s;
+			while (len >= 4 * WORDSIZE) {
+				dw[0] = sw[0];
+				dw[1] = sw[1];
+				dw[2] = sw[2];
+				dw[3] = sw[3];
+				dw += 4;
+				sw += 4;
+				len -= 4 * WORDSIZE;
+			}
+			while (len >= WORDSIZE) {
+				*dw++ = *sw++;
+				len -= WORDSIZE;
+			}
 		}
+		else {
+			sw = (const unsigned long *)(s - shift / 8);
+			w0 = *sw++;
+			/*
+			 * Each pass reads the word after the one that
+			 * finishes the output word, so stop while there
+			 * is still a whole spare word of source left.
+			 */
+			while (len >= 2 * WORDSIZE) {
+				w1 = *sw++;
+				*dw++ = MERGE(w0, w1, shift);
+				w0 = w1;
+				len -= WORDSIZE;
+			}
+		}
+
+		s += (unsigned char *)dw - d;
+		d = (unsigned char *)dw;
 	}
-	else {
-		char *d = dst;
-		const char *s = src;
 
-		for (i=0; i<len; i++) {
-			d[i] = s[i];
-		}
+	while (len > 0) {
+		*d++ = *s++;
+		len--;
 	}
 
 	return dst;
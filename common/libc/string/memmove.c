@@ -34,12 +34,16 @@
 
 #ifdef _KERNEL
 #include <types.h>
+#include <endian.h>
 #include <lib.h>
 #else
 #include <stdint.h>
 #include <string.h>
+#include <sys/endian.h>
 #endif
 
+#include "wordcopy.h"
+
 /*
  * C standard function - copy a block of memory, handling overlapping
  * regions correctly.
@@ -48,7 +52,8 @@
 void *
 memmove(void *dst, const void *src, size_t len)
 {
-	size_t i;
+	unsigned char *d;
+	const unsigned char *s;
 
 	/*
 	 * If the buffers don't overlap, it doesn't matter what direction
@@ -84,33 +89,68 @@ memmove(void *dst, const void *src, size_t len)
 	}
 
 	/*
-	 * Copy by words in the common case. Look in memcpy.c for more
-	 * information.
+	 * Otherwise copy back to front, the same way memcpy copies
+	 * front to back: bytes until the end of the destination is
+	 * word-aligned, then words (merging pairs of source words if
+	 * the source end isn't aligned too), then the remaining bytes.
+	 * Look in memcpy.c for more information.
+	 *
+	 * Every word we load lies at or below the last one, and every
+	 * store lands above the source bytes still to be read, so the
+	 * overlap can't corrupt anything.
 	 */
 
-	if ((uintptr_t)dst % sizeof(long) == 0 &&
-	    (uintptr_t)src % sizeof(long) == 0 &&
-	    len % sizeof(long) == 0) {
+	d = (unsigned char *)dst + len;
+	s = (const unsigned char *)src + len;
 
-		long *d = dst;
-		const long *s = src;
+	if (len >= 2 * WORDSIZE) {
+		unsigned long *dw;
+		const unsigned long *sw;
+		unsigned long w0, w1;
+		unsigned shift;
 
-		/*
-		 * The reason we copy index i-1 and test i>0 is that
-		 * i is unsigned -- so testing i>=0 doesn't work.
-		 */
+		while ((uintptr_t)d % WORDSIZE != 0) {
+			*--d = *--s;
+			len--;
+		}
 
-		for (i=len/sizeof(long); i>0; i--) {
-			d[i-1] = s[i-1];
+		dw = (unsigned long *)d;
+		shift = ((uintptr_t)s % WORDSIZE) * 8;
+
+		if (shift == 0) {
+			sw = (const unsigned long *)s;
+			while (len >= 4 * WORDSIZE) {
+				dw -= 4;
+				sw -= 4;
+				dw[3] = sw[3];
+				dw[2] = sw[2];
+				dw[1] = sw[1];
+				dw[0] = sw[0];
+				len -= 4 * WORDSIZE;
+			}
+			while (len >= WORDSIZE) {
+				*--dw = *--sw;
+				len -= WORDSIZE;
+			}
+		}
+		else {
+			sw = (const unsigned long *)(s - shift / 8);
+			w1 = *sw;
+			while (len >= 2 * WORDSIZE) {
+				w0 = *--sw;
+				*--dw = MERGE(w0, w1, shift);
+				w1 = w0;
+				len -= WORDSIZE;
+			}
 		}
+
+		s -= d - (unsigned char *)dw;
+		d = (unsigned char *)dw;
 	}
-	else {
-		char *d = dst;
-		const char *s = src;
 
-		for (i=len; i>0; i--) {
-			d[i-1] = s[i-1];
-		}
+	while (len > 0) {
+		*--d = *--s;
+		len--;
 	}
 
 	return dst;
@@ -31,9 +31,12 @@
 #include <types.h>
 #include <lib.h>
 #else
+#include <stdint.h>
 #include <string.h>
 #endif
 
+#define WORDSIZE	sizeof(unsigned long)
+
 /*
  * C standard function - initialize a block of memory
  */
@@ -41,11 +44,52 @@
 void *
 memset(void *ptr, int ch, size_t len)
 {
-	char *p = ptr;
-	size_t i;
+	unsigned char *p = ptr;
+	unsigned long *w;
+	unsigned long fill;
+
+	/*
+	 * Set bytes up to a word boundary, then set whole words,
+	 * four per pass, then any bytes left over. Blocks shorter
+	 * than a couple of words aren't worth the setup.
+	 *
+	 * bzero also comes through here, so this is the path for
+	 * zeroing pages as well as kmalloc's debug fill.
+	 */
+
+	if (len >= 2 * WORDSIZE) {
+		fill = (unsigned char)ch;
+		fill |= fill << 8;
+		fill |= fill << 16;
+		if (WORDSIZE > 4) {
+			/* two shifts so a 32-bit long doesn't overflow */
+			fill |= (fill << 16) << 16;
+		}
+
+		while ((uintptr_t)p % WORDSIZE != 0) {
+			*p++ = ch;
+			len--;
+		}
+
+		w = (unsigned long *)p;
+		while (len >= 4 * WORDSIZE) {
+			w[0] = fill;
+			w[1] = fill;
+			w[2] = fill;
+			w[3] = fill;
+			w += 4;
+			len -= 4 * WORDSIZE;
+		}
+		while (len >= WORDSIZE) {
+			*w++ = fill;
+			len -= WORDSIZE;
+		}
+		p = (unsigned char *)w;
+	}
 
-	for (i=0; i<len; i++) {
-		p[i] = ch;
+	while (len > 0) {
+		*p++ = ch;
+		len--;
 	}
 
 	return ptr;
@@ -36,9 +36,23 @@
 #include <types.h>
 #include <lib.h>
 #else
+#include <stdint.h>
 #include <string.h>
 #endif
 
+#define WORDSIZE	sizeof(unsigned long)
+
+/* 0x01 and 0x80 in every byte of a word. */
+#define ONES		(~0UL / 0xff)
+#define HIGHS		(ONES << 7)
+
+/*
+ * Nonzero if any byte of the word W is zero. This is the usual
+ * subtract-and-mask trick; it never misses a zero byte and never
+ * reports one that isn't there.
+ */
+#define HASZERO(w)	(((w) - ONES) & ~(w) & HIGHS)
+
 /*
  * C standard string function: get length of a string
  */
@@ -46,10 +60,31 @@
 size_t
 strlen(const char *str)
 {
-	size_t ret = 0;
+	const char *p = str;
+	const unsigned long *w;
+
+	/*
+	 * Check bytes up to a word boundary, then whole words until
+	 * one of them has a zero byte in it, then find which byte.
+	 * Aligned word loads never cross a page boundary, so reading
+	 * a few bytes past the terminator can't fault.
+	 */
+
+	while ((uintptr_t)p % WORDSIZE != 0) {
+		if (*p == 0) {
+			return p - str;
+		}
+		p++;
+	}
+
+	w = (const unsigned long *)p;
+	while (!HASZERO(*w)) {
+		w++;
+	}
 
-	while (str[ret]) {
-		ret++;
+	p = (const char *)w;
+	while (*p) {
+		p++;
 	}
-	return ret;
+	return p - str;
 }
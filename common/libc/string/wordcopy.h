@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _WORDCOPY_H_
+#define _WORDCOPY_H_
+
+/*
+ * Word-at-a-time copying helpers shared by memcpy.c and memmove.c.
+ * Include <endian.h> (or <sys/endian.h> in userland) first.
+ */
+
+#define WORDSIZE	sizeof(unsigned long)
+#define WORDBITS	(WORDSIZE * 8)
+
+/*
+ * Combine the tail of word W0 with the head of the following word W1,
+ * where the data we want starts SHIFT bits into W0. Which end of the
+ * word counts as the head depends on the byte order.
+ */
+#if _BYTE_ORDER == _BIG_ENDIAN
+#define MERGE(w0, w1, shift) \
+	(((w0) << (shift)) | ((w1) >> (WORDBITS - (shift))))
+#else
+#define MERGE(w0, w1, shift) \
+	(((w0) >> (shift)) | ((w1) << (WORDBITS - (shift))))
+#endif
+
+#endif /* _WORDCOPY_H_ */
@@ -152,10 +152,13 @@ mips_trap(struct trapframe *tf)
 	/* Interrupt? Call the interrupt handler and return. */
 	if (code == EX_IRQ) {
 		int old_in;
+		bool old_user;
 		bool doadjust;
 
 		old_in = curthread->t_in_interrupt;
+		old_user = curthread->t_intr_user;
 		curthread->t_in_interrupt = 1;
+		curthread->t_intr_user = !iskern;
 
 		/*
 		 * The processor has turned interrupts off; if the
@@ -195,6 +198,7 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+		curthread->t_intr_user = old_user;
 		goto done2;
 	}
 
@@ -36,6 +36,8 @@
 #include <current.h>
 #include <syscall.h>
 #include <addrspace.h>
+#include <endian.h>
+#include <copyinout.h>
 
 /*
  * System call dispatcher.
@@ -80,6 +82,10 @@ syscall(struct trapframe *tf)
 {
 	int callno;
 	int32_t retval;
+	off_t retval64;
+	bool is64;
+	off_t pos;
+	int whence;
 	int err;
 
 	KASSERT(curthread != NULL);
@@ -87,6 +93,7 @@ syscall(struct trapframe *tf)
 	KASSERT(curthread->t_iplhigh_count == 0);
 
 	callno = tf->tf_v0;
+	curthread->t_usage.tu_nsyscalls++;
 
 	/*
 	 * Initialize retval to 0. Many of the system calls don't
@@ -98,6 +105,8 @@ syscall(struct trapframe *tf)
 	 */
 
 	retval = 0;
+	retval64 = 0;
+	is64 = false;
 
 	switch (callno) {
 	    case SYS_reboot:
@@ -120,18 +129,106 @@ syscall(struct trapframe *tf)
 		break;
 
 		case SYS_write:
-			err = sys_write((userptr_t)tf->tf_a1, (int)tf->tf_a2, &retval);
+			err = sys_write((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+					(size_t)tf->tf_a2, &retval);
 			break;
 			
 		case SYS_read:
-			err = sys_read((userptr_t)tf->tf_a1, (int)tf->tf_a2);
+			err = sys_read((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+				       (size_t)tf->tf_a2, &retval);
 			break;
+		case SYS_pread:
+		case SYS_pwrite:
+			/* the 64-bit offset doesn't fit in a3; it's on the stack */
+			err = copyin((userptr_t)(tf->tf_sp + 16), &pos,
+				     sizeof(pos));
+			if (err) {
+				break;
+			}
+			if (callno == SYS_pread) {
+				err = sys_pread((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+						(size_t)tf->tf_a2, pos, &retval);
+			}
+			else {
+				err = sys_pwrite((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+						 (size_t)tf->tf_a2, pos, &retval);
+			}
+		break;
+		case SYS_readv:
+			err = sys_readv((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+					(int)tf->tf_a2, &retval);
+		break;
+		case SYS_writev:
+			err = sys_writev((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+					 (int)tf->tf_a2, &retval);
+		break;
+		case SYS_open:
+			err = sys_open((userptr_t)tf->tf_a0, (int)tf->tf_a1,
+				       (mode_t)tf->tf_a2, &retval);
+		break;
+		case SYS_close:
+			err = sys_close((int)tf->tf_a0);
+		break;
+		case SYS_lseek:
+			/* fd in a0, 64-bit pos in a2/a3, whence on the stack */
+			join32to64(tf->tf_a2, tf->tf_a3, (uint64_t *)&pos);
+			err = copyin((userptr_t)(tf->tf_sp + 16), &whence,
+				     sizeof(whence));
+			if (err) {
+				break;
+			}
+			err = sys_lseek((int)tf->tf_a0, pos, whence, &retval64);
+			is64 = true;
+		break;
+		case SYS_dup2:
+			err = sys_dup2((int)tf->tf_a0, (int)tf->tf_a1, &retval);
+		break;
+		case SYS_dup:
+			err = sys_dup((int)tf->tf_a0, &retval);
+		break;
+		case SYS_pipe:
+			err = sys_pipe((userptr_t)tf->tf_a0);
+		break;
+		case SYS_ioctl:
+			err = sys_ioctl((int)tf->tf_a0, (int)tf->tf_a1,
+					(userptr_t)tf->tf_a2);
+		break;
+		case SYS_splice:
+			err = sys_splice((int)tf->tf_a0, (int)tf->tf_a1,
+					 (size_t)tf->tf_a2, &retval);
+		break;
+		case SYS_poll:
+			err = sys_poll((userptr_t)tf->tf_a0, (unsigned)tf->tf_a1,
+				       (int)tf->tf_a2, &retval);
+		break;
+		case SYS___batch:
+			err = sys___batch((userptr_t)tf->tf_a0, &retval);
+		break;
+		case SYS_fcntl:
+			err = sys_fcntl((int)tf->tf_a0, (int)tf->tf_a1,
+					(int)tf->tf_a2, &retval);
+		break;
 		case SYS_fork:
 			err = sys_fork(tf, &retval);
 		break;
+		case SYS_execv:
+			err = sys_execv((userptr_t)tf->tf_a0,
+					(userptr_t)tf->tf_a1);
+		break;
+		case SYS_spawn:
+			err = sys_spawn((userptr_t)tf->tf_a0,
+					(userptr_t)tf->tf_a1, &retval);
+		break;
 		case SYS_waitpid:
 			err = sys_waitpid ((pid_t)tf->tf_a0,(int*)tf->tf_a1,(int)tf->tf_a2,(pid_t*) &retval);
 		break;
+		case SYS_getrusage:
+			err = sys_getrusage((int)tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+		case SYS_wait4:
+			err = sys_wait4 ((pid_t)tf->tf_a0,(int*)tf->tf_a1,(int)tf->tf_a2,
+					 (userptr_t)tf->tf_a3,(pid_t*) &retval);
+		break;
 	    default:
 		kprintf("Unknown syscall %d\n", callno);
 		err = ENOSYS;
@@ -148,6 +245,11 @@ syscall(struct trapframe *tf)
 		tf->tf_v0 = err;
 		tf->tf_a3 = 1;      /* signal an error */
 	}
+	else if (is64) {
+		/* Success, with a 64-bit return value in v0/v1. */
+		split64to32(retval64, &tf->tf_v0, &tf->tf_v1);
+		tf->tf_a3 = 0;      /* signal no error */
+	}
 	else {
 		/* Success. */
 		tf->tf_v0 = retval;
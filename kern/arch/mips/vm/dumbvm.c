@@ -29,15 +29,18 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/timepage.h>
 #include <lib.h>
 #include <spl.h>
 #include <cpu.h>
 #include <spinlock.h>
 #include <proc.h>
+#include <thread.h>
 #include <current.h>
 #include <mips/tlb.h>
 #include <addrspace.h>
 #include <vm.h>
+#include <clock.h>
 
 /*
  * Dumb MIPS-only "VM system" that is intended to only be just barely
@@ -67,7 +70,9 @@ static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
 void
 vm_bootstrap(void)
 {
-	/* Do nothing. */
+	/* The time page must not overlap the stack. */
+	COMPILE_ASSERT(TIMEPAGE_VADDR + PAGE_SIZE <=
+		       USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE);
 }
 
 /*
@@ -141,15 +146,21 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	int i;
 	uint32_t ehi, elo;
 	struct addrspace *as;
+	bool readonly = false;
 	int spl;
 
 	faultaddress &= PAGE_FRAME;
 
 	DEBUG(DB_VM, "dumbvm: fault: 0x%x\n", faultaddress);
 
+	curthread->t_usage.tu_faults++;
+
 	switch (faulttype) {
 	    case VM_FAULT_READONLY:
-		/* We always create pages read-write, so we can't get this */
+		/* Only the time page is mapped read-only */
+		if (faultaddress == TIMEPAGE_VADDR) {
+			return EFAULT;
+		}
 		panic("dumbvm: got VM_FAULT_READONLY\n");
 	    case VM_FAULT_READ:
 	    case VM_FAULT_WRITE:
@@ -206,6 +217,13 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	else if (faultaddress >= stackbase && faultaddress < stacktop) {
 		paddr = (faultaddress - stackbase) + as->as_stackpbase;
 	}
+	else if (faultaddress == TIMEPAGE_VADDR) {
+		if (faulttype == VM_FAULT_WRITE) {
+			return EFAULT;
+		}
+		paddr = KVADDR_TO_PADDR(timepage_kvaddr());
+		readonly = true;
+	}
 	else {
 		return EFAULT;
 	}
@@ -222,7 +240,10 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 			continue;
 		}
 		ehi = faultaddress;
-		elo = paddr | TLBLO_DIRTY | TLBLO_VALID;
+		elo = paddr | TLBLO_VALID;
+		if (!readonly) {
+			elo |= TLBLO_DIRTY;
+		}
 		DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, paddr);
 		tlb_write(ehi, elo, i);
 		splx(spl);
@@ -174,6 +174,7 @@ con_input(void *vcs, int ch)
 	cs->cs_gotchars_head = nexthead;
 
 	V(cs->cs_rsem);
+	poll_wakeup(&cs->cs_poll);
 }
 
 /*
@@ -240,12 +241,20 @@ con_eachopen(struct device *dev, int openflags)
 	return 0;
 }
 
+/*
+ * Characters are moved between the uio and the device in chunks of
+ * up to CON_IOBUFSIZE, so that a user write costs one uiomove (and
+ * thus one copyin) per chunk instead of one per character.
+ */
+#define CON_IOBUFSIZE 128
+
 static
 int
 con_io(struct device *dev, struct uio *uio)
 {
-	int result;
-	char ch;
+	int result = 0;
+	char buf[CON_IOBUFSIZE];
+	size_t len, i;
 	struct lock *lk;
 
 	(void)dev;  // unused
@@ -261,34 +270,42 @@ con_io(struct device *dev, struct uio *uio)
 	lock_acquire(lk);
 
 	while (uio->uio_resid > 0) {
+		len = uio->uio_resid;
+		if (len > sizeof(buf)) {
+			len = sizeof(buf);
+		}
 		if (uio->uio_rw==UIO_READ) {
-			ch = getch();
-			if (ch=='\r') {
-				ch = '\n';
+			/* Stop early at end of line, like before. */
+			for (i=0; i<len; i++) {
+				buf[i] = getch();
+				if (buf[i]=='\r') {
+					buf[i] = '\n';
+				}
+				if (buf[i]=='\n') {
+					i++;
+					break;
+				}
 			}
-			result = uiomove(&ch, 1, uio);
-			if (result) {
-				lock_release(lk);
-				return result;
-			}
-			if (ch=='\n') {
+			result = uiomove(buf, i, uio);
+			if (result || buf[i-1]=='\n') {
 				break;
 			}
 		}
 		else {
-			result = uiomove(&ch, 1, uio);
+			result = uiomove(buf, len, uio);
 			if (result) {
-				lock_release(lk);
-				return result;
+				break;
 			}
-			if (ch=='\n') {
-				putch('\r');
+			for (i=0; i<len; i++) {
+				if (buf[i]=='\n') {
+					putch('\r');
+				}
+				putch(buf[i]);
 			}
-			putch(ch);
 		}
 	}
 	lock_release(lk);
-	return 0;
+	return result;
 }
 
 static
@@ -302,10 +319,30 @@ con_ioctl(struct device *dev, int op, userptr_t data)
 	return EINVAL;
 }
 
+/*
+ * Input is ready if there's anything in the input buffer. (A read
+ * may still wait for the rest of the line.) Output is always ready.
+ */
+static
+int
+con_poll(struct device *dev, int events, int *revents)
+{
+	struct con_softc *cs = dev->d_data;
+
+	poll_record(&cs->cs_poll);
+
+	*revents = events & (POLLOUT | POLLWRNORM);
+	if (cs->cs_gotchars_head != cs->cs_gotchars_tail) {
+		*revents |= events & (POLLIN | POLLRDNORM);
+	}
+	return 0;
+}
+
 static const struct device_ops console_devops = {
 	.devop_eachopen = con_eachopen,
 	.devop_io = con_io,
 	.devop_ioctl = con_ioctl,
+	.devop_poll = con_poll,
 };
 
 static
@@ -386,6 +423,7 @@ config_con(struct con_softc *cs, int unit)
 	cs->cs_wsem = wsem;
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	pollrec_init(&cs->cs_poll);
 
 	the_console = cs;
 	con_userlock_read = rlk;
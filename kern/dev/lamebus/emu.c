@@ -1083,6 +1083,7 @@ static const struct vnode_ops emufs_fileops = {
 	.vop_getdirentry = emufs_uio_op_notdir,
 	.vop_write = emufs_write,
 	.vop_ioctl = emufs_ioctl,
+	.vop_poll = vopgeneric_poll,
 	.vop_stat = emufs_stat,
 	.vop_gettype = emufs_file_gettype,
 	.vop_isseekable = emufs_isseekable,
@@ -1117,6 +1118,7 @@ static const struct vnode_ops emufs_dirops = {
 	.vop_getdirentry = emufs_getdirentry,
 	.vop_write = emufs_uio_op_isdir,
 	.vop_ioctl = emufs_ioctl,
+	.vop_poll = vopgeneric_poll,
 	.vop_stat = emufs_stat,
 	.vop_gettype = emufs_dir_gettype,
 	.vop_isseekable = emufs_isseekable,
@@ -36,9 +36,12 @@
 #include <lib.h>
 #include <uio.h>
 #include <membar.h>
+#include <spinlock.h>
 #include <synch.h>
+#include <wchan.h>
 #include <platform/bus.h>
 #include <vfs.h>
+#include <iosched.h>
 #include <lamebus/lhd.h>
 #include "autoconf.h"
 
@@ -60,6 +63,9 @@
 /* Buffer (offset within slot)  */
 #define LHD_BUFFER      32768
 
+/* Size of the bounce buffer for user transfers */
+#define LHD_BOUNCESIZE  4096
+
 /*
  * Shortcut for reading a register.
  */
@@ -96,27 +102,69 @@ int lhd_code_to_errno(struct lhd_softc *lh, int code)
 }
 
 /*
- * Record that an I/O has completed: save the result and poke the
- * completion semaphore.
+ * Start the next sector of the current request. The disk moves one
+ * sector at a time through the on-card buffer; for writes, fill the
+ * buffer first. Called with lh_lock held.
  */
 static
 void
-lhd_iodone(struct lhd_softc *lh, int err)
+lhd_startsector(struct lhd_softc *lh)
 {
-	lh->lh_result = err;
-	V(lh->lh_done);
+	struct uio *uio = lh->lh_cur->dr_uio;
+	uint32_t sector = uio->uio_offset / LHD_SECTSIZE;
+	uint32_t statval = LHD_WORKING;
+	int result;
+
+	if (uio->uio_rw == UIO_WRITE) {
+		/* Kernel memory; can't fail. */
+		result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
+		KASSERT(result == 0);
+		membar_store_store();
+		statval |= LHD_ISWRITE;
+	}
+
+	/* Tell it what sector we want... */
+	lhd_wreg(lh, LHD_REG_SECT, sector);
+
+	/* and start the operation. */
+	lhd_wreg(lh, LHD_REG_STAT, statval);
+}
+
+/*
+ * If the disk is idle, start the request the scheduler picks next.
+ * Called with lh_lock held.
+ */
+static
+void
+lhd_startnext(struct lhd_softc *lh)
+{
+	if (lh->lh_cur != NULL) {
+		return;
+	}
+	lh->lh_cur = iosched_next(lh->lh_sched, lh->lh_headpos);
+	if (lh->lh_cur != NULL) {
+		lhd_startsector(lh);
+	}
 }
 
 /*
  * Interrupt handler for lhd.
  * Read the status register; if an operation finished, clear the status
- * register and report completion.
+ * register and move the data. Then go straight on to the next sector
+ * of the request, or if it's done, to the next request, so the disk
+ * doesn't sit idle waiting for a thread to run. The completion
+ * callback is called last, without the lock.
  */
 void
 lhd_irq(void *vlh)
 {
 	struct lhd_softc *lh = vlh;
+	struct devreq *done = NULL;
+	struct uio *uio;
 	uint32_t val;
+	int result = 0;
+
+	spinlock_acquire(&lh->lh_lock);
 
 	val = lhd_rdreg(lh, LHD_REG_STAT);
 
@@ -128,9 +176,48 @@ lhd_irq(void *vlh)
 	    case LHD_INVSECT:
 	    case LHD_MEDIA:
 		lhd_wreg(lh, LHD_REG_STAT, 0);
-		lhd_iodone(lh, lhd_code_to_errno(lh, val));
+		result = lhd_code_to_errno(lh, val);
+		if (lh->lh_cur == NULL) {
+			kprintf("lhd%d: Spurious completion\n", lh->lh_unit);
+			break;
+		}
+		uio = lh->lh_cur->dr_uio;
+
+		/*
+		 * Are we reading? If so, and if we succeeded,
+		 * transfer the data out of the on-card buffer.
+		 */
+		if (result == 0 && uio->uio_rw == UIO_READ) {
+			membar_load_load();
+			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
+		}
+
+		if (result == 0 && uio->uio_resid > 0) {
+			lhd_startsector(lh);
+		}
+		else {
+			/*
+			 * Go on to the rest of a merged group if there
+			 * is any, otherwise whatever the scheduler says.
+			 */
+			done = lh->lh_cur;
+			lh->lh_headpos = uio->uio_offset;
+			lh->lh_cur = done->dr_merged;
+			if (lh->lh_cur != NULL) {
+				lhd_startsector(lh);
+			}
+			else {
+				lhd_startnext(lh);
+			}
+		}
 		break;
 	}
+
+	spinlock_release(&lh->lh_lock);
+
+	if (done != NULL) {
+		done->dr_done(done, result);
+	}
 }
 
 /*
@@ -180,21 +267,16 @@ lhd_reset(struct lhd_softc *lh)
 #endif
 
 /*
- * I/O function (for both reads and writes)
+ * Check that a transfer is sector-aligned and on the disk.
  */
 static
 int
-lhd_io(struct device *d, struct uio *uio)
+lhd_checkio(struct lhd_softc *lh, struct uio *uio)
 {
-	struct lhd_softc *lh = d->d_data;
-
 	uint32_t sector = uio->uio_offset / LHD_SECTSIZE;
 	uint32_t sectoff = uio->uio_offset % LHD_SECTSIZE;
 	uint32_t len = uio->uio_resid / LHD_SECTSIZE;
 	uint32_t lenoff = uio->uio_resid % LHD_SECTSIZE;
-	uint32_t i;
-	uint32_t statval = LHD_WORKING;
-	int result;
 
 	/* Don't allow I/O that isn't sector-aligned. */
 	if (sectoff != 0 || lenoff != 0) {
@@ -202,72 +284,163 @@ lhd_io(struct device *d, struct uio *uio)
 	}
 
 	/* Don't allow I/O past the end of the disk. */
-	/* XXX this check can overflow */
-	if (sector+len > lh->lh_dev.d_blocks) {
+	if (sector > lh->lh_dev.d_blocks ||
+	    len > lh->lh_dev.d_blocks - sector) {
 		return EINVAL;
 	}
+	return 0;
+}
 
-	/* Set up the value to write into the status register. */
-	if (uio->uio_rw==UIO_WRITE) {
-		statval |= LHD_ISWRITE;
+/*
+ * Asynchronous I/O function. Hand the request to the scheduler, and
+ * start something if the disk is idle.
+ */
+static
+int
+lhd_ioasync(struct device *d, struct devreq *dr)
+{
+	struct lhd_softc *lh = d->d_data;
+	int result;
+
+	KASSERT(dr->dr_uio->uio_segflg == UIO_SYSSPACE);
+
+	result = lhd_checkio(lh, dr->dr_uio);
+	if (result) {
+		return result;
+	}
+	if (dr->dr_uio->uio_resid == 0) {
+		dr->dr_done(dr, 0);
+		return 0;
 	}
 
-	/* Loop over all the sectors we were asked to do. */
-	for (i=0; i<len; i++) {
+	spinlock_acquire(&lh->lh_lock);
+	iosched_add(lh->lh_sched, dr);
+	lhd_startnext(lh);
+	spinlock_release(&lh->lh_lock);
+	return 0;
+}
 
-		/* Wait until nobody else is using the device. */
-		P(lh->lh_clear);
+/*
+ * State for a synchronous request waiting to finish.
+ */
+struct lhd_wait {
+	struct lhd_softc *lw_lh;
+	bool lw_done;
+	int lw_result;
+};
 
-		/*
-		 * Are we writing? If so, transfer the data to the
-		 * on-card buffer.
-		 */
-		if (uio->uio_rw == UIO_WRITE) {
-			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
-			membar_store_store();
-			if (result) {
-				V(lh->lh_clear);
-				return result;
-			}
-		}
+static
+void
+lhd_waitdone(struct devreq *dr, int result)
+{
+	struct lhd_wait *lw = dr->dr_data;
+	struct lhd_softc *lh = lw->lw_lh;
+
+	spinlock_acquire(&lh->lh_lock);
+	lw->lw_result = result;
+	lw->lw_done = true;
+	wchan_wakeall(lh->lh_wchan, &lh->lh_lock);
+	spinlock_release(&lh->lh_lock);
+}
 
-		/* Tell it what sector we want... */
-		lhd_wreg(lh, LHD_REG_SECT, sector+i);
+/*
+ * Do a kernel-space transfer and wait for it.
+ */
+static
+int
+lhd_iowait(struct lhd_softc *lh, struct uio *uio)
+{
+	struct devreq dr;
+	struct lhd_wait lw;
+	int result;
 
-		/* and start the operation. */
-		lhd_wreg(lh, LHD_REG_STAT, statval);
+	lw.lw_lh = lh;
+	lw.lw_done = false;
+	lw.lw_result = 0;
+	dr.dr_uio = uio;
+	dr.dr_done = lhd_waitdone;
+	dr.dr_data = &lw;
 
-		/* Now wait until the interrupt handler tells us we're done. */
-		P(lh->lh_done);
+	result = lhd_ioasync(&lh->lh_dev, &dr);
+	if (result) {
+		return result;
+	}
 
-		/* Get the result value saved by the interrupt handler. */
-		result = lh->lh_result;
+	spinlock_acquire(&lh->lh_lock);
+	while (!lw.lw_done) {
+		wchan_sleep(lh->lh_wchan, &lh->lh_lock);
+	}
+	spinlock_release(&lh->lh_lock);
+	return lw.lw_result;
+}
 
-		/*
-		 * Are we reading? If so, and if we succeeded,
-		 * transfer the data out of the on-card buffer.
-		 */
-		if (result==0 && uio->uio_rw==UIO_READ) {
-			membar_load_load();
-			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
+/*
+ * I/O function (for both reads and writes)
+ *
+ * The transfer itself happens in the interrupt handler, which can't
+ * touch user memory, so user transfers go through the bounce buffer a
+ * chunk at a time. There's one per disk, allocated at attach time;
+ * users of the raw device take turns with it.
+ */
+static
+int
+lhd_io(struct device *d, struct uio *uio)
+{
+	struct lhd_softc *lh = d->d_data;
+	struct iovec iov;
+	struct uio ku;
+	size_t len;
+	off_t pos;
+	int result;
+
+	result = lhd_checkio(lh, uio);
+	if (result) {
+		return result;
+	}
+
+	if (uio->uio_segflg == UIO_SYSSPACE) {
+		return lhd_iowait(lh, uio);
+	}
+
+	lock_acquire(lh->lh_bouncelock);
+	result = 0;
+	while (uio->uio_resid > 0) {
+		len = uio->uio_resid;
+		if (len > LHD_BOUNCESIZE) {
+			len = LHD_BOUNCESIZE;
 		}
+		pos = uio->uio_offset;
 
-		/* Tell another thread it's cleared to go ahead. */
-		V(lh->lh_clear);
+		if (uio->uio_rw == UIO_WRITE) {
+			result = uiomove(lh->lh_bounce, len, uio);
+			if (result) {
+				break;
+			}
+		}
 
-		/* If we failed, return the error. */
+		uio_kinit(&iov, &ku, lh->lh_bounce, len, pos, uio->uio_rw);
+		result = lhd_iowait(lh, &ku);
 		if (result) {
-			return result;
+			break;
+		}
+
+		if (uio->uio_rw == UIO_READ) {
+			result = uiomove(lh->lh_bounce, len, uio);
+			if (result) {
+				break;
+			}
 		}
 	}
 
-	return 0;
+	lock_release(lh->lh_bouncelock);
+	return result;
 }
 
 static const struct device_ops lhd_devops = {
 	.devop_eachopen = lhd_eachopen,
 	.devop_io = lhd_io,
 	.devop_ioctl = lhd_ioctl,
+	.devop_ioasync = lhd_ioasync,
 };
 
 /*
@@ -284,15 +457,36 @@ config_lhd(struct lhd_softc *lh, int lhdno)
 	/* Get a pointer to the on-chip buffer. */
 	lh->lh_buf = bus_map_area(lh->lh_busdata, lh->lh_buspos, LHD_BUFFER);
 
-	/* Create the semaphores. */
-	lh->lh_clear = sem_create("lhd-clear", 1);
-	if (lh->lh_clear == NULL) {
+	/* Set up the request queue. */
+	spinlock_init(&lh->lh_lock);
+	lh->lh_cur = NULL;
+	lh->lh_headpos = 0;
+	lh->lh_sched = iosched_create(name);
+	if (lh->lh_sched == NULL) {
+		spinlock_cleanup(&lh->lh_lock);
+		return ENOMEM;
+	}
+	lh->lh_wchan = wchan_create("lhd");
+	if (lh->lh_wchan == NULL) {
+		iosched_destroy(lh->lh_sched);
+		spinlock_cleanup(&lh->lh_lock);
+		return ENOMEM;
+	}
+
+	/* And the bounce buffer for user transfers. */
+	lh->lh_bounce = kmalloc(LHD_BOUNCESIZE);
+	if (lh->lh_bounce == NULL) {
+		wchan_destroy(lh->lh_wchan);
+		iosched_destroy(lh->lh_sched);
+		spinlock_cleanup(&lh->lh_lock);
 		return ENOMEM;
 	}
-	lh->lh_done = sem_create("lhd-done", 0);
-	if (lh->lh_done == NULL) {
-		sem_destroy(lh->lh_clear);
-		lh->lh_clear = NULL;
+	lh->lh_bouncelock = lock_create("lhd bounce");
+	if (lh->lh_bouncelock == NULL) {
+		kfree(lh->lh_bounce);
+		wchan_destroy(lh->lh_wchan);
+		iosched_destroy(lh->lh_sched);
+		spinlock_cleanup(&lh->lh_lock);
 		return ENOMEM;
 	}
 
@@ -30,6 +30,7 @@
 #ifndef _LAMEBUS_LHD_H_
 #define _LAMEBUS_LHD_H_
 
+#include <spinlock.h>
 #include <device.h>
 
 /*
@@ -51,9 +52,13 @@ struct lhd_softc {
 	 */
 
 	void *lh_buf;			/* Pointer to on-card I/O buffer */
-	int lh_result;			/* Result from I/O operation */
-	struct semaphore *lh_clear;	/* Synchronization */
-	struct semaphore *lh_done;
+	struct spinlock lh_lock;	/* Protects the rest */
+	struct devreq *lh_cur;		/* Request in progress */
+	struct iosched *lh_sched;	/* Requests waiting */
+	off_t lh_headpos;		/* Where the last transfer ended */
+	struct wchan *lh_wchan;		/* For synchronous I/O */
+	char *lh_bounce;		/* Bounce buffer for user I/O */
+	struct lock *lh_bouncelock;	/* Protects lh_bounce */
 
 	struct device lh_dev;		/* VFS device structure */
 };
@@ -659,6 +659,7 @@ static const struct vnode_ops semfs_dirops = {
 	.vop_getdirentry = semfs_getdirentry,
 	.vop_write = vopfail_uio_isdir,
 	.vop_ioctl = semfs_ioctl,
+	.vop_poll = vopgeneric_poll,
 	.vop_stat = semfs_dirstat,
 	.vop_gettype = semfs_gettype,
 	.vop_isseekable = semfs_isseekable,
@@ -692,6 +693,7 @@ static const struct vnode_ops semfs_semops = {
 	.vop_getdirentry = vopfail_uio_notdir,
 	.vop_write = semfs_write,
 	.vop_ioctl = semfs_ioctl,
+	.vop_poll = vopgeneric_poll,
 	.vop_stat = semfs_semstat,
 	.vop_gettype = semfs_gettype,
 	.vop_isseekable = semfs_isseekable,
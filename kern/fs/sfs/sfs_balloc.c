@@ -35,32 +35,47 @@
 #include <types.h>
 #include <lib.h>
 #include <bitmap.h>
+#include <synch.h>
+#include <buf.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
 /*
- * Zero out a disk block.
+ * Zero out a disk block. This only zeros its buffer; the zeros reach
+ * the disk when the buffer is written back, if the block hasn't been
+ * overwritten first.
  */
 static
 int
 sfs_clearblock(struct sfs_fs *sfs, daddr_t block)
 {
-	/* static -> automatically initialized to zero */
-	static char zeros[SFS_BLOCKSIZE];
+	struct buf *b;
+	int result;
 
-	return sfs_writeblock(sfs, block, zeros, SFS_BLOCKSIZE);
+	result = buf_get(sfs->sfs_device, block, &b);
+	if (result) {
+		return result;
+	}
+	bzero(buf_data(b), SFS_BLOCKSIZE);
+	buf_markdirty(b);
+	buf_release(b);
+	return 0;
 }
 
 /*
- * Allocate a block.
+ * Allocate a block, as close after GOAL as we can. Callers pass the
+ * block that precedes the new one in the file (or the file's inode),
+ * so files come out contiguous when there's room.
  */
 int
-sfs_balloc(struct sfs_fs *sfs, daddr_t *diskblock)
+sfs_balloc(struct sfs_fs *sfs, daddr_t goal, daddr_t *diskblock)
 {
 	int result;
 
-	result = bitmap_alloc(sfs->sfs_freemap, diskblock);
+	lock_acquire(sfs->sfs_freemaplock);
+	result = bitmap_alloc_near(sfs->sfs_freemap, goal, diskblock);
 	if (result) {
+		lock_release(sfs->sfs_freemaplock);
 		return result;
 	}
 	sfs->sfs_freemapdirty = true;
@@ -69,23 +84,130 @@ sfs_balloc(struct sfs_fs *sfs, daddr_t *diskblock)
 		panic("sfs: %s: balloc: invalid block %u\n",
 		      sfs->sfs_sb.sb_volname, *diskblock);
 	}
+	lock_release(sfs->sfs_freemaplock);
 
-	/* Clear block before returning it */
+	/*
+	 * Clear block before returning it. The block is ours now, so
+	 * this doesn't need the freemap locked.
+	 */
 	result = sfs_clearblock(sfs, *diskblock);
 	if (result) {
+		lock_acquire(sfs->sfs_freemaplock);
 		bitmap_unmark(sfs->sfs_freemap, *diskblock);
+		lock_release(sfs->sfs_freemaplock);
 	}
 	return result;
 }
 
+/*
+ * Preallocation. When a file is being appended to, sfs_balloc_file
+ * reserves a run of free blocks after each block it has to search
+ * for, and hands out the following blocks of the file from the run
+ * as long as they keep coming in order. Reserved blocks are marked
+ * in the freemap so nobody else takes them, but only the vnode knows
+ * about them; they're given back when the file is truncated or the
+ * vnode is reclaimed. (After a crash, sfsck finds them marked but
+ * unused and frees them.)
+ */
+#define SFS_PREALLOC	16	/* blocks reserved at a time */
+
+/*
+ * Reserve up to MAX free blocks starting at START, stopping at the
+ * first that's in use. Returns how many were reserved.
+ */
+static
+uint32_t
+sfs_breserve(struct sfs_fs *sfs, daddr_t start, uint32_t max)
+{
+	uint32_t n;
+
+	lock_acquire(sfs->sfs_freemaplock);
+	for (n=0; n<max && start+n < sfs->sfs_sb.sb_nblocks; n++) {
+		if (bitmap_isset(sfs->sfs_freemap, start+n)) {
+			break;
+		}
+		bitmap_mark(sfs->sfs_freemap, start+n);
+	}
+	if (n > 0) {
+		sfs->sfs_freemapdirty = true;
+	}
+	lock_release(sfs->sfs_freemaplock);
+	return n;
+}
+
+/*
+ * Give back the rest of a file's reserved run.
+ */
+void
+sfs_prealloc_release(struct sfs_vnode *sv)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+
+	KASSERT(lock_do_i_hold(sv->sv_lock));
+
+	if (sv->sv_nprealloc == 0) {
+		return;
+	}
+	lock_acquire(sfs->sfs_freemaplock);
+	for (; sv->sv_nprealloc > 0; sv->sv_nprealloc--) {
+		bitmap_unmark(sfs->sfs_freemap, sv->sv_prealloc++);
+	}
+	sfs->sfs_freemapdirty = true;
+	lock_release(sfs->sfs_freemaplock);
+}
+
+/*
+ * Allocate a block for file SV that comes right after disk block PREV
+ * in the file (0 if there isn't one). APPEND means it's past EOF.
+ */
+int
+sfs_balloc_file(struct sfs_vnode *sv, daddr_t prev, bool append,
+		daddr_t *diskblock)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	int result;
+
+	KASSERT(lock_do_i_hold(sv->sv_lock));
+
+	if (sv->sv_nprealloc > 0 && prev != 0 && sv->sv_prealloc == prev + 1) {
+		/* Next block of the run; it's ours, so no freemap lock. */
+		*diskblock = sv->sv_prealloc++;
+		sv->sv_nprealloc--;
+		result = sfs_clearblock(sfs, *diskblock);
+		if (result) {
+			sfs_bfree(sfs, *diskblock);
+		}
+		return result;
+	}
+
+	result = sfs_balloc(sfs, prev != 0 ? prev : sv->sv_ino, diskblock);
+	if (result) {
+		return result;
+	}
+
+	/* If more appending looks likely, set up a new run. */
+	if (append && prev != 0 && sv->sv_i.sfi_type == SFS_TYPE_FILE) {
+		sfs_prealloc_release(sv);
+		sv->sv_prealloc = *diskblock + 1;
+		sv->sv_nprealloc = sfs_breserve(sfs, sv->sv_prealloc,
+						SFS_PREALLOC);
+	}
+	return 0;
+}
+
 /*
  * Free a block.
  */
 void
 sfs_bfree(struct sfs_fs *sfs, daddr_t diskblock)
 {
+	lock_acquire(sfs->sfs_freemaplock);
 	bitmap_unmark(sfs->sfs_freemap, diskblock);
 	sfs->sfs_freemapdirty = true;
+	lock_release(sfs->sfs_freemaplock);
+
+	/* Don't bother writing back whatever was in it. */
+	buf_discard(sfs->sfs_device, diskblock);
 }
 
 /*
@@ -94,10 +216,15 @@ sfs_bfree(struct sfs_fs *sfs, daddr_t diskblock)
 int
 sfs_bused(struct sfs_fs *sfs, daddr_t diskblock)
 {
+	int ret;
+
 	if (diskblock >= sfs->sfs_sb.sb_nblocks) {
 		panic("sfs: %s: sfs_bused called on out of range block %u\n",
 		      sfs->sfs_sb.sb_volname, diskblock);
 	}
-	return bitmap_isset(sfs->sfs_freemap, diskblock);
+	lock_acquire(sfs->sfs_freemaplock);
+	ret = bitmap_isset(sfs->sfs_freemap, diskblock);
+	lock_release(sfs->sfs_freemaplock);
+	return ret;
 }
 
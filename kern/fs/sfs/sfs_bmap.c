@@ -35,54 +35,73 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <synch.h>
 #include <vfs.h>
+#include <buf.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
 /*
- * Look up the disk block number (from 0 up to the number of blocks on
- * the disk) given a file and the logical block number within that
- * file. If DOALLOC is set, and no such block exists, one will be
- * allocated.
+ * Files map their blocks through the direct blocks in the inode, then
+ * through up to three trees of indirect blocks: the indirect block
+ * (one level), the double indirect block (two levels), and the triple
+ * indirect block (three levels).
  */
-int
-sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
-	 daddr_t *diskblock)
+#define SFS_MAXLEVELS	3
+
+/*
+ * Return the inode field that holds the root of the tree with LEVELS
+ * levels of indirect blocks.
+ */
+static
+uint32_t *
+sfs_bmap_root(struct sfs_vnode *sv, unsigned levels)
 {
-	/*
-	 * I/O buffer for handling indirect blocks.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
+	switch (levels) {
+	    case 1: return &sv->sv_i.sfi_indirect;
+	    case 2: return &sv->sv_i.sfi_dindirect;
+	    case 3: return &sv->sv_i.sfi_tindirect;
+	}
+	panic("sfs: bmap: bad indirection level %u\n", levels);
+	return NULL;
+}
 
+/*
+ * Do the work of sfs_bmap. New blocks go as close after PREV as
+ * possible, and each new indirect block becomes PREV for whatever
+ * gets allocated under it, so a file's data comes out right after the
+ * indirect block that maps it.
+ *
+ * The leaf indirect block that was reached last is remembered in the
+ * vnode, so running through a file only walks down from the top of
+ * the tree once every SFS_DBPERIDB blocks.
+ */
+static
+int
+sfs_bmap_walk(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
+	      daddr_t prev, daddr_t *diskblock)
+{
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
-	daddr_t block;
-	daddr_t idblock;
-	uint32_t idnum, idoff;
+	struct buf *idbuf;
+	uint32_t *idptrs;
+	uint32_t *root;
+	daddr_t block, idblock;
+	uint32_t offset, span, idx;
+	unsigned levels;
+	bool append;
 	int result;
 
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
-
-	/* Since we're using a static buffer, we'd better be locked. */
-	KASSERT(vfs_biglock_do_i_hold());
+	/* Anything allocated past EOF is probably being appended */
+	append = (off_t)fileblock * SFS_BLOCKSIZE >= (off_t)sv->sv_i.sfi_size;
 
 	/*
-	 * If the block we want is one of the direct blocks...
+	 * If the block we want is one of the direct blocks, it's
+	 * right in the inode.
 	 */
 	if (fileblock < SFS_NDIRECT) {
-		/*
-		 * Get the block number
-		 */
 		block = sv->sv_i.sfi_direct[fileblock];
-
-		/*
-		 * Do we need to allocate?
-		 */
 		if (block==0 && doalloc) {
-			result = sfs_balloc(sfs, &block);
+			result = sfs_balloc_file(sv, prev, append, &block);
 			if (result) {
 				return result;
 			}
@@ -91,97 +110,141 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 			sv->sv_i.sfi_direct[fileblock] = block;
 			sv->sv_dirty = true;
 		}
-
-		/*
-		 * Hand back the block
-		 */
-		if (block != 0 && !sfs_bused(sfs, block)) {
-			panic("sfs: %s: Data block %u (block %u of file %u) "
-			      "marked free\n", sfs->sfs_sb.sb_volname,
-			      block, fileblock, sv->sv_ino);
-		}
 		*diskblock = block;
 		return 0;
 	}
 
-	/*
-	 * It's not a direct block; it must be in the indirect block.
-	 * Subtract off the number of direct blocks, so FILEBLOCK is
-	 * now the offset into the indirect block space.
-	 */
-
-	fileblock -= SFS_NDIRECT;
+	if (sv->sv_bmapleaf != 0 && fileblock >= sv->sv_bmapbase &&
+	    fileblock - sv->sv_bmapbase < SFS_DBPERIDB) {
+		/* Same leaf as last time; skip the upper levels. */
+		idblock = sv->sv_bmapleaf;
+		offset = fileblock - sv->sv_bmapbase;
+		levels = 1;
+		span = SFS_DBPERIDB;
+	}
+	else {
+		/*
+		 * Find which tree the block is in, and its offset
+		 * within that tree. SPAN is how many file blocks the
+		 * whole tree maps.
+		 */
+		offset = fileblock - SFS_NDIRECT;
+		span = SFS_DBPERIDB;
+		for (levels=1; offset >= span; levels++) {
+			if (levels == SFS_MAXLEVELS) {
+				/* Past the end of the biggest tree */
+				return EFBIG;
+			}
+			offset -= span;
+			span *= SFS_DBPERIDB;
+		}
 
-	/* Get the indirect block number and offset w/i that indirect block */
-	idnum = fileblock / SFS_DBPERIDB;
-	idoff = fileblock % SFS_DBPERIDB;
+		root = sfs_bmap_root(sv, levels);
+		idblock = *root;
+		if (idblock==0 && !doalloc) {
+			/*
+			 * No tree at all. We weren't asked to allocate
+			 * anything, so pretend it's full of zeros.
+			 */
+			*diskblock = 0;
+			return 0;
+		}
+		else if (idblock==0) {
+			result = sfs_balloc_file(sv, prev, append, &idblock);
+			if (result) {
+				return result;
+			}
+			*root = idblock;
+			sv->sv_dirty = true;
+			prev = idblock;
+		}
+	}
 
 	/*
-	 * We only have one indirect block. If the offset we were asked for
-	 * is too large, we can't handle it, so fail.
+	 * Go down through the tree, one indirect block per level,
+	 * until IDBLOCK is the indirect block that holds the data
+	 * block's number. A newly allocated indirect block was zeroed
+	 * in the cache by sfs_balloc_file, so reading it won't go to
+	 * disk.
 	 */
-	if (idnum >= SFS_NINDIRECT) {
-		return EFBIG;
-	}
-
-	/* Get the disk block number of the indirect block. */
-	idblock = sv->sv_i.sfi_indirect;
+	for (; levels > 0; levels--) {
+		span /= SFS_DBPERIDB;
+		idx = offset / span;
+		offset %= span;
+
+		if (levels == 1) {
+			/* Remember the leaf for next time */
+			sv->sv_bmapleaf = idblock;
+			sv->sv_bmapbase = fileblock - idx;
+		}
 
-	if (idblock==0 && !doalloc) {
-		/*
-		 * There's no indirect block allocated. We weren't
-		 * asked to allocate anything, so pretend the indirect
-		 * block was filled with all zeros.
-		 */
-		*diskblock = 0;
-		return 0;
-	}
-	else if (idblock==0) {
-		/*
-		 * There's no indirect block allocated, but we need to
-		 * allocate a block whose number needs to be stored in
-		 * the indirect block. Thus, we need to allocate an
-		 * indirect block.
-		 */
-		result = sfs_balloc(sfs, &idblock);
+		result = buf_read(sfs->sfs_device, idblock, &idbuf);
 		if (result) {
 			return result;
 		}
+		idptrs = buf_data(idbuf);
 
-		/* Remember the block we just allocated */
-		sv->sv_i.sfi_indirect = idblock;
+		block = idptrs[idx];
+		if (block==0 && doalloc) {
+			result = sfs_balloc_file(sv, prev, append, &block);
+			if (result) {
+				buf_release(idbuf);
+				return result;
+			}
 
-		/* Mark the inode dirty */
-		sv->sv_dirty = true;
+			/* Remember it; the indirect block is dirty */
+			idptrs[idx] = block;
+			buf_markdirty(idbuf);
+			prev = block;
+		}
+		buf_release(idbuf);
 
-		/* Clear the indirect block buffer */
-		bzero(idbuf, sizeof(idbuf));
-	}
-	else {
-		/*
-		 * We already have an indirect block allocated; load it.
-		 */
-		result = sfs_readblock(sfs, idblock, idbuf, sizeof(idbuf));
-		if (result) {
-			return result;
+		if (block == 0) {
+			/* A hole */
+			break;
 		}
+		idblock = block;
 	}
 
-	/* Get the block out of the indirect block buffer */
-	block = idbuf[idoff];
+	*diskblock = block;
+	return 0;
+}
 
-	/* If there's no block there, allocate one */
-	if (block==0 && doalloc) {
-		result = sfs_balloc(sfs, &block);
-		if (result) {
-			return result;
-		}
+/*
+ * Look up the disk block number (from 0 up to the number of blocks on
+ * the disk) given a file and the logical block number within that
+ * file. If DOALLOC is set, and no such block exists, one will be
+ * allocated, as close after the file's previous block as possible.
+ */
+int
+sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
+	 daddr_t *diskblock)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	daddr_t block, prev;
+	int result;
+
+	KASSERT(SFS_DBPERIDB * sizeof(uint32_t) == SFS_BLOCKSIZE);
 
-		/* Remember the block we allocated */
-		idbuf[idoff] = block;
+	/* We're changing the inode; we'd better be locked. */
+	KASSERT(lock_do_i_hold(sv->sv_lock));
 
-		/* The indirect block is now dirty; write it back */
-		result = sfs_writeblock(sfs, idblock, idbuf, sizeof(idbuf));
+	result = sfs_bmap_walk(sv, fileblock, false, 0, &block);
+	if (result) {
+		return result;
+	}
+
+	if (block==0 && doalloc) {
+		/* Find the previous block, to put the new one after */
+		prev = 0;
+		if (fileblock > 0) {
+			result = sfs_bmap_walk(sv, fileblock-1, false, 0,
+					       &prev);
+			if (result) {
+				return result;
+			}
+		}
+		result = sfs_bmap_walk(sv, fileblock, true, prev, &block);
 		if (result) {
 			return result;
 		}
@@ -197,35 +260,107 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 	return 0;
 }
 
+/*
+ * Free everything at or past file block KEEP under indirect block
+ * IDBLOCK, which has LEVELS levels (counting itself) and maps the
+ * file blocks starting at BASE. Sets *EMPTY if nothing is left in
+ * it; the caller then frees IDBLOCK itself.
+ */
+static
+int
+sfs_itrunc_ib(struct sfs_vnode *sv, daddr_t idblock, unsigned levels,
+	      uint32_t base, uint32_t keep, bool *empty)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct buf *idbuf;
+	uint32_t *idptrs;
+	uint32_t span, i;
+	bool childempty, iddirty;
+	int result;
+
+	/* How many file blocks each entry maps */
+	span = 1;
+	for (i=1; i<levels; i++) {
+		span *= SFS_DBPERIDB;
+	}
+
+	result = buf_read(sfs->sfs_device, idblock, &idbuf);
+	if (result) {
+		return result;
+	}
+	idptrs = buf_data(idbuf);
+
+	*empty = true;
+	iddirty = false;
+	for (i=0; i<SFS_DBPERIDB; i++) {
+		if (idptrs[i] == 0) {
+			continue;
+		}
+		if (base + (i+1)*span <= keep) {
+			/* Entirely before the new EOF */
+			*empty = false;
+			continue;
+		}
+
+		if (levels > 1) {
+			result = sfs_itrunc_ib(sv, idptrs[i], levels-1,
+					       base + i*span, keep,
+					       &childempty);
+			if (result) {
+				if (iddirty) {
+					buf_markdirty(idbuf);
+				}
+				buf_release(idbuf);
+				return result;
+			}
+			if (!childempty) {
+				*empty = false;
+				continue;
+			}
+		}
+
+		/* Discard it; it's past the new EOF or now empty */
+		sfs_bfree(sfs, idptrs[i]);
+		idptrs[i] = 0;
+		iddirty = true;
+	}
+
+	if (iddirty) {
+		buf_markdirty(idbuf);
+	}
+	buf_release(idbuf);
+	return 0;
+}
+
 /*
  * Called for ftruncate() and from sfs_reclaim.
  */
 int
 sfs_itrunc(struct sfs_vnode *sv, off_t len)
 {
-	/*
-	 * I/O buffer for handling the indirect block.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
-
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	uint32_t blocklen;
+	uint32_t i, base, span;
+	uint32_t *root;
+	unsigned levels;
+	daddr_t block;
+	bool empty;
+	int result;
 
-	/* Length in blocks (divide rounding up) */
-	uint32_t blocklen = DIVROUNDUP(len, SFS_BLOCKSIZE);
+	KASSERT(lock_do_i_hold(sv->sv_lock));
 
-	uint32_t i, j;
-	daddr_t block, idblock;
-	uint32_t baseblock, highblock;
-	int result;
-	int hasnonzero, iddirty;
+	if (len > SFS_MAXFILESIZE) {
+		return EFBIG;
+	}
+
+	/* Length in blocks (divide rounding up) */
+	blocklen = DIVROUNDUP(len, SFS_BLOCKSIZE);
 
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
+	/* Anything reserved for appending goes back first. */
+	sfs_prealloc_release(sv);
 
-	vfs_biglock_acquire();
+	/* The remembered leaf might be about to go away. */
+	sv->sv_bmapleaf = 0;
 
 	/*
 	 * Go through the direct blocks. Discard any that are
@@ -240,55 +375,30 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 		}
 	}
 
-	/* Indirect block number */
-	idblock = sv->sv_i.sfi_indirect;
-
-	/* The lowest block in the indirect block */
-	baseblock = SFS_NDIRECT;
-
-	/* The highest block in the indirect block */
-	highblock = baseblock + SFS_DBPERIDB - 1;
-
-	if (blocklen < highblock && idblock != 0) {
-		/* We're past the proposed EOF; may need to free stuff */
-
-		/* Read the indirect block */
-		result = sfs_readblock(sfs, idblock, idbuf, sizeof(idbuf));
-		if (result) {
-			vfs_biglock_release();
-			return result;
-		}
-
-		hasnonzero = 0;
-		iddirty = 0;
-		for (j=0; j<SFS_DBPERIDB; j++) {
-			/* Discard any blocks that are past the new EOF */
-			if (blocklen < baseblock+j && idbuf[j] != 0) {
-				sfs_bfree(sfs, idbuf[j]);
-				idbuf[j] = 0;
-				iddirty = 1;
-			}
-			/* Remember if we see any nonzero blocks in here */
-			if (idbuf[j]!=0) {
-				hasnonzero=1;
-			}
-		}
-
-		if (!hasnonzero) {
-			/* The whole indirect block is empty now; free it */
-			sfs_bfree(sfs, idblock);
-			sv->sv_i.sfi_indirect = 0;
-			sv->sv_dirty = true;
-		}
-		else if (iddirty) {
-			/* The indirect block is dirty; write it back */
-			result = sfs_writeblock(sfs, idblock, idbuf,
-						sizeof(idbuf));
+	/*
+	 * Then each tree of indirect blocks that reaches past the new
+	 * EOF. BASE is the first file block the tree maps and SPAN is
+	 * how many it maps.
+	 */
+	base = SFS_NDIRECT;
+	span = SFS_DBPERIDB;
+	for (levels=1; levels<=SFS_MAXLEVELS; levels++) {
+		root = sfs_bmap_root(sv, levels);
+		if (*root != 0 && base + span > blocklen) {
+			result = sfs_itrunc_ib(sv, *root, levels, base,
+					       blocklen, &empty);
 			if (result) {
-				vfs_biglock_release();
 				return result;
 			}
+			if (empty) {
+				/* The whole tree is empty now; free it */
+				sfs_bfree(sfs, *root);
+				*root = 0;
+				sv->sv_dirty = true;
+			}
 		}
+		base += span;
+		span *= SFS_DBPERIDB;
 	}
 
 	/* Set the file size */
@@ -297,7 +407,42 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 	/* Mark the inode dirty */
 	sv->sv_dirty = true;
 
-	vfs_biglock_release();
 	return 0;
 }
 
+/*
+ * Called for FIORESERVE: allocate every block of the file up to LEN
+ * bytes, and extend the file to LEN if it's shorter, so later writes
+ * there can't run out of space. Like posix_fallocate, the new part of
+ * the file reads as zeros.
+ */
+int
+sfs_ireserve(struct sfs_vnode *sv, off_t len)
+{
+	off_t oldsize = sv->sv_i.sfi_size;
+	uint32_t nblocks, i;
+	daddr_t diskblock;
+	int result;
+
+	KASSERT(lock_do_i_hold(sv->sv_lock));
+
+	if (len > SFS_MAXFILESIZE) {
+		return EFBIG;
+	}
+	nblocks = DIVROUNDUP(len, SFS_BLOCKSIZE);
+
+	for (i=0; i<nblocks; i++) {
+		result = sfs_bmap(sv, i, true, &diskblock);
+		if (result) {
+			/* Give back what we got past EOF. */
+			sfs_itrunc(sv, oldsize);
+			return result;
+		}
+	}
+
+	if (len > oldsize) {
+		sv->sv_i.sfi_size = len;
+		sv->sv_dirty = true;
+	}
+	return 0;
+}
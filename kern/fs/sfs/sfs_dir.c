@@ -35,24 +35,38 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <synch.h>
 #include <vfs.h>
+#include <buf.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
 /*
- * Read the directory entry out of slot SLOT of a directory vnode.
- * The "slot" is the index of the directory entry, starting at 0.
+ * Hashed directories (see kern/sfs.h). A linear directory is converted
+ * when it fills up at SFS_DIRHASH_MINBUCKETS blocks or more, and a
+ * hashed one is doubled when a new entry would land more than
+ * SFS_DIRHASH_MAXPROBE blocks from home. SFS_DIRHASH_MAXBUCKETS caps
+ * how big the table gets; past that the probe sequences just get
+ * longer.
+ */
+#define SFS_DIRHASH_MINBUCKETS	4
+#define SFS_DIRHASH_MAXPROBE	2
+#define SFS_DIRHASH_MAXBUCKETS	1024
+
+/*
+ * Hash a name.
  */
 static
-int
-sfs_readdir(struct sfs_vnode *sv, int slot, struct sfs_direntry *sd)
+uint32_t
+sfs_dirhash(const char *name)
 {
-	off_t actualpos;
+	uint32_t h = SFS_DIRHASH_BASIS;
 
-	/* Compute the actual position in the directory to read. */
-	actualpos = slot * sizeof(struct sfs_direntry);
-
-	return sfs_metaio(sv, actualpos, sd, sizeof(*sd), UIO_READ);
+	for (; *name != 0; name++) {
+		h ^= (unsigned char)*name;
+		h *= SFS_DIRHASH_PRIME;
+	}
+	return h;
 }
 
 /*
@@ -72,6 +86,30 @@ sfs_writedir(struct sfs_vnode *sv, int slot, struct sfs_direntry *sd)
 	return sfs_metaio(sv, actualpos, sd, sizeof(*sd), UIO_WRITE);
 }
 
+/*
+ * Get the buffer for block BLOCK of a directory, so its entries can be
+ * looked at in place. Hands back NULL for a hole, which holds only
+ * empty slots.
+ */
+static
+int
+sfs_dir_getblock(struct sfs_vnode *sv, unsigned block, struct buf **ret)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	daddr_t diskblock;
+	int result;
+
+	result = sfs_bmap(sv, block, false, &diskblock);
+	if (result) {
+		return result;
+	}
+	if (diskblock == 0) {
+		*ret = NULL;
+		return 0;
+	}
+	return buf_read(sfs->sfs_device, diskblock, ret);
+}
+
 /*
  * Compute the number of entries in a directory.
  * This actually computes the number of existing slots, and does not
@@ -95,6 +133,142 @@ sfs_dir_nentries(struct sfs_vnode *sv)
 	return size / sizeof(struct sfs_direntry);
 }
 
+/*
+ * Check if a directory is hashed. If the fields don't make sense
+ * (e.g. because a kernel that doesn't know about hashing appended to
+ * the directory) treat it as linear.
+ */
+static
+bool
+sfs_dir_ishashed(struct sfs_vnode *sv)
+{
+	uint32_t nbuckets = sv->sv_i.sfi_dirhash;
+
+	return nbuckets != 0 && (nbuckets & (nbuckets - 1)) == 0 &&
+		sv->sv_i.sfi_size == nbuckets * SFS_BLOCKSIZE;
+}
+
+/*
+ * Number of blocks slot SLOT is past the home bucket for NAME.
+ */
+static
+unsigned
+sfs_dir_probedist(const char *name, int slot, unsigned nbuckets)
+{
+	unsigned home;
+
+	home = sfs_dirhash(name) & (nbuckets - 1);
+	return (slot / SFS_DIRENTPERBLOCK - home) & (nbuckets - 1);
+}
+
+/*
+ * Check if directory entry SD has name NAME. The name on disk might
+ * not be null-terminated, and we can't fix it in place.
+ */
+static
+bool
+sfs_dir_namematch(const struct sfs_direntry *sd, const char *name)
+{
+	unsigned i;
+
+	for (i=0; i<sizeof(sd->sfd_name)-1; i++) {
+		if (sd->sfd_name[i] != name[i]) {
+			return false;
+		}
+		if (name[i] == 0) {
+			return true;
+		}
+	}
+	/* Treat the last byte as 0, as if it had been terminated. */
+	return name[i] == 0;
+}
+
+/*
+ * Look through the NUM entries in SDS (slots FIRST and up) for NAME
+ * (if not NULL) and for an empty slot. Returns true if NAME was found.
+ */
+static
+bool
+sfs_dir_scan(struct sfs_direntry *sds, unsigned num, int first,
+	     const char *name, uint32_t *ino, int *slot, int *emptyslot)
+{
+	unsigned i;
+
+	for (i=0; i<num; i++) {
+		if (sds[i].sfd_ino == SFS_NOINO) {
+			/* Free slot - report it back if one was requested */
+			if (emptyslot != NULL) {
+				*emptyslot = first + i;
+			}
+			continue;
+		}
+		if (name != NULL && sfs_dir_namematch(&sds[i], name)) {
+			if (slot != NULL) {
+				*slot = first + i;
+			}
+			if (ino != NULL) {
+				*ino = sds[i].sfd_ino;
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * sfs_dir_findname for a hashed directory: only look in the blocks
+ * the name could be in. If an empty slot is wanted, hand back the
+ * first one in the probe sequence, even if it's further along than
+ * the name could be; sfs_dir_link sorts that out.
+ */
+static
+int
+sfs_dir_hashfind(struct sfs_vnode *sv, const char *name,
+		 uint32_t *ino, int *slot, int *emptyslot)
+{
+	struct buf *b;
+	unsigned nbuckets, maxprobe, home, block, d;
+	int empty = -1;
+	bool found = false;
+	int result;
+
+	nbuckets = sv->sv_i.sfi_dirhash;
+	maxprobe = sv->sv_i.sfi_dirmaxprobe;
+	home = sfs_dirhash(name) & (nbuckets - 1);
+
+	for (d=0; d<nbuckets; d++) {
+		if (d > maxprobe && (emptyslot == NULL || empty >= 0)) {
+			break;
+		}
+		block = (home + d) & (nbuckets - 1);
+
+		result = sfs_dir_getblock(sv, block, &b);
+		if (result) {
+			return result;
+		}
+		if (b == NULL) {
+			if (empty < 0) {
+				empty = block * SFS_DIRENTPERBLOCK;
+			}
+			continue;
+		}
+		/* Past maxprobe we're only looking for room. */
+		found = sfs_dir_scan(buf_data(b), SFS_DIRENTPERBLOCK,
+				     block * SFS_DIRENTPERBLOCK,
+				     d <= maxprobe ? name : NULL,
+				     ino, slot, empty < 0 ? &empty : NULL);
+		buf_release(b);
+		if (found) {
+			return 0;
+		}
+	}
+
+	if (emptyslot != NULL && empty >= 0) {
+		*emptyslot = empty;
+	}
+	return ENOENT;
+}
+
 /*
  * Search a directory for a particular filename in a directory, and
  * return its inode number, its slot, and/or the slot number of an
@@ -104,57 +278,230 @@ int
 sfs_dir_findname(struct sfs_vnode *sv, const char *name,
 		uint32_t *ino, int *slot, int *emptyslot)
 {
-	struct sfs_direntry tsd;
-	int found, nentries, i, result;
+	struct buf *b;
+	unsigned nblocks, block, num;
+	int nentries, result;
+
+	if (sfs_dir_ishashed(sv)) {
+		return sfs_dir_hashfind(sv, name, ino, slot, emptyslot);
+	}
 
 	nentries = sfs_dir_nentries(sv);
+	nblocks = DIVROUNDUP(nentries, SFS_DIRENTPERBLOCK);
 
-	/* For each slot... */
-	found = 0;
-	for (i=0; i<nentries; i++) {
+	/* For each block... */
+	for (block=0; block<nblocks; block++) {
+		num = nentries - block * SFS_DIRENTPERBLOCK;
+		if (num > SFS_DIRENTPERBLOCK) {
+			num = SFS_DIRENTPERBLOCK;
+		}
 
-		/* Read the entry from that slot */
-		result = sfs_readdir(sv, i, &tsd);
+		result = sfs_dir_getblock(sv, block, &b);
 		if (result) {
 			return result;
 		}
-		if (tsd.sfd_ino == SFS_NOINO) {
-			/* Free slot - report it back if one was requested */
+		if (b == NULL) {
 			if (emptyslot != NULL) {
-				*emptyslot = i;
+				*emptyslot = block * SFS_DIRENTPERBLOCK;
 			}
+			continue;
+		}
+		if (sfs_dir_scan(buf_data(b), num, block * SFS_DIRENTPERBLOCK,
+				 name, ino, slot, emptyslot)) {
+			/* Each name may legally appear only once. */
+			buf_release(b);
+			return 0;
+		}
+		buf_release(b);
+	}
+
+	return ENOENT;
+}
+
+/*
+ * Pick a table size for NUM entries: at most half full.
+ */
+static
+unsigned
+sfs_dir_hashsize(unsigned num)
+{
+	unsigned nbuckets = SFS_DIRHASH_MINBUCKETS;
+
+	while (nbuckets * SFS_DIRENTPERBLOCK < 2 * num &&
+	       nbuckets < SFS_DIRHASH_MAXBUCKETS) {
+		nbuckets *= 2;
+	}
+	return nbuckets;
+}
+
+/*
+ * Put SD in the first empty slot along its probe sequence, in a
+ * directory that is being rebuilt as a hash table of NBUCKETS blocks
+ * (all allocated). Hands back the probe distance.
+ */
+static
+int
+sfs_dir_hashinsert(struct sfs_vnode *sv, unsigned nbuckets,
+		   const struct sfs_direntry *sd, unsigned *dist)
+{
+	struct sfs_direntry *sds;
+	struct buf *b;
+	unsigned home, block, d, i;
+	int result;
+
+	home = sfs_dirhash(sd->sfd_name) & (nbuckets - 1);
+	for (d=0; d<nbuckets; d++) {
+		block = (home + d) & (nbuckets - 1);
+		result = sfs_dir_getblock(sv, block, &b);
+		if (result) {
+			return result;
 		}
-		else {
-			/* Ensure null termination, just in case */
-			tsd.sfd_name[sizeof(tsd.sfd_name)-1] = 0;
-			if (!strcmp(tsd.sfd_name, name)) {
-
-				/* Each name may legally appear only once... */
-				KASSERT(found==0);
-
-				found = 1;
-				if (slot != NULL) {
-					*slot = i;
-				}
-				if (ino != NULL) {
-					*ino = tsd.sfd_ino;
-				}
+		KASSERT(b != NULL);
+		sds = buf_data(b);
+		for (i=0; i<SFS_DIRENTPERBLOCK; i++) {
+			if (sds[i].sfd_ino == SFS_NOINO) {
+				sds[i] = *sd;
+				buf_markdirty(b);
+				buf_release(b);
+				*dist = d;
+				return 0;
 			}
 		}
+		buf_release(b);
 	}
+	return ENOSPC;
+}
+
+/*
+ * Rebuild a directory as a hash table of NBUCKETS blocks, which must
+ * be at least as many as it has now. This is done in place through
+ * the buffer cache, one block at a time.
+ *
+ * First the directory is grown to NBUCKETS blocks, all allocated and
+ * empty, so if we run out of space it can be cut back to what it was.
+ * Then each old block in turn is emptied and its entries put back
+ * where they hash to. An entry can land in an old block that hasn't
+ * had its turn yet; it just gets moved again, so the recorded probe
+ * length may come out a bit longer than needed, which is harmless.
+ */
+static
+int
+sfs_dir_rehash(struct sfs_vnode *sv, unsigned nbuckets)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct sfs_direntry *scratch, *sds;
+	struct buf *b;
+	daddr_t diskblock;
+	unsigned oldblocks, block, num, i, d, maxprobe;
+	off_t oldsize;
+	int nentries, result;
+
+	KASSERT(nbuckets > 0 && (nbuckets & (nbuckets - 1)) == 0);
 
-	return found ? 0 : ENOENT;
+	nentries = sfs_dir_nentries(sv);
+	oldsize = sv->sv_i.sfi_size;
+	oldblocks = DIVROUNDUP(oldsize, SFS_BLOCKSIZE);
+	if (oldblocks > nbuckets) {
+		return ENOSPC;
+	}
+
+	scratch = kmalloc(SFS_BLOCKSIZE);
+	if (scratch == NULL) {
+		return ENOMEM;
+	}
+
+	/* Allocate every block, filling in any holes too. */
+	for (block=0; block<nbuckets; block++) {
+		result = sfs_bmap(sv, block, true, &diskblock);
+		if (result) {
+			goto undo;
+		}
+	}
+
+	/* Slots past the old end become part of the table; clear them. */
+	num = nentries % SFS_DIRENTPERBLOCK;
+	if (num != 0) {
+		result = sfs_dir_getblock(sv, oldblocks - 1, &b);
+		if (result) {
+			goto undo;
+		}
+		sds = buf_data(b);
+		bzero(&sds[num], (SFS_DIRENTPERBLOCK - num) * sizeof(*sds));
+		buf_markdirty(b);
+		buf_release(b);
+	}
+
+	sv->sv_i.sfi_size = nbuckets * SFS_BLOCKSIZE;
+	sv->sv_dirty = true;
+
+	/*
+	 * Move the entries. From here on the only thing that can fail
+	 * is I/O, and the entries in SCRATCH would be lost; there's no
+	 * going back.
+	 */
+	maxprobe = 0;
+	for (block=0; block<oldblocks; block++) {
+		result = sfs_dir_getblock(sv, block, &b);
+		if (result) {
+			break;
+		}
+		sds = buf_data(b);
+		memcpy(scratch, sds, SFS_BLOCKSIZE);
+		bzero(sds, SFS_BLOCKSIZE);
+		buf_markdirty(b);
+		buf_release(b);
+
+		for (i=0; i<SFS_DIRENTPERBLOCK; i++) {
+			if (scratch[i].sfd_ino == SFS_NOINO) {
+				continue;
+			}
+			scratch[i].sfd_name[sizeof(scratch[i].sfd_name)-1] = 0;
+			result = sfs_dir_hashinsert(sv, nbuckets, &scratch[i],
+						    &d);
+			if (result) {
+				break;
+			}
+			if (d > maxprobe) {
+				maxprobe = d;
+			}
+		}
+		if (result) {
+			break;
+		}
+	}
+	kfree(scratch);
+	if (result) {
+		panic("sfs: %s: directory %u: rehash: %s\n",
+		      sfs->sfs_sb.sb_volname, sv->sv_ino, strerror(result));
+	}
+
+	sv->sv_i.sfi_dirhash = nbuckets;
+	sv->sv_i.sfi_dirmaxprobe = maxprobe;
+	sv->sv_dirty = true;
+	return 0;
+
+ undo:
+	kfree(scratch);
+	if (sfs_itrunc(sv, oldsize)) {
+		panic("sfs: %s: directory %u: Cannot undo rehash\n",
+		      sfs->sfs_sb.sb_volname, sv->sv_ino);
+	}
+	return result;
 }
 
 /*
  * Create a link in a directory to the specified inode by number, with
  * the specified name, and optionally hand back the slot.
+ *
+ * This may rebuild the directory and move other entries around, so
+ * slot numbers found before calling it are no longer good.
  */
 int
 sfs_dir_link(struct sfs_vnode *sv, const char *name, uint32_t ino, int *slot)
 {
 	int emptyslot = -1;
-	int result;
+	int nentries, result;
+	unsigned nbuckets, dist;
 	struct sfs_direntry sd;
 
 	/* Look up the name. We want to make sure it *doesn't* exist. */
@@ -170,8 +517,54 @@ sfs_dir_link(struct sfs_vnode *sv, const char *name, uint32_t ino, int *slot)
 		return ENAMETOOLONG;
 	}
 
-	/* If we didn't get an empty slot, add the entry at the end. */
-	if (emptyslot < 0) {
+	/*
+	 * If a big enough linear directory is full, hash it instead of
+	 * adding to the end. If that doesn't work, just add to the end.
+	 */
+	if (!sfs_dir_ishashed(sv) && emptyslot < 0) {
+		nentries = sfs_dir_nentries(sv);
+		if (nentries >= (int)(SFS_DIRHASH_MINBUCKETS *
+				      SFS_DIRENTPERBLOCK) &&
+		    sfs_dir_rehash(sv, sfs_dir_hashsize(nentries+1)) == 0) {
+			result = sfs_dir_findname(sv, name, NULL, NULL,
+						  &emptyslot);
+			if (result != ENOENT) {
+				return result;
+			}
+		}
+	}
+
+	if (sfs_dir_ishashed(sv)) {
+		/*
+		 * If the table's full, or the entry would be too far
+		 * from home, double it. If that doesn't work, live with
+		 * a longer probe if we can.
+		 */
+		nbuckets = sv->sv_i.sfi_dirhash;
+		if ((emptyslot < 0 ||
+		     sfs_dir_probedist(name, emptyslot, nbuckets)
+		     > SFS_DIRHASH_MAXPROBE) &&
+		    nbuckets < SFS_DIRHASH_MAXBUCKETS &&
+		    sfs_dir_rehash(sv, nbuckets * 2) == 0) {
+			nbuckets *= 2;
+			emptyslot = -1;
+			result = sfs_dir_findname(sv, name, NULL, NULL,
+						  &emptyslot);
+			if (result != ENOENT) {
+				return result;
+			}
+		}
+		if (emptyslot < 0) {
+			return ENOSPC;
+		}
+		dist = sfs_dir_probedist(name, emptyslot, nbuckets);
+		if (dist > sv->sv_i.sfi_dirmaxprobe) {
+			sv->sv_i.sfi_dirmaxprobe = dist;
+			sv->sv_dirty = true;
+		}
+	}
+	else if (emptyslot < 0) {
+		/* No empty slot: add the entry at the end. */
 		emptyslot = sfs_dir_nentries(sv);
 	}
 
@@ -38,9 +38,11 @@
 #include <lib.h>
 #include <array.h>
 #include <bitmap.h>
+#include <synch.h>
 #include <uio.h>
 #include <vfs.h>
 #include <device.h>
+#include <buf.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
@@ -112,13 +114,47 @@ static
 int
 sfs_sync_vnodes(struct sfs_fs *sfs)
 {
-	unsigned i, num;
+	struct sfs_vnbucket *vb;
+	struct sfs_vnode **svs, *sv;
+	unsigned b, i, num;
 
-	/* Go over the array of loaded vnodes, syncing as we go. */
-	num = vnodearray_num(sfs->sfs_vnodes);
-	for (i=0; i<num; i++) {
-		struct vnode *v = vnodearray_get(sfs->sfs_vnodes, i);
-		VOP_FSYNC(v);
+	/*
+	 * Each inode has to be synced under its own lock, which comes
+	 * before the bucket locks, so for each bucket take a reference
+	 * to everything in it and then do them one at a time with the
+	 * bucket unlocked. This only puts the inodes in the buffer
+	 * cache; sfs_sync writes everything out at the end.
+	 */
+	for (b=0; b<SFS_VNHASHSIZE; b++) {
+		vb = &sfs->sfs_vnhash[b];
+
+		lock_acquire(vb->vb_lock);
+		num = vb->vb_count;
+		if (num == 0) {
+			lock_release(vb->vb_lock);
+			continue;
+		}
+		svs = kmalloc(num * sizeof(*svs));
+		if (svs == NULL) {
+			lock_release(vb->vb_lock);
+			return ENOMEM;
+		}
+		i = 0;
+		for (sv = vb->vb_head; sv != NULL; sv = sv->sv_hashnext) {
+			VOP_INCREF(&sv->sv_absvn);
+			svs[i++] = sv;
+		}
+		KASSERT(i == num);
+		lock_release(vb->vb_lock);
+
+		for (i=0; i<num; i++) {
+			sv = svs[i];
+			lock_acquire(sv->sv_lock);
+			sfs_sync_inode(sv);
+			lock_release(sv->sv_lock);
+			VOP_DECREF(&sv->sv_absvn);
+		}
+		kfree(svs);
 	}
 	return 0;
 }
@@ -132,13 +168,16 @@ sfs_sync_freemap(struct sfs_fs *sfs)
 {
 	int result;
 
+	lock_acquire(sfs->sfs_freemaplock);
 	if (sfs->sfs_freemapdirty) {
 		result = sfs_freemapio(sfs, UIO_WRITE);
 		if (result) {
+			lock_release(sfs->sfs_freemaplock);
 			return result;
 		}
 		sfs->sfs_freemapdirty = false;
 	}
+	lock_release(sfs->sfs_freemaplock);
 
 	return 0;
 }
@@ -152,14 +191,17 @@ sfs_sync_superblock(struct sfs_fs *sfs)
 {
 	int result;
 
+	lock_acquire(sfs->sfs_freemaplock);
 	if (sfs->sfs_superdirty) {
 		result = sfs_writeblock(sfs, SFS_SUPER_BLOCK, &sfs->sfs_sb,
 					sizeof(sfs->sfs_sb));
 		if (result) {
+			lock_release(sfs->sfs_freemaplock);
 			return result;
 		}
 		sfs->sfs_superdirty = false;
 	}
+	lock_release(sfs->sfs_freemaplock);
 	return 0;
 }
 
@@ -174,7 +216,8 @@ sfs_sync(struct fs *fs)
 	struct sfs_fs *sfs;
 	int result;
 
-	vfs_biglock_acquire();
+	/* vfs_sync and vfs_unmount call us with the big lock held. */
+	KASSERT(vfs_biglock_do_i_hold());
 
 	/*
 	 * Get the sfs_fs from the generic abstract fs.
@@ -211,25 +254,27 @@ sfs_sync(struct fs *fs)
 	/* If any vnodes need to be written, write them. */
 	result = sfs_sync_vnodes(sfs);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
 	/* If the free block map needs to be written, write it. */
 	result = sfs_sync_freemap(sfs);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
 	/* If the superblock needs to be written, write it. */
 	result = sfs_sync_superblock(sfs);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
-	vfs_biglock_release();
+	/* Now write back everything that's dirty in the buffer cache. */
+	result = buf_sync(sfs->sfs_device);
+	if (result) {
+		return result;
+	}
+
 	return 0;
 }
 
@@ -243,13 +288,9 @@ const char *
 sfs_getvolname(struct fs *fs)
 {
 	struct sfs_fs *sfs = fs->fs_data;
-	const char *ret;
 
-	vfs_biglock_acquire();
-	ret = sfs->sfs_sb.sb_volname;
-	vfs_biglock_release();
-
-	return ret;
+	/* The volume name never changes once mounted. */
+	return sfs->sfs_sb.sb_volname;
 }
 
 /*
@@ -259,10 +300,16 @@ static
 void
 sfs_fs_destroy(struct sfs_fs *sfs)
 {
+	unsigned i;
+
 	if (sfs->sfs_freemap != NULL) {
 		bitmap_destroy(sfs->sfs_freemap);
 	}
-	vnodearray_destroy(sfs->sfs_vnodes);
+	lock_destroy(sfs->sfs_freemaplock);
+	for (i=0; i<SFS_VNHASHSIZE; i++) {
+		KASSERT(sfs->sfs_vnhash[i].vb_head == NULL);
+		lock_destroy(sfs->sfs_vnhash[i].vb_lock);
+	}
 	KASSERT(sfs->sfs_device == NULL);
 	kfree(sfs);
 }
@@ -277,19 +324,36 @@ int
 sfs_unmount(struct fs *fs)
 {
 	struct sfs_fs *sfs = fs->fs_data;
+	unsigned i;
+	bool busy;
+	int result;
 
-	vfs_biglock_acquire();
+	KASSERT(vfs_biglock_do_i_hold());
 
-	/* Do we have any files open? If so, can't unmount. */
-	if (vnodearray_num(sfs->sfs_vnodes) > 0) {
-		vfs_biglock_release();
-		return EBUSY;
+	/*
+	 * Do we have any files open? If so, can't unmount. The vfs
+	 * layer has taken the filesystem out of its list, so nothing
+	 * can start using it again after this check.
+	 */
+	for (i=0; i<SFS_VNHASHSIZE; i++) {
+		lock_acquire(sfs->sfs_vnhash[i].vb_lock);
+		busy = sfs->sfs_vnhash[i].vb_count > 0;
+		lock_release(sfs->sfs_vnhash[i].vb_lock);
+		if (busy) {
+			return EBUSY;
+		}
 	}
 
 	/* We should have just had sfs_sync called. */
 	KASSERT(sfs->sfs_superdirty == false);
 	KASSERT(sfs->sfs_freemapdirty == false);
 
+	/* Drop our cached blocks; this also writes back any stragglers. */
+	result = buf_detach(sfs->sfs_device);
+	if (result) {
+		return result;
+	}
+
 	/* The vfs layer takes care of the device for us */
 	sfs->sfs_device = NULL;
 
@@ -297,7 +361,6 @@ sfs_unmount(struct fs *fs)
 	sfs_fs_destroy(sfs);
 
 	/* nothing else to do */
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -321,6 +384,7 @@ struct sfs_fs *
 sfs_fs_create(void)
 {
 	struct sfs_fs *sfs;
+	unsigned i;
 
 	/*
 	 * Make sure our on-disk structures aren't messed up
@@ -351,18 +415,30 @@ sfs_fs_create(void)
 	sfs->sfs_device = NULL;
 
 	/* vnode table */
-	sfs->sfs_vnodes = vnodearray_create();
-	if (sfs->sfs_vnodes == NULL) {
-		goto cleanup_object;
+	for (i=0; i<SFS_VNHASHSIZE; i++) {
+		sfs->sfs_vnhash[i].vb_lock = lock_create("sfs vnodes");
+		if (sfs->sfs_vnhash[i].vb_lock == NULL) {
+			goto cleanup_vnhash;
+		}
+		sfs->sfs_vnhash[i].vb_head = NULL;
+		sfs->sfs_vnhash[i].vb_count = 0;
 	}
 
 	/* freemap */
+	sfs->sfs_freemaplock = lock_create("sfs freemap");
+	if (sfs->sfs_freemaplock == NULL) {
+		goto cleanup_vnhash;
+	}
 	sfs->sfs_freemap = NULL;
 	sfs->sfs_freemapdirty = false;
 
 	return sfs;
 
-cleanup_object:
+cleanup_vnhash:
+	while (i > 0) {
+		i--;
+		lock_destroy(sfs->sfs_vnhash[i].vb_lock);
+	}
 	kfree(sfs);
 fail:
 	return NULL;
@@ -388,8 +464,6 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	int result;
 	struct sfs_fs *sfs;
 
-	vfs_biglock_acquire();
-
 	/* We don't pass any options through mount */
 	(void)options;
 
@@ -402,7 +476,6 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	 * don't do that in sfs.)
 	 */
 	if (dev->d_blocksize != SFS_BLOCKSIZE) {
-		vfs_biglock_release();
 		kprintf("sfs: Cannot mount on device with blocksize %zu\n",
 			dev->d_blocksize);
 		return ENXIO;
@@ -410,7 +483,6 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 
 	sfs = sfs_fs_create();
 	if (sfs == NULL) {
-		vfs_biglock_release();
 		return ENOMEM;
 	}
 
@@ -421,9 +493,9 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	result = sfs_readblock(sfs, SFS_SUPER_BLOCK, &sfs->sfs_sb,
 			       sizeof(sfs->sfs_sb));
 	if (result) {
+		buf_detach(dev);
 		sfs->sfs_device = NULL;
 		sfs_fs_destroy(sfs);
-		vfs_biglock_release();
 		return result;
 	}
 
@@ -434,9 +506,9 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 			"(0x%x, should be 0x%x)\n",
 			sfs->sfs_sb.sb_magic,
 			SFS_MAGIC);
+		buf_detach(dev);
 		sfs->sfs_device = NULL;
 		sfs_fs_destroy(sfs);
-		vfs_biglock_release();
 		return EINVAL;
 	}
 
@@ -451,23 +523,22 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	/* Load free block bitmap */
 	sfs->sfs_freemap = bitmap_create(SFS_FS_FREEMAPBITS(sfs));
 	if (sfs->sfs_freemap == NULL) {
+		buf_detach(dev);
 		sfs->sfs_device = NULL;
 		sfs_fs_destroy(sfs);
-		vfs_biglock_release();
 		return ENOMEM;
 	}
 	result = sfs_freemapio(sfs, UIO_READ);
 	if (result) {
+		buf_detach(dev);
 		sfs->sfs_device = NULL;
 		sfs_fs_destroy(sfs);
-		vfs_biglock_release();
 		return result;
 	}
 
 	/* Hand back the abstract fs */
 	*ret = &sfs->sfs_absfs;
 
-	vfs_biglock_release();
 	return 0;
 }
 
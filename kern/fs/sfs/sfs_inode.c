@@ -35,6 +35,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <synch.h>
 #include <vfs.h>
 #include <sfs.h>
 #include "sfsprivate.h"
@@ -49,6 +50,8 @@ sfs_sync_inode(struct sfs_vnode *sv)
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
 	int result;
 
+	KASSERT(lock_do_i_hold(sv->sv_lock));
+
 	if (sv->sv_dirty) {
 		result = sfs_writeblock(sfs, sv->sv_ino, &sv->sv_i,
 					sizeof(sv->sv_i));
@@ -60,6 +63,16 @@ sfs_sync_inode(struct sfs_vnode *sv)
 	return 0;
 }
 
+/*
+ * The vnode table bucket inode INO belongs in.
+ */
+static
+struct sfs_vnbucket *
+sfs_vnbucket(struct sfs_fs *sfs, uint32_t ino)
+{
+	return &sfs->sfs_vnhash[ino & (SFS_VNHASHSIZE - 1)];
+}
+
 /*
  * Called when the vnode refcount (in-memory usage count) hits zero.
  *
@@ -70,16 +83,21 @@ sfs_reclaim(struct vnode *v)
 {
 	struct sfs_vnode *sv = v->vn_data;
 	struct sfs_fs *sfs = v->vn_fs->fs_data;
-	unsigned ix, i, num;
+	struct sfs_vnbucket *vb = sfs_vnbucket(sfs, sv->sv_ino);
+	struct sfs_vnode **svp;
 	int result;
 
-	vfs_biglock_acquire();
-
 	/*
 	 * Make sure someone else hasn't picked up the vnode since the
-	 * decision was made to reclaim it. (You must also synchronize
-	 * this with sfs_loadvnode.)
+	 * decision was made to reclaim it. sfs_loadvnode only hands out
+	 * references with the bucket locked, so holding the bucket lock
+	 * from here until the vnode is gone from the table closes the
+	 * race. Nobody else has a reference, so nobody else can be
+	 * holding the vnode's own lock either.
 	 */
+	vfs_biglock_acquire();
+	lock_acquire(sv->sv_lock);
+	lock_acquire(vb->vb_lock);
 	spinlock_acquire(&v->vn_countlock);
 	if (v->vn_refcount != 1) {
 
@@ -88,15 +106,22 @@ sfs_reclaim(struct vnode *v)
 		v->vn_refcount--;
 
 		spinlock_release(&v->vn_countlock);
+		lock_release(vb->vb_lock);
+		lock_release(sv->sv_lock);
 		vfs_biglock_release();
 		return EBUSY;
 	}
 	spinlock_release(&v->vn_countlock);
 
+	/* Give back any blocks reserved for appending. */
+	sfs_prealloc_release(sv);
+
 	/* If there are no on-disk references to the file either, erase it. */
 	if (sv->sv_i.sfi_linkcount == 0) {
 		result = sfs_itrunc(sv, 0);
 		if (result) {
+			lock_release(vb->vb_lock);
+			lock_release(sv->sv_lock);
 			vfs_biglock_release();
 			return result;
 		}
@@ -105,6 +130,8 @@ sfs_reclaim(struct vnode *v)
 	/* Sync the inode to disk */
 	result = sfs_sync_inode(sv);
 	if (result) {
+		lock_release(vb->vb_lock);
+		lock_release(sv->sv_lock);
 		vfs_biglock_release();
 		return result;
 	}
@@ -115,27 +142,22 @@ sfs_reclaim(struct vnode *v)
 	}
 
 	/* Remove the vnode structure from the table in the struct sfs_fs. */
-	num = vnodearray_num(sfs->sfs_vnodes);
-	ix = num;
-	for (i=0; i<num; i++) {
-		struct vnode *v2 = vnodearray_get(sfs->sfs_vnodes, i);
-		struct sfs_vnode *sv2 = v2->vn_data;
-		if (sv2 == sv) {
-			ix = i;
-			break;
+	for (svp = &vb->vb_head; *svp != sv; svp = &(*svp)->sv_hashnext) {
+		if (*svp == NULL) {
+			panic("sfs: %s: reclaim vnode %u not in vnode pool\n",
+			      sfs->sfs_sb.sb_volname, sv->sv_ino);
 		}
 	}
-	if (ix == num) {
-		panic("sfs: %s: reclaim vnode %u not in vnode pool\n",
-		      sfs->sfs_sb.sb_volname, sv->sv_ino);
-	}
-	vnodearray_remove(sfs->sfs_vnodes, ix);
+	*svp = sv->sv_hashnext;
+	vb->vb_count--;
+	lock_release(vb->vb_lock);
 
 	vnode_cleanup(&sv->sv_absvn);
 
-	vfs_biglock_release();
-
 	/* Release the storage for the vnode structure itself. */
+	lock_release(sv->sv_lock);
+	vfs_biglock_release();
+	lock_destroy(sv->sv_lock);
 	kfree(sv);
 
 	/* Done */
@@ -150,26 +172,15 @@ int
 sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 		 struct sfs_vnode **ret)
 {
-	struct vnode *v;
+	struct sfs_vnbucket *vb = sfs_vnbucket(sfs, ino);
 	struct sfs_vnode *sv;
 	const struct vnode_ops *ops;
-	unsigned i, num;
 	int result;
 
-	/* Look in the vnodes table */
-	num = vnodearray_num(sfs->sfs_vnodes);
-
-	/* Linear search. Is this too slow? You decide. */
-	for (i=0; i<num; i++) {
-		v = vnodearray_get(sfs->sfs_vnodes, i);
-		sv = v->vn_data;
-
-		/* Every inode in memory must be in an allocated block */
-		if (!sfs_bused(sfs, sv->sv_ino)) {
-			panic("sfs: %s: Found inode %u in unallocated block\n",
-			      sfs->sfs_sb.sb_volname, sv->sv_ino);
-		}
+	lock_acquire(vb->vb_lock);
 
+	/* Look in the vnode table */
+	for (sv = vb->vb_head; sv != NULL; sv = sv->sv_hashnext) {
 		if (sv->sv_ino==ino) {
 			/* Found */
 
@@ -177,15 +188,26 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 			KASSERT(forcetype==SFS_TYPE_INVAL);
 
 			VOP_INCREF(&sv->sv_absvn);
+			lock_release(vb->vb_lock);
 			*ret = sv;
 			return 0;
 		}
 	}
 
-	/* Didn't have it loaded; load it */
+	/*
+	 * Didn't have it loaded; load it. Keep the bucket locked while
+	 * doing so, so nobody else loads a second copy.
+	 */
 
 	sv = kmalloc(sizeof(struct sfs_vnode));
 	if (sv==NULL) {
+		lock_release(vb->vb_lock);
+		return ENOMEM;
+	}
+	sv->sv_lock = lock_create("sfs vnode");
+	if (sv->sv_lock == NULL) {
+		kfree(sv);
+		lock_release(vb->vb_lock);
 		return ENOMEM;
 	}
 
@@ -198,7 +220,9 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Read the block the inode is in */
 	result = sfs_readblock(sfs, ino, &sv->sv_i, sizeof(sv->sv_i));
 	if (result) {
+		lock_destroy(sv->sv_lock);
 		kfree(sv);
+		lock_release(vb->vb_lock);
 		return result;
 	}
 
@@ -235,20 +259,27 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Call the common vnode initializer */
 	result = vnode_init(&sv->sv_absvn, ops, &sfs->sfs_absfs, sv);
 	if (result) {
+		lock_destroy(sv->sv_lock);
 		kfree(sv);
+		lock_release(vb->vb_lock);
 		return result;
 	}
 
 	/* Set the other fields in our vnode structure */
 	sv->sv_ino = ino;
+	sv->sv_rapos = 0;
+	sv->sv_rawindow = 0;
+	sv->sv_raend = 0;
+	sv->sv_prealloc = 0;
+	sv->sv_nprealloc = 0;
+	sv->sv_bmapleaf = 0;
+	sv->sv_bmapbase = 0;
 
 	/* Add it to our table */
-	result = vnodearray_add(sfs->sfs_vnodes, &sv->sv_absvn, NULL);
-	if (result) {
-		vnode_cleanup(&sv->sv_absvn);
-		kfree(sv);
-		return result;
-	}
+	sv->sv_hashnext = vb->vb_head;
+	vb->vb_head = sv;
+	vb->vb_count++;
+	lock_release(vb->vb_lock);
 
 	/* Hand it back */
 	*ret = sv;
@@ -256,10 +287,12 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 }
 
 /*
- * Create a new filesystem object and hand back its vnode.
+ * Create a new filesystem object and hand back its vnode. The inode
+ * goes near GOAL (normally the directory it's being created in).
  */
 int
-sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret)
+sfs_makeobj(struct sfs_fs *sfs, int type, daddr_t goal,
+	    struct sfs_vnode **ret)
 {
 	uint32_t ino;
 	int result;
@@ -269,7 +302,7 @@ sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret)
 	 * number is the block number, so just get a block.)
 	 */
 
-	result = sfs_balloc(sfs, &ino);
+	result = sfs_balloc(sfs, goal, &ino);
 	if (result) {
 		return result;
 	}
@@ -297,24 +330,22 @@ sfs_getroot(struct fs *fs, struct vnode **ret)
 	int result;
 
 	vfs_biglock_acquire();
-
 	result = sfs_loadvnode(sfs, SFS_ROOTDIR_INO, SFS_TYPE_INVAL, &sv);
+	vfs_biglock_release();
 	if (result) {
 		kprintf("sfs: %s: getroot: Cannot load root vnode\n",
 			sfs->sfs_sb.sb_volname);
-		vfs_biglock_release();
 		return result;
 	}
 
+	/* The type never changes, so this needs no lock. */
 	if (sv->sv_i.sfi_type != SFS_TYPE_DIR) {
 		kprintf("sfs: %s: getroot: not directory (type %u)\n",
 			sfs->sfs_sb.sb_volname, sv->sv_i.sfi_type);
-		vfs_biglock_release();
+		VOP_DECREF(&sv->sv_absvn);
 		return EINVAL;
 	}
 
-	vfs_biglock_release();
-
 	*ret = &sv->sv_absvn;
 	return 0;
 }
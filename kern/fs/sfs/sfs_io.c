@@ -35,12 +35,20 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <synch.h>
 #include <uio.h>
+#include <thread.h>
+#include <current.h>
 #include <vfs.h>
 #include <device.h>
+#include <buf.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
+/* Read-ahead window limits, in blocks */
+#define SFS_RAMIN	4
+#define SFS_RAMAX	32
+
 ////////////////////////////////////////////////////////////
 //
 // Basic block-level I/O routines
@@ -53,82 +61,46 @@
  */
 
 /*
- * Read or write a block, retrying I/O errors.
- */
-static
-int
-sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
-{
-	int result;
-	int tries=0;
-
-	KASSERT(vfs_biglock_do_i_hold());
-
-	DEBUG(DB_SFS, "sfs: %s %llu\n",
-	      uio->uio_rw == UIO_READ ? "read" : "write",
-	      uio->uio_offset / SFS_BLOCKSIZE);
-
- retry:
-	result = DEVOP_IO(sfs->sfs_device, uio);
-	if (result == EINVAL) {
-		/*
-		 * This means the sector we requested was out of range,
-		 * or the seek address we gave wasn't sector-aligned,
-		 * or a couple of other things that are our fault.
-		 */
-		panic("sfs: %s: DEVOP_IO returned EINVAL\n",
-		      sfs->sfs_sb.sb_volname);
-	}
-	if (result == EIO) {
-		if (tries == 0) {
-			tries++;
-			kprintf("sfs: %s: block %llu I/O error, retrying\n",
-				sfs->sfs_sb.sb_volname,
-				uio->uio_offset / SFS_BLOCKSIZE);
-			goto retry;
-		}
-		else if (tries < 10) {
-			tries++;
-			goto retry;
-		}
-		else {
-			kprintf("sfs: %s: block %llu I/O error, giving up "
-				"after %d retries\n",
-				sfs->sfs_sb.sb_volname,
-				uio->uio_offset / SFS_BLOCKSIZE, tries);
-		}
-	}
-	return result;
-}
-
-/*
- * Read a block.
+ * Read a block. This goes through the buffer cache; callers that
+ * want to work on a block in place use buf_read directly.
  */
 int
 sfs_readblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len)
 {
-	struct iovec iov;
-	struct uio ku;
+	struct buf *b;
+	int result;
 
 	KASSERT(len == SFS_BLOCKSIZE);
 
-	SFSUIO(&iov, &ku, data, block, UIO_READ);
-	return sfs_rwblock(sfs, &ku);
+	result = buf_read(sfs->sfs_device, block, &b);
+	if (result) {
+		return result;
+	}
+	memcpy(data, buf_data(b), len);
+	buf_release(b);
+	return 0;
 }
 
 /*
- * Write a block.
+ * Write a block. The data goes into the buffer cache and reaches
+ * the disk when the buffer is written back.
  */
 int
 sfs_writeblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len)
 {
-	struct iovec iov;
-	struct uio ku;
+	struct buf *b;
+	int result;
 
 	KASSERT(len == SFS_BLOCKSIZE);
 
-	SFSUIO(&iov, &ku, data, block, UIO_WRITE);
-	return sfs_rwblock(sfs, &ku);
+	result = buf_get(sfs->sfs_device, block, &b);
+	if (result) {
+		return result;
+	}
+	memcpy(buf_data(b), data, len);
+	buf_markdirty(b);
+	buf_release(b);
+	return 0;
 }
 
 ////////////////////////////////////////////////////////////
@@ -137,9 +109,9 @@ sfs_writeblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len)
 
 /*
  * Do I/O to a block of a file that doesn't cover the whole block.  We
- * need to read in the original block first, even if we're writing, so
- * we don't clobber the portion of the block we're not intending to
- * write over.
+ * need the original contents of the block in its buffer first, even
+ * if we're writing, so we don't clobber the portion of the block
+ * we're not intending to write over.
  *
  * SKIPSTART is the number of bytes to skip past at the beginning of
  * the sector; LEN is the number of bytes to actually read or write.
@@ -150,16 +122,8 @@ int
 sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	      uint32_t skipstart, uint32_t len)
 {
-	/*
-	 * I/O buffer for handling partial sectors.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static char iobuf[SFS_BLOCKSIZE];
-
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct buf *b;
 	daddr_t diskblock;
 	uint32_t fileblock;
 	int result;
@@ -169,9 +133,6 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 
 	KASSERT(skipstart + len <= SFS_BLOCKSIZE);
 
-	/* We're using a global static buffer; it had better be locked */
-	KASSERT(vfs_biglock_do_i_hold());
-
 	/* Compute the block offset of this block in the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
 
@@ -184,40 +145,32 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	if (diskblock == 0) {
 		/*
 		 * There was no block mapped at this point in the file.
-		 * Zero the buffer.
+		 * Read zeros.
 		 */
 		KASSERT(uio->uio_rw == UIO_READ);
-		bzero(iobuf, sizeof(iobuf));
-	}
-	else {
-		/*
-		 * Read the block.
-		 */
-		result = sfs_readblock(sfs, diskblock, iobuf, sizeof(iobuf));
-		if (result) {
-			return result;
-		}
+		return uiomovezeros(len, uio);
 	}
 
 	/*
-	 * Now perform the requested operation into/out of the buffer.
+	 * Get the block and perform the requested operation into/out
+	 * of its buffer.
 	 */
-	result = uiomove(iobuf+skipstart, len, uio);
+	result = buf_read(sfs->sfs_device, diskblock, &b);
 	if (result) {
 		return result;
 	}
+	result = uiomove((char *)buf_data(b) + skipstart, len, uio);
 
 	/*
-	 * If it was a write, write back the modified block.
+	 * If it was a write, the buffer is now dirty. Mark it even if
+	 * uiomove failed partway, since some of it may have changed.
 	 */
 	if (uio->uio_rw == UIO_WRITE) {
-		result = sfs_writeblock(sfs, diskblock, iobuf, sizeof(iobuf));
-		if (result) {
-			return result;
-		}
+		buf_markdirty(b);
 	}
+	buf_release(b);
 
-	return 0;
+	return result;
 }
 
 /*
@@ -228,14 +181,11 @@ int
 sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 {
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct buf *b;
 	daddr_t diskblock;
 	uint32_t fileblock;
 	int result;
 	bool doalloc = (uio->uio_rw==UIO_WRITE);
-	off_t saveoff;
-	off_t diskoff;
-	off_t saveres;
-	off_t diskres;
 
 	/* Get the block number within the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
@@ -257,34 +207,96 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 		return uiomovezeros(SFS_BLOCKSIZE, uio);
 	}
 
-	/*
-	 * Do the I/O directly to the uio region. Save the uio_offset,
-	 * and substitute one that makes sense to the device.
-	 */
-	saveoff = uio->uio_offset;
-	diskoff = diskblock * SFS_BLOCKSIZE;
-	uio->uio_offset = diskoff;
-
-	/*
-	 * Temporarily set the residue to be one block size.
-	 */
 	KASSERT(uio->uio_resid >= SFS_BLOCKSIZE);
-	saveres = uio->uio_resid;
-	diskres = SFS_BLOCKSIZE;
-	uio->uio_resid = diskres;
 
-	result = sfs_rwblock(sfs, uio);
+	if (uio->uio_rw == UIO_READ) {
+		result = buf_read(sfs->sfs_device, diskblock, &b);
+		if (result) {
+			return result;
+		}
+		result = uiomove(buf_data(b), SFS_BLOCKSIZE, uio);
+		buf_release(b);
+		return result;
+	}
 
 	/*
-	 * Now, restore the original uio_offset and uio_resid and update
-	 * them by the amount of I/O done.
+	 * Writing the whole block, so there's no need to read the
+	 * old contents. If the copy fails partway and the buffer
+	 * didn't already have good data, it has garbage in it; just
+	 * let it go without marking it. Otherwise it's dirty.
 	 */
-	uio->uio_offset = (uio->uio_offset - diskoff) + saveoff;
-	uio->uio_resid = (uio->uio_resid - diskres) + saveres;
-
+	result = buf_get(sfs->sfs_device, diskblock, &b);
+	if (result) {
+		return result;
+	}
+	result = uiomove(buf_data(b), SFS_BLOCKSIZE, uio);
+	if (result == 0 || buf_valid(b)) {
+		buf_markdirty(b);
+	}
+	buf_release(b);
 	return result;
 }
 
+/*
+ * Read-ahead, called after a read from STARTPOS up to ENDPOS.
+ *
+ * If the read picked up where the previous one left off, the window
+ * grows (doubling up to SFS_RAMAX blocks) and, once less than half
+ * of it is still queued ahead of us, the rest of it is handed to the
+ * buffer cache to prefetch in the background. Queueing half a window
+ * at a time lets the cache read it in one transfer. A read anywhere
+ * else shuts read-ahead off until reads become sequential again.
+ */
+static
+void
+sfs_readahead(struct sfs_vnode *sv, off_t startpos, off_t endpos)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	uint32_t fileblock, endblock, nblocks;
+	daddr_t diskblock;
+
+	if (startpos != sv->sv_rapos) {
+		sv->sv_rapos = endpos;
+		sv->sv_rawindow = 0;
+		sv->sv_raend = 0;
+		return;
+	}
+	sv->sv_rapos = endpos;
+
+	if (sv->sv_rawindow == 0) {
+		sv->sv_rawindow = SFS_RAMIN;
+	}
+	else if (sv->sv_rawindow < SFS_RAMAX) {
+		sv->sv_rawindow *= 2;
+	}
+
+	/* The first block we haven't read, and the end of the window */
+	fileblock = DIVROUNDUP(endpos, SFS_BLOCKSIZE);
+	endblock = fileblock + sv->sv_rawindow;
+	nblocks = DIVROUNDUP(sv->sv_i.sfi_size, SFS_BLOCKSIZE);
+	if (endblock > nblocks) {
+		endblock = nblocks;
+	}
+
+	if (sv->sv_raend > fileblock + sv->sv_rawindow / 2) {
+		/* Still plenty queued. */
+		return;
+	}
+	if (fileblock < sv->sv_raend) {
+		fileblock = sv->sv_raend;
+	}
+
+	for (; fileblock < endblock; fileblock++) {
+		if (sfs_bmap(sv, fileblock, false, &diskblock)) {
+			break;
+		}
+		if (diskblock != 0) {
+			buf_prefetch(sfs->sfs_device, diskblock);
+		}
+	}
+	sv->sv_raend = fileblock;
+}
+
 /*
  * Do I/O of a whole region of data, whether or not it's block-aligned.
  */
@@ -295,8 +307,10 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 	uint32_t nblocks, i;
 	int result = 0;
 	uint32_t origresid, extraresid = 0;
+	off_t origoffset;
 
 	origresid = uio->uio_resid;
+	origoffset = uio->uio_offset;
 
 	/*
 	 * If reading, check for EOF. If we can read a partial area,
@@ -318,6 +332,10 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 			uio->uio_resid -= extraresid;
 		}
 	}
+	else if (uio->uio_offset >= SFS_MAXFILESIZE) {
+		/* Past where the block map can reach */
+		return EFBIG;
+	}
 
 	/*
 	 * First, do any leading partial block.
@@ -381,6 +399,11 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 		sv->sv_dirty = true;
 	}
 
+	/* If reading, keep the read-ahead going */
+	if (uio->uio_rw == UIO_READ && result == 0) {
+		sfs_readahead(sv, origoffset, uio->uio_offset);
+	}
+
 	/* Add in any extra amount we couldn't read because of EOF */
 	uio->uio_resid += extraresid;
 
@@ -407,6 +430,7 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 	   enum uio_rw rw)
 {
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct buf *b;
 	off_t endpos;
 	uint32_t vnblock;
 	uint32_t blockoffset;
@@ -414,17 +438,8 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 	bool doalloc;
 	int result;
 
-	/*
-	 * I/O buffer for metadata ops.
-	 *
-	 * Note: in real life (and when you've done the fs assignment) you
-	 * would get space from the disk buffer cache for this, not use a
-	 * static area.
-	 */
-	static char metaiobuf[SFS_BLOCKSIZE];
-
-	/* We're using a global static buffer; it had better be locked */
-	KASSERT(vfs_biglock_do_i_hold());
+	/* We may be changing the inode; we'd better be locked */
+	KASSERT(lock_do_i_hold(sv->sv_lock));
 
 	/* Figure out which block of the vnode (directory, whatever) this is */
 	vnblock = actualpos / SFS_BLOCKSIZE;
@@ -446,26 +461,22 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 		return 0;
 	}
 
-	/* Read the block */
-	result = sfs_readblock(sfs, diskblock, metaiobuf, sizeof(metaiobuf));
+	/* Get the block */
+	result = buf_read(sfs->sfs_device, diskblock, &b);
 	if (result) {
 		return result;
 	}
 
 	if (rw == UIO_READ) {
 		/* Copy out the selected region */
-		memcpy(data, metaiobuf + blockoffset, len);
+		memcpy(data, (char *)buf_data(b) + blockoffset, len);
+		buf_release(b);
 	}
 	else {
 		/* Update the selected region */
-		memcpy(metaiobuf + blockoffset, data, len);
-
-		/* Write the block back */
-		result = sfs_writeblock(sfs, diskblock,
-					metaiobuf, sizeof(metaiobuf));
-		if (result) {
-			return result;
-		}
+		memcpy((char *)buf_data(b) + blockoffset, data, len);
+		buf_markdirty(b);
+		buf_release(b);
 
 		/* Update the vnode size if needed */
 		endpos = actualpos + len;
@@ -35,10 +35,14 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/ioctl.h>
 #include <stat.h>
 #include <lib.h>
+#include <synch.h>
 #include <uio.h>
+#include <copyinout.h>
 #include <vfs.h>
+#include <buf.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
@@ -103,7 +107,9 @@ sfs_read(struct vnode *v, struct uio *uio)
 	KASSERT(uio->uio_rw==UIO_READ);
 
 	vfs_biglock_acquire();
+	lock_acquire(sv->sv_lock);
 	result = sfs_io(sv, uio);
+	lock_release(sv->sv_lock);
 	vfs_biglock_release();
 
 	return result;
@@ -122,7 +128,9 @@ sfs_write(struct vnode *v, struct uio *uio)
 	KASSERT(uio->uio_rw==UIO_WRITE);
 
 	vfs_biglock_acquire();
+	lock_acquire(sv->sv_lock);
 	result = sfs_io(sv, uio);
+	lock_release(sv->sv_lock);
 	vfs_biglock_release();
 
 	return result;
@@ -135,15 +143,31 @@ static
 int
 sfs_ioctl(struct vnode *v, int op, userptr_t data)
 {
-	/*
-	 * No ioctls.
-	 */
+	struct sfs_vnode *sv = v->vn_data;
+	off_t len;
+	int result;
 
-	(void)v;
-	(void)op;
-	(void)data;
+	switch (op) {
+	    case FIORESERVE:
+		if (sv->sv_i.sfi_type != SFS_TYPE_FILE) {
+			return EISDIR;
+		}
+		result = copyin(data, &len, sizeof(len));
+		if (result) {
+			return result;
+		}
+		if (len < 0) {
+			return EINVAL;
+		}
+		vfs_biglock_acquire();
+		lock_acquire(sv->sv_lock);
+		result = sfs_ireserve(sv, len);
+		lock_release(sv->sv_lock);
+		vfs_biglock_release();
+		return result;
+	}
 
-	return EINVAL;
+	return EIOCTL;
 }
 
 /*
@@ -164,8 +188,12 @@ sfs_stat(struct vnode *v, struct stat *statbuf)
 		return result;
 	}
 
+	vfs_biglock_acquire();
+	lock_acquire(sv->sv_lock);
 	statbuf->st_size = sv->sv_i.sfi_size;
 	statbuf->st_nlink = sv->sv_i.sfi_linkcount;
+	lock_release(sv->sv_lock);
+	vfs_biglock_release();
 
 	/* We don't support this yet */
 	statbuf->st_blocks = 0;
@@ -185,16 +213,13 @@ sfs_gettype(struct vnode *v, uint32_t *ret)
 	struct sfs_vnode *sv = v->vn_data;
 	struct sfs_fs *sfs = v->vn_fs->fs_data;
 
-	vfs_biglock_acquire();
-
+	/* The type never changes, so this needs no lock. */
 	switch (sv->sv_i.sfi_type) {
 	case SFS_TYPE_FILE:
 		*ret = S_IFREG;
-		vfs_biglock_release();
 		return 0;
 	case SFS_TYPE_DIR:
 		*ret = S_IFDIR;
-		vfs_biglock_release();
 		return 0;
 	}
 	panic("sfs: %s: gettype: Invalid inode type (inode %u, type %u)\n",
@@ -222,11 +247,21 @@ int
 sfs_fsync(struct vnode *v)
 {
 	struct sfs_vnode *sv = v->vn_data;
+	struct sfs_fs *sfs = v->vn_fs->fs_data;
 	int result;
 
 	vfs_biglock_acquire();
+	lock_acquire(sv->sv_lock);
 	result = sfs_sync_inode(sv);
+	lock_release(sv->sv_lock);
 	vfs_biglock_release();
+	if (result == 0) {
+		/*
+		 * That only updated the inode's buffer. Write back the
+		 * device's dirty buffers, which include this file's.
+		 */
+		result = buf_sync(sfs->sfs_device);
+	}
 
 	return result;
 }
@@ -250,8 +285,15 @@ int
 sfs_truncate(struct vnode *v, off_t len)
 {
 	struct sfs_vnode *sv = v->vn_data;
+	int result;
 
-	return sfs_itrunc(sv, len);
+	vfs_biglock_acquire();
+	lock_acquire(sv->sv_lock);
+	result = sfs_itrunc(sv, len);
+	lock_release(sv->sv_lock);
+	vfs_biglock_release();
+
+	return result;
 }
 
 /*
@@ -290,16 +332,19 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 	int result;
 
 	vfs_biglock_acquire();
+	lock_acquire(sv->sv_lock);
 
 	/* Look up the name */
 	result = sfs_dir_findname(sv, name, &ino, NULL, NULL);
 	if (result!=0 && result!=ENOENT) {
+		lock_release(sv->sv_lock);
 		vfs_biglock_release();
 		return result;
 	}
 
 	/* If it exists and we didn't want it to, fail */
 	if (result==0 && excl) {
+		lock_release(sv->sv_lock);
 		vfs_biglock_release();
 		return EEXIST;
 	}
@@ -307,18 +352,19 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 	if (result==0) {
 		/* We got something; load its vnode and return */
 		result = sfs_loadvnode(sfs, ino, SFS_TYPE_INVAL, &newguy);
+		lock_release(sv->sv_lock);
+		vfs_biglock_release();
 		if (result) {
-			vfs_biglock_release();
 			return result;
 		}
 		*ret = &newguy->sv_absvn;
-		vfs_biglock_release();
 		return 0;
 	}
 
 	/* Didn't exist - create it */
-	result = sfs_makeobj(sfs, SFS_TYPE_FILE, &newguy);
+	result = sfs_makeobj(sfs, SFS_TYPE_FILE, sv->sv_ino, &newguy);
 	if (result) {
+		lock_release(sv->sv_lock);
 		vfs_biglock_release();
 		return result;
 	}
@@ -329,20 +375,24 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 	/* Link it into the directory */
 	result = sfs_dir_link(sv, name, newguy->sv_ino, NULL);
 	if (result) {
-		VOP_DECREF(&newguy->sv_absvn);
+		lock_release(sv->sv_lock);
 		vfs_biglock_release();
+		VOP_DECREF(&newguy->sv_absvn);
 		return result;
 	}
 
 	/* Update the linkcount of the new file */
+	lock_acquire(newguy->sv_lock);
 	newguy->sv_i.sfi_linkcount++;
 
 	/* and consequently mark it dirty. */
 	newguy->sv_dirty = true;
+	lock_release(newguy->sv_lock);
 
-	*ret = &newguy->sv_absvn;
-
+	lock_release(sv->sv_lock);
 	vfs_biglock_release();
+
+	*ret = &newguy->sv_absvn;
 	return 0;
 }
 
@@ -361,25 +411,29 @@ sfs_link(struct vnode *dir, const char *name, struct vnode *file)
 
 	KASSERT(file->vn_fs == dir->vn_fs);
 
-	vfs_biglock_acquire();
-
 	/* Hard links to directories aren't allowed. */
 	if (f->sv_i.sfi_type == SFS_TYPE_DIR) {
-		vfs_biglock_release();
 		return EINVAL;
 	}
 
+	vfs_biglock_acquire();
+	lock_acquire(sv->sv_lock);
+
 	/* Create the link */
 	result = sfs_dir_link(sv, name, f->sv_ino, NULL);
 	if (result) {
+		lock_release(sv->sv_lock);
 		vfs_biglock_release();
 		return result;
 	}
 
 	/* and update the link count, marking the inode dirty */
+	lock_acquire(f->sv_lock);
 	f->sv_i.sfi_linkcount++;
 	f->sv_dirty = true;
+	lock_release(f->sv_lock);
 
+	lock_release(sv->sv_lock);
 	vfs_biglock_release();
 	return 0;
 }
@@ -397,10 +451,12 @@ sfs_remove(struct vnode *dir, const char *name)
 	int result;
 
 	vfs_biglock_acquire();
+	lock_acquire(sv->sv_lock);
 
 	/* Look for the file and fetch a vnode for it. */
 	result = sfs_lookonce(sv, name, &victim, &slot);
 	if (result) {
+		lock_release(sv->sv_lock);
 		vfs_biglock_release();
 		return result;
 	}
@@ -409,15 +465,22 @@ sfs_remove(struct vnode *dir, const char *name)
 	result = sfs_dir_unlink(sv, slot);
 	if (result==0) {
 		/* If we succeeded, decrement the link count. */
+		lock_acquire(victim->sv_lock);
 		KASSERT(victim->sv_i.sfi_linkcount > 0);
 		victim->sv_i.sfi_linkcount--;
 		victim->sv_dirty = true;
+		lock_release(victim->sv_lock);
 	}
 
-	/* Discard the reference that sfs_lookonce got us */
+	lock_release(sv->sv_lock);
+	vfs_biglock_release();
+
+	/*
+	 * Discard the reference that sfs_lookonce got us. This may
+	 * reclaim the file, which takes its lock, so it comes last.
+	 */
 	VOP_DECREF(&victim->sv_absvn);
 
-	vfs_biglock_release();
 	return result;
 }
 
@@ -438,14 +501,16 @@ sfs_rename(struct vnode *d1, const char *n1,
 	int slot1, slot2;
 	int result, result2;
 
-	vfs_biglock_acquire();
-
 	KASSERT(d1==d2);
 	KASSERT(sv->sv_ino == SFS_ROOTDIR_INO);
 
+	vfs_biglock_acquire();
+	lock_acquire(sv->sv_lock);
+
 	/* Look up the old name of the file and get its inode and slot number*/
 	result = sfs_lookonce(sv, n1, &g1, &slot1);
 	if (result) {
+		lock_release(sv->sv_lock);
 		vfs_biglock_release();
 		return result;
 	}
@@ -467,8 +532,16 @@ sfs_rename(struct vnode *d1, const char *n1,
 	}
 
 	/* Increment the link count, and mark inode dirty */
+	lock_acquire(g1->sv_lock);
 	g1->sv_i.sfi_linkcount++;
 	g1->sv_dirty = true;
+	lock_release(g1->sv_lock);
+
+	/* Linking may have rehashed the directory; find the old name again */
+	result = sfs_dir_findname(sv, n1, NULL, &slot1, NULL);
+	if (result) {
+		goto puke_harder;
+	}
 
 	/* Unlink the old slot */
 	result = sfs_dir_unlink(sv, slot1);
@@ -480,14 +553,18 @@ sfs_rename(struct vnode *d1, const char *n1,
 	 * Decrement the link count again, and mark the inode dirty again,
 	 * in case it's been synced behind our back.
 	 */
+	lock_acquire(g1->sv_lock);
 	KASSERT(g1->sv_i.sfi_linkcount>0);
 	g1->sv_i.sfi_linkcount--;
 	g1->sv_dirty = true;
+	lock_release(g1->sv_lock);
+
+	lock_release(sv->sv_lock);
+	vfs_biglock_release();
 
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_absvn);
 
-	vfs_biglock_release();
 	return 0;
 
  puke_harder:
@@ -503,11 +580,14 @@ sfs_rename(struct vnode *d1, const char *n1,
 		panic("sfs: %s: rename: Cannot recover\n",
 		      sfs->sfs_sb.sb_volname);
 	}
+	lock_acquire(g1->sv_lock);
 	g1->sv_i.sfi_linkcount--;
+	lock_release(g1->sv_lock);
  puke:
+	lock_release(sv->sv_lock);
+	vfs_biglock_release();
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_absvn);
-	vfs_biglock_release();
 	return result;
 }
 
@@ -525,15 +605,11 @@ sfs_lookparent(struct vnode *v, char *path, struct vnode **ret,
 {
 	struct sfs_vnode *sv = v->vn_data;
 
-	vfs_biglock_acquire();
-
 	if (sv->sv_i.sfi_type != SFS_TYPE_DIR) {
-		vfs_biglock_release();
 		return ENOTDIR;
 	}
 
 	if (strlen(path)+1 > buflen) {
-		vfs_biglock_release();
 		return ENAMETOOLONG;
 	}
 	strcpy(buf, path);
@@ -541,7 +617,6 @@ sfs_lookparent(struct vnode *v, char *path, struct vnode **ret,
 	VOP_INCREF(&sv->sv_absvn);
 	*ret = &sv->sv_absvn;
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -559,22 +634,21 @@ sfs_lookup(struct vnode *v, char *path, struct vnode **ret)
 	struct sfs_vnode *final;
 	int result;
 
-	vfs_biglock_acquire();
-
 	if (sv->sv_i.sfi_type != SFS_TYPE_DIR) {
-		vfs_biglock_release();
 		return ENOTDIR;
 	}
 
+	vfs_biglock_acquire();
+	lock_acquire(sv->sv_lock);
 	result = sfs_lookonce(sv, path, &final, NULL);
+	lock_release(sv->sv_lock);
+	vfs_biglock_release();
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
 	*ret = &final->sv_absvn;
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -595,6 +669,7 @@ const struct vnode_ops sfs_fileops = {
 	.vop_getdirentry = vopfail_uio_notdir,
 	.vop_write = sfs_write,
 	.vop_ioctl = sfs_ioctl,
+	.vop_poll = vopgeneric_poll,
 	.vop_stat = sfs_stat,
 	.vop_gettype = sfs_gettype,
 	.vop_isseekable = sfs_isseekable,
@@ -629,6 +704,7 @@ const struct vnode_ops sfs_dirops = {
 	.vop_getdirentry = vopfail_uio_nosys,
 	.vop_write = vopfail_uio_isdir,
 	.vop_ioctl = sfs_ioctl,
+	.vop_poll = vopgeneric_poll,
 	.vop_stat = sfs_stat,
 	.vop_gettype = sfs_gettype,
 	.vop_isseekable = sfs_isseekable,
@@ -33,17 +33,23 @@
 #include <uio.h> /* for uio_rw */
 
 
+/* Largest file the block map can describe */
+#define SFS_MAXFILEBLOCKS (SFS_NDIRECT + \
+			   SFS_NINDIRECT * SFS_DBPERIDB + \
+			   SFS_NDINDIRECT * SFS_DBPERIDB * SFS_DBPERIDB + \
+			   SFS_NTINDIRECT * SFS_DBPERIDB * SFS_DBPERIDB * \
+			   SFS_DBPERIDB)
+#define SFS_MAXFILESIZE ((off_t)SFS_MAXFILEBLOCKS * SFS_BLOCKSIZE)
+
 /* ops tables (in sfs_vnops.c) */
 extern const struct vnode_ops sfs_fileops;
 extern const struct vnode_ops sfs_dirops;
 
-/* Macro for initializing a uio structure */
-#define SFSUIO(iov, uio, ptr, block, rw) \
-    uio_kinit(iov, uio, ptr, SFS_BLOCKSIZE, ((off_t)(block))*SFS_BLOCKSIZE, rw)
-
-
 /* Functions in sfs_balloc.c */
-int sfs_balloc(struct sfs_fs *sfs, daddr_t *diskblock);
+int sfs_balloc(struct sfs_fs *sfs, daddr_t goal, daddr_t *diskblock);
+int sfs_balloc_file(struct sfs_vnode *sv, daddr_t prev, bool append,
+		daddr_t *diskblock);
+void sfs_prealloc_release(struct sfs_vnode *sv);
 void sfs_bfree(struct sfs_fs *sfs, daddr_t diskblock);
 int sfs_bused(struct sfs_fs *sfs, daddr_t diskblock);
 
@@ -51,6 +57,7 @@ int sfs_bused(struct sfs_fs *sfs, daddr_t diskblock);
 int sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		daddr_t *diskblock);
 int sfs_itrunc(struct sfs_vnode *sv, off_t len);
+int sfs_ireserve(struct sfs_vnode *sv, off_t len);
 
 /* Functions in sfs_dir.c */
 int sfs_dir_findname(struct sfs_vnode *sv, const char *name,
@@ -67,7 +74,8 @@ int sfs_sync_inode(struct sfs_vnode *sv);
 int sfs_reclaim(struct vnode *v);
 int sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 		struct sfs_vnode **ret);
-int sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret);
+int sfs_makeobj(struct sfs_fs *sfs, int type, daddr_t goal,
+		struct sfs_vnode **ret);
 int sfs_getroot(struct fs *fs, struct vnode **ret);
 
 /* Functions in sfs_io.c */
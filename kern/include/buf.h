@@ -0,0 +1,84 @@
+#ifndef _BUF_H_
+#define _BUF_H_
+
+/*
+ * Block buffer cache.
+ *
+ * Caches BUF_SIZE-byte blocks of block devices, keyed by (device,
+ * block number). A buffer is handed out held: the holder has it to
+ * itself until it calls buf_release, and anyone else asking for the
+ * same block waits. Buffers nobody holds or is waiting for sit on an
+ * LRU list and are recycled oldest first.
+ *
+ * Writes are write-back: buf_markdirty just marks the buffer, and
+ * the data goes to disk when the buffer is recycled or when
+ * buf_sync is called for its device. Filesystems call buf_sync from
+ * their sync operation.
+ *
+ * Device reads and writes done here are charged to the current
+ * thread's rusage block counts.
+ *
+ * buf_prefetch queues a block to be read in the background by the
+ * read-ahead thread, which reads runs of consecutive blocks in one
+ * device transfer.
+ */
+
+struct device;
+struct buf;
+
+/* Size of a buffer; devices used with the cache must match. */
+#define BUF_SIZE	512
+
+/*
+ * Get the buffer for BLOCK of DEV, held, reading it from the device
+ * if it isn't already cached.
+ */
+int buf_read(struct device *dev, daddr_t block, struct buf **ret);
+
+/*
+ * Get the buffer for BLOCK of DEV, held, but don't read it in. For
+ * callers that are about to overwrite the whole block. If the
+ * contents weren't cached (buf_valid returns false) they are
+ * garbage until written.
+ */
+int buf_get(struct device *dev, daddr_t block, struct buf **ret);
+
+/* Data area of a held buffer. */
+void *buf_data(struct buf *b);
+
+/* True if a held buffer's data matches (or supersedes) the disk. */
+bool buf_valid(struct buf *b);
+
+/* Note that a held buffer's data has been changed. Also makes it valid. */
+void buf_markdirty(struct buf *b);
+
+/* Let go of a held buffer. */
+void buf_release(struct buf *b);
+
+/*
+ * Forget any cached copy of BLOCK of DEV without writing it back,
+ * for blocks that have been freed. Does nothing if the buffer is
+ * held.
+ */
+void buf_discard(struct device *dev, daddr_t block);
+
+/*
+ * Start reading BLOCK of DEV into the cache in the background, if it
+ * isn't there already. Never waits; if too much read-ahead is pending
+ * the request is dropped.
+ */
+void buf_prefetch(struct device *dev, daddr_t block);
+
+/* Write back all dirty buffers for DEV. */
+int buf_sync(struct device *dev);
+
+/*
+ * Write back and then drop all buffers for DEV, when it's being
+ * unmounted. None may be held by filesystem code.
+ */
+int buf_detach(struct device *dev);
+
+/* Call once during startup. */
+void buf_bootstrap(void);
+
+#endif /* _BUF_H_ */
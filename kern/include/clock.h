@@ -73,6 +73,14 @@ void timespec_sub(const struct timespec *t1,
 		  const struct timespec *t2,
 		  struct timespec *ret);
 
+/*
+ * The time page (see kern/timepage.h). timepage_bootstrap allocates
+ * it; hardclock keeps it up to date; the VM system maps the page at
+ * timepage_kvaddr() into user address spaces.
+ */
+void timepage_bootstrap(void);
+vaddr_t timepage_kvaddr(void);
+
 /*
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
@@ -37,6 +37,27 @@
 
 struct uio;  /* in <uio.h> */
 
+/*
+ * Asynchronous device request, for DEVOP_IOASYNC/dev_ioasync.
+ *
+ * DR_UIO says what to transfer and must describe kernel memory
+ * (UIO_SYSSPACE). When the transfer is finished, DR_DONE is called
+ * with the result. It may be called from an interrupt handler, so it
+ * must not sleep. The request and the uio belong to the device until
+ * then.
+ */
+struct devreq {
+	struct uio *dr_uio;
+	void (*dr_done)(struct devreq *dr, int result);
+	void *dr_data;			/* for the submitter */
+
+	/* For the device's queue (see iosched.h) */
+	struct devreq *dr_next;
+	struct devreq *dr_merged;	/* merged requests that follow */
+	off_t dr_pos, dr_end;		/* byte range, with merged ones */
+	uint64_t dr_expire;		/* deadline, in ns */
+};
+
 /*
  * Filesystem-namespace-accessible device.
  */
@@ -56,11 +77,18 @@ struct device {
  *      devop_eachopen - called on each open call to allow denying the open
  *      devop_io - for both reads and writes (the uio indicates the direction)
  *      devop_ioctl - miscellaneous control operations
+ *      devop_poll - report readiness, as for vop_poll (optional; if
+ *                   NULL the device is treated as always ready)
+ *      devop_ioasync - start a transfer and return without waiting
+ *                   for it (optional; use dev_ioasync, which falls
+ *                   back on devop_io)
  */
 struct device_ops {
 	int (*devop_eachopen)(struct device *, int flags_from_open);
 	int (*devop_io)(struct device *, struct uio *);
 	int (*devop_ioctl)(struct device *, int op, userptr_t data);
+	int (*devop_poll)(struct device *, int events, int *revents);
+	int (*devop_ioasync)(struct device *, struct devreq *);
 };
 
 /*
@@ -69,6 +97,16 @@ struct device_ops {
 #define DEVOP_EACHOPEN(d, f)	((d)->d_ops->devop_eachopen(d, f))
 #define DEVOP_IO(d, u)		((d)->d_ops->devop_io(d, u))
 #define DEVOP_IOCTL(d, op, p)	((d)->d_ops->devop_ioctl(d, op, p))
+#define DEVOP_POLL(d, ev, rev)	((d)->d_ops->devop_poll(d, ev, rev))
+#define DEVOP_IOASYNC(d, dr)	((d)->d_ops->devop_ioasync(d, dr))
+
+/*
+ * Start an asynchronous transfer. If this returns an error, the
+ * request was not started and DR_DONE won't be called. Devices
+ * without devop_ioasync do the transfer on the spot and call DR_DONE
+ * before returning.
+ */
+int dev_ioasync(struct device *d, struct devreq *dr);
 
 
 /* Create vnode for a vfs-level device. */
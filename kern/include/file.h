@@ -0,0 +1,67 @@
+#ifndef _FILE_H_
+#define _FILE_H_
+
+/*
+ * Open-file objects.
+ *
+ * A struct file_handle is one open() of a file: the vnode, the
+ * access mode, and the seek position. File descriptors are slots in
+ * a process's file_table that point at these objects; the same
+ * object may be referenced from several slots (dup2) and from
+ * several processes (fork), and they all share the seek position.
+ *
+ * destroy_count is the number of file_table slots referring to the
+ * object, protected by count_lock. The object and its vnode reference
+ * go away when the count drops to zero.
+ *
+ * offset and mode_open are protected by lock. For seekable objects it
+ * is held across each read or write so that I/O through a shared
+ * handle sees and advances the offset atomically. Pipes and the
+ * console have no offset, and I/O on them can block indefinitely, so
+ * it isn't taken for those.
+ *
+ * A process's file_table itself is only changed by the process's own
+ * (single) thread, or after it has exited, and needs no lock.
+ */
+
+#include <spinlock.h>
+
+struct proc;
+struct vnode;
+
+struct file_handle {
+	struct vnode *vnode;
+	off_t offset;
+	struct lock *lock;
+	struct spinlock count_lock;
+	int destroy_count;
+	int mode_open;
+	bool con_file;
+};
+
+/* Make a new handle for VN, taking over the caller's reference. */
+int file_create(struct vnode *vn, int flags, struct file_handle **ret);
+
+/* Open PATH (which may be destroyed) and make a new handle for it. */
+int file_open(char *path, int flags, mode_t mode, struct file_handle **ret);
+
+/* Add and drop references. The last file_decref closes the vnode. */
+void file_incref(struct file_handle *fh);
+void file_decref(struct file_handle *fh);
+
+/* Look up descriptor FD in the current process. */
+int fd_lookup(int fd, struct file_handle **ret);
+
+/* Install FH at the lowest free descriptor of PROC. Consumes a reference. */
+int filetable_place(struct proc *proc, struct file_handle *fh, int *fd);
+
+/* Give CHILD references to all of PARENT's open files. */
+void filetable_fork(struct proc *parent, struct proc *child);
+
+/* Close everything PROC has open. */
+void filetable_closeall(struct proc *proc);
+
+/* Open the console as descriptors 0, 1, and 2 of PROC. */
+int filetable_stdio(struct proc *proc);
+
+#endif /* _FILE_H_ */
@@ -0,0 +1,76 @@
+#ifndef _IOSCHED_H_
+#define _IOSCHED_H_
+
+/*
+ * Disk request scheduler.
+ *
+ * A block device driver keeps its waiting requests (struct devreq)
+ * in an iosched instead of a plain queue, and asks it which one to
+ * start whenever the disk goes idle. The policy can be changed at
+ * any time:
+ *
+ *    fifo      - in order of arrival.
+ *    clook     - in order of position, sweeping upward from where
+ *                the disk is now and then jumping back to the lowest
+ *                waiting request (circular LOOK).
+ *    deadline  - clook, except that a request that has waited too
+ *                long (IOSCHED_READEXPIRE/IOSCHED_WRITEEXPIRE ms)
+ *                goes next.
+ *
+ * Under every policy, a request that begins where a waiting request
+ * of the same direction ends (or ends where it begins) is merged
+ * with it, and the two are started back to back. A merged group is
+ * handed to the driver as its first request, with the others chained
+ * on dr_merged in disk order.
+ *
+ * The iosched does no locking; the driver calls it with its own lock
+ * held. It may be called from interrupt handlers.
+ *
+ * Schedulers are registered by name (normally the device name, e.g.
+ * "lhd0") so the policy can be looked up and changed from outside
+ * the driver.
+ */
+
+struct devreq;
+
+/* Policies */
+#define IOSCHED_FIFO		0
+#define IOSCHED_CLOOK		1
+#define IOSCHED_DEADLINE	2
+#define IOSCHED_NPOLICIES	3
+
+/* Deadlines, in milliseconds */
+#define IOSCHED_READEXPIRE	100
+#define IOSCHED_WRITEEXPIRE	500
+
+/* Largest merged group, in bytes */
+#define IOSCHED_MAXMERGE	32768
+
+struct iosched;
+
+/*
+ * Create a scheduler for a device called NAME, with the default
+ * policy (clook), and destroy one (which must be empty).
+ */
+struct iosched *iosched_create(const char *name);
+void iosched_destroy(struct iosched *ios);
+
+/* Add a request. */
+void iosched_add(struct iosched *ios, struct devreq *dr);
+
+/*
+ * Take the next request (or merged group) to start, given that the
+ * disk's head is at byte offset HEADPOS. Returns NULL if there are
+ * none waiting.
+ */
+struct devreq *iosched_next(struct iosched *ios, off_t headpos);
+
+/*
+ * Policy names, and changing the policy of the scheduler registered
+ * as NAME. iosched_setpolicy returns ENOENT if there's no such
+ * scheduler and EINVAL if there's no such policy.
+ */
+const char *iosched_policyname(int policy);
+int iosched_setpolicy(const char *name, const char *policy);
+
+#endif /* _IOSCHED_H_ */
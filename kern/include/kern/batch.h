@@ -0,0 +1,50 @@
+#ifndef _KERN_BATCH_H_
+#define _KERN_BATCH_H_
+
+/*
+ * Batched system calls.
+ *
+ * A process queues requests in a struct batch_ring in its own memory
+ * and hands the whole ring to the kernel with one __batch() call.
+ * The kernel runs the entries from br_head up to br_tail in order,
+ * stores each one's result and error code back into the entry, and
+ * advances br_head to br_tail. Entries are independent: a failure in
+ * one does not stop the others.
+ *
+ * br_head and br_tail count up forever; an entry's slot is its count
+ * modulo BATCH_RINGSIZE. Results stay in the ring until the slot is
+ * reused.
+ */
+
+#define BATCH_RINGSIZE  64
+
+/* Operations */
+#define BATCH_READ      1	/* read(fd, buf, len) */
+#define BATCH_WRITE     2	/* write(fd, buf, len) */
+#define BATCH_PREAD     3	/* pread(fd, buf, len, pos) */
+#define BATCH_PWRITE    4	/* pwrite(fd, buf, len, pos) */
+#define BATCH_LSEEK     5	/* lseek(fd, pos, whence) */
+#define BATCH_CLOSE     6	/* close(fd) */
+
+struct batch_ent {
+	int be_op;
+	int be_fd;
+#ifdef _KERNEL
+	userptr_t be_buf;
+#else
+	void *be_buf;
+#endif
+	__size_t be_len;
+	int be_whence;
+	int be_error;			/* set by kernel: 0 or errno */
+	__off_t be_pos;
+	__off_t be_result;		/* set by kernel: return value */
+};
+
+struct batch_ring {
+	unsigned br_head;		/* next entry to run; set by kernel */
+	unsigned br_tail;		/* next free entry; set by user */
+	struct batch_ent br_ents[BATCH_RINGSIZE];
+};
+
+#endif /* _KERN_BATCH_H_ */
@@ -34,6 +34,13 @@
  * ioctl operation codes
  */
 
-/* (none yet) */
+/*
+ * FIORESERVE: allocate disk space for a file up to the length pointed
+ * to by the argument (an off_t), extending the file to that length
+ * if it's shorter, like posix_fallocate from offset 0. Blocks that
+ * were already there are left alone; new ones read as zeros. Needs
+ * a handle open for writing.
+ */
+#define FIORESERVE	1
 
 #endif /* _KERN_IOCTL_H_*/
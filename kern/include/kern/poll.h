@@ -0,0 +1,27 @@
+#ifndef _KERN_POLL_H_
+#define _KERN_POLL_H_
+
+/*
+ * Definitions for poll().
+ */
+
+struct pollfd {
+	int fd;			/* file descriptor; ignored if negative */
+	short events;		/* events of interest */
+	short revents;		/* events that happened (returned) */
+};
+
+/* Events. POLLERR, POLLHUP, and POLLNVAL are always reported. */
+#define POLLIN      0x0001	/* data can be read */
+#define POLLPRI     0x0002	/* urgent data can be read (never) */
+#define POLLOUT     0x0004	/* data can be written */
+#define POLLRDNORM  0x0040	/* same as POLLIN */
+#define POLLWRNORM  0x0100	/* same as POLLOUT */
+#define POLLERR     0x0008	/* error (e.g. pipe with no reader) */
+#define POLLHUP     0x0010	/* hung up (e.g. pipe with no writer) */
+#define POLLNVAL    0x0020	/* fd is not open */
+
+/* Timeout value meaning wait forever. */
+#define INFTIM      (-1)
+
+#endif /* _KERN_POLL_H_ */
@@ -41,8 +41,8 @@
 #define SFS_VOLNAME_SIZE  32            /* max length of volume name */
 #define SFS_NDIRECT       15            /* # of direct blocks in inode */
 #define SFS_NINDIRECT     1             /* # of indirect blocks in inode */
-#define SFS_NDINDIRECT    0             /* # of 2x indirect blocks in inode */
-#define SFS_NTINDIRECT    0             /* # of 3x indirect blocks in inode */
+#define SFS_NDINDIRECT    1             /* # of 2x indirect blocks in inode */
+#define SFS_NTINDIRECT    1             /* # of 3x indirect blocks in inode */
 #define SFS_DBPERIDB      128           /* # direct blks per indirect blk */
 #define SFS_NAMELEN       60            /* max length of filename */
 #define SFS_SUPER_BLOCK   0             /* block the superblock lives in */
@@ -86,9 +86,31 @@ struct sfs_dinode {
 	uint16_t sfi_linkcount;			/* # hard links to this file */
 	uint32_t sfi_direct[SFS_NDIRECT];	/* Direct blocks */
 	uint32_t sfi_indirect;			/* Indirect block */
-	uint32_t sfi_waste[128-3-SFS_NDIRECT];	/* unused space, set to 0 */
+	uint32_t sfi_dirhash;			/* Dir hash buckets, or 0 */
+	uint32_t sfi_dirmaxprobe;		/* Longest dir hash probe */
+	uint32_t sfi_dindirect;			/* Double indirect block */
+	uint32_t sfi_tindirect;			/* Triple indirect block */
+	uint32_t sfi_waste[128-7-SFS_NDIRECT];	/* unused space, set to 0 */
 };
 
+/*
+ * Hashed directories
+ *
+ * A directory with sfi_dirhash nonzero is exactly sfi_dirhash blocks
+ * long, and sfi_dirhash is a power of 2. Each block is a bucket. The
+ * entry for a name lives in the first block with room, starting from
+ * block (hash % sfi_dirhash) and wrapping around at the end, at most
+ * sfi_dirmaxprobe blocks further on, where hash is the 32-bit FNV-1a
+ * hash of the bytes of the name. A lookup need only read those blocks.
+ *
+ * The directory is otherwise an ordinary array of entries, so code
+ * that doesn't know about hashing can still read it, and setting both
+ * fields to 0 always turns it back into a valid linear directory.
+ */
+#define SFS_DIRHASH_BASIS	2166136261U	/* FNV-1a offset basis */
+#define SFS_DIRHASH_PRIME	16777619U	/* FNV-1a prime */
+#define SFS_DIRENTPERBLOCK	(SFS_BLOCKSIZE / sizeof(struct sfs_direntry))
+
 /*
  * On-disk directory entry
  */
@@ -0,0 +1,27 @@
+#ifndef _KERN_TIMEPAGE_H_
+#define _KERN_TIMEPAGE_H_
+
+/*
+ * The time page.
+ *
+ * The kernel keeps the current time in this page and updates it every
+ * clock tick. The page is mapped read-only into every process at
+ * TIMEPAGE_VADDR (just below the user stack), so reading the time
+ * needs no system call; its resolution is one clock tick.
+ *
+ * Updates are bracketed by incrementing tp_seq, so it is odd while an
+ * update is in progress. A reader takes tp_seq, reads the time, and
+ * retries if tp_seq was odd or has changed since. tp_seq is zero if
+ * the kernel has never filled the page in.
+ */
+
+#define TIMEPAGE_VADDR  0x7ff00000
+
+struct timepage {
+	volatile __u32 tp_seq;
+	__u32 tp_pad;
+	volatile __time_t tp_sec;	/* seconds */
+	volatile __i32 tp_nsec;		/* nanoseconds */
+};
+
+#endif /* _KERN_TIMEPAGE_H_ */
@@ -0,0 +1,39 @@
+#ifndef _PIPE_H_
+#define _PIPE_H_
+
+/*
+ * Pipes.
+ *
+ * A pipe is a page-sized ring buffer with two vnodes, one for each
+ * end. The ends are not in any filesystem; each is referenced only by
+ * the open-file object pipe() makes for it, and the pipe itself goes
+ * away when both ends have been closed.
+ *
+ * Reading an empty pipe blocks until there is data or the write end
+ * is closed (EOF). Writing to a pipe whose read end is closed fails
+ * with EPIPE. Writes of PIPE_BUF bytes or less are atomic.
+ */
+
+struct vnode;
+
+/* Size of the pipe buffer. */
+#define PIPE_SIZE  PAGE_SIZE
+
+/* Create a pipe; returns the read and write ends. */
+int pipe_create(struct vnode **readret, struct vnode **writeret);
+
+/*
+ * Turn non-blocking mode on or off for one end of a pipe. Does
+ * nothing if VN is not a pipe.
+ */
+void pipe_setnonblock(struct vnode *vn, bool nonblock);
+
+/*
+ * Move up to LEN bytes from FROM to TO without going through user
+ * memory. One of them must be a pipe end and the other a file, which
+ * is accessed at *POS. Returns the amount moved in *MOVED.
+ */
+int pipe_splice(struct vnode *from, struct vnode *to, off_t *pos, size_t len,
+		size_t *moved);
+
+#endif /* _PIPE_H_ */
@@ -0,0 +1,45 @@
+#ifndef _POLL_H_
+#define _POLL_H_
+
+/*
+ * Kernel support for poll().
+ *
+ * Anything whose readiness can change embeds a struct pollrec. Its
+ * vop_poll calls poll_record() and *then* checks its state; whenever
+ * the state changes in a way that might make it ready, it calls
+ * poll_wakeup(). Doing it in that order means a change that races
+ * with the check is never missed. poll_wakeup is just a flag test
+ * unless somebody has polled the object since the last wakeup, so
+ * objects nobody polls pay almost nothing. It may be called from
+ * interrupt handlers.
+ *
+ * All pollers sleep on one channel. Each effective wakeup bumps a
+ * generation number, which tells pollers to rescan their
+ * descriptors; pollers with a timeout are also woken each clock tick,
+ * but only look at the clock unless the generation has changed.
+ */
+
+#include <kern/poll.h>
+
+struct timespec;
+
+struct pollrec {
+	volatile bool pr_wanted;	/* polled since the last wakeup */
+};
+
+void pollrec_init(struct pollrec *pr);
+void poll_record(struct pollrec *pr);
+void poll_wakeup(struct pollrec *pr);
+
+/*
+ * For the poll code: get the current generation before scanning, and
+ * if nothing was ready, sleep until it changes or (if DEADLINE is
+ * not NULL) the deadline passes. Returns true on timeout.
+ */
+unsigned poll_generation(void);
+bool poll_sleep(unsigned gen, const struct timespec *deadline);
+
+void poll_bootstrap(void);
+void pollclock(void);	/* called from hardclock */
+
+#endif /* _POLL_H_ */
@@ -38,9 +38,12 @@
 
 #include <spinlock.h>
 #include <limits.h>
+#include <kern/time.h>
+#include <kern/resource.h>
 struct addrspace;
 struct thread;
 struct vnode;
+struct file_handle;
 
 /*
  * Process structure.
@@ -73,28 +76,31 @@ struct proc {
 	/* add more material here as needed */
 	pid_t proc_id;
 	pid_t parent_id;
+	pid_t p_pgid;			/* process group */
 	bool exit_status;
 	int exit_code;
 	struct lock *lock;
-	struct cv *cv;
-	struct file_handle *file_table[__OPEN_MAX];
+	struct cv *cv;			/* children's exits; see proctable_lock */
+	struct rusage p_rusage;		/* usage of this process */
+	struct rusage p_cusage;		/* usage of reaped children */
+	struct file_handle *file_table[__OPEN_MAX];	/* see file.h */
 	//Userrrrrrrrrrrrrr
 	bool exited; //flag for exit
 	struct thread * self; //pointer to the thread
 };
-struct file_handle {
-    struct vnode *vnode;
-    off_t offset;
-    struct lock *lock;
-    int destroy_count;
-    int mode_open;
-	bool con_file;
-};
-struct lock *arg_lock;
 
 /* This is the process structure for the kernel and for kernel-only threads. */
 extern struct proc *kproc;
 
+/*
+ * Table of all processes, indexed by pid-1. proctable_lock protects
+ * the table itself and each entry's parent_id, exit_status and
+ * exit_code; it is also the lock paired with each process's cv,
+ * which exiting children broadcast on to wake a waiting parent.
+ */
+extern struct proc *process_table[PID_MAX];
+extern struct lock *proctable_lock;
+
 /* Call once during system startup to allocate data structures. */
 void proc_bootstrap(void);
 
@@ -118,4 +124,22 @@ struct addrspace *proc_setas(struct addrspace *);
 int pid_alloc (pid_t* pid);
 int process_create(pid_t ppid, pid_t cpid, struct thread * selfThread);
 
+/* Create a child of the current process for fork. */
+int proc_create_fork(struct proc **ret);
+
+/* Look up a process by pid. Caller holds proctable_lock. */
+struct proc *proc_lookup(pid_t pid);
+
+/* Remove a process from the table. Caller holds proctable_lock. */
+void proctable_remove(struct proc *proc);
+
+/* Add the resource usage in FROM into TO. */
+void rusage_add(struct rusage *to, const struct rusage *from);
+
+/* Get usage for PROC, including its threads' not-yet-rolled-up usage. */
+void proc_getrusage(struct proc *proc, struct rusage *ru);
+
+/* One past the highest process table slot handed out so far. */
+extern unsigned proctable_hiwater;
+
 #endif /* _PROC_H_ */
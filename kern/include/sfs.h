@@ -50,23 +50,62 @@
 
 /*
  * In-memory inode
+ *
+ * sv_lock covers the inode copy and the file's contents. The inode
+ * number and type never change, so they can be looked at without it.
  */
 struct sfs_vnode {
 	struct vnode sv_absvn;          /* abstract vnode structure */
-	struct sfs_dinode sv_i;		/* copy of on-disk inode */
 	uint32_t sv_ino;                /* inode number */
+	struct sfs_vnode *sv_hashnext;  /* next in vnode table bucket */
+	struct lock *sv_lock;           /* lock for following */
+	struct sfs_dinode sv_i;		/* copy of on-disk inode */
 	bool sv_dirty;                  /* true if sv_i modified */
+	off_t sv_rapos;                 /* where a sequential read goes next */
+	uint32_t sv_rawindow;           /* read-ahead window, in blocks */
+	uint32_t sv_raend;              /* read-ahead queued up to here */
+	daddr_t sv_prealloc;            /* blocks reserved for appending */
+	uint32_t sv_nprealloc;          /* number of them */
+	daddr_t sv_bmapleaf;            /* last leaf indirect block, or 0 */
+	uint32_t sv_bmapbase;           /* first file block it maps */
+};
+
+/*
+ * Bucket of the table of loaded vnodes. Vnodes are hashed by inode
+ * number, and each bucket has its own lock, so lookups of different
+ * inodes don't wait for each other.
+ */
+#define SFS_VNHASHSIZE	64	/* must be a power of 2 */
+
+struct sfs_vnbucket {
+	struct lock *vb_lock;           /* lock for following */
+	struct sfs_vnode *vb_head;      /* chained on sv_hashnext */
+	unsigned vb_count;              /* number of vnodes in chain */
 };
 
 /*
  * In-memory info for a whole fs volume
+ *
+ * Lock order: vfs_biglock, then a directory's sv_lock, then the
+ * sv_lock of a file in it, then a vnode table bucket lock, then
+ * sfs_freemaplock. Buffers are held inside all of these, except that
+ * bmap and itrunc keep an indirect block held across sfs_balloc and
+ * sfs_bfree.
+ *
+ * Every entry point still takes vfs_biglock first, so for now the
+ * finer locks never actually contend; they are there for when the
+ * big lock comes off.
  */
 struct sfs_fs {
 	struct fs sfs_absfs;            /* abstract filesystem structure */
+	struct device *sfs_device;      /* device mounted on */
+
+	/* vnodes loaded into memory */
+	struct sfs_vnbucket sfs_vnhash[SFS_VNHASHSIZE];
+
+	struct lock *sfs_freemaplock;   /* lock for following */
 	struct sfs_superblock sfs_sb;	/* copy of on-disk superblock */
 	bool sfs_superdirty;            /* true if superblock modified */
-	struct device *sfs_device;      /* device mounted on */
-	struct vnodearray *sfs_vnodes;  /* vnodes loaded into memory */
 	struct bitmap *sfs_freemap;     /* blocks in use are marked 1 */
 	bool sfs_freemapdirty;          /* true if freemap modified */
 };
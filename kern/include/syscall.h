@@ -53,7 +53,6 @@ __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 
 /* Fork */
 #include <limits.h>
-extern struct proc *process_table [__OPEN_MAX];
 extern int process_counter;
 
 /*
@@ -64,9 +63,31 @@ int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
 int sys_getpid(pid_t *retval);
 void sys_exit (int exitcode);
-int sys_write(userptr_t buffer, int nbytes, int *retval);
-int sys_read(userptr_t buffer, int nbytes);
+int sys_write(int fd, userptr_t buffer, size_t nbytes, int *retval);
+int sys_read(int fd, userptr_t buffer, size_t nbytes, int *retval);
+int sys_pread(int fd, userptr_t buffer, size_t nbytes, off_t pos,
+	      int *retval);
+int sys_pwrite(int fd, userptr_t buffer, size_t nbytes, off_t pos,
+	       int *retval);
+int sys_readv(int fd, userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fd, userptr_t iov, int iovcnt, int *retval);
+int sys_open(userptr_t path, int flags, mode_t mode, int *retval);
+int sys_close(int fd);
+int sys_lseek(int fd, off_t pos, int whence, off_t *retval);
+int sys_dup2(int oldfd, int newfd, int *retval);
+int sys_dup(int oldfd, int *retval);
+int sys_pipe(userptr_t fds);
+int sys_fcntl(int fd, int cmd, int arg, int *retval);
+int sys_ioctl(int fd, int code, userptr_t data);
+int sys_splice(int fromfd, int tofd, size_t len, int *retval);
+int sys_poll(userptr_t fds, unsigned nfds, int timeout, int *retval);
+int sys___batch(userptr_t ring, int *retval);
 int sys_fork (struct trapframe *tf, pid_t *child_pid);
+int sys_execv(userptr_t prog, userptr_t args);
+int sys_spawn(userptr_t prog, userptr_t args, pid_t *retval);
 int sys_waitpid (pid_t pid, int *status, int options, pid_t * retval);
+int sys_wait4 (pid_t pid, int *status, int options, userptr_t rusage,
+	       pid_t *retval);
+int sys_getrusage(int who, userptr_t usage);
 
 #endif /* _SYSCALL_H_ */
@@ -94,6 +94,8 @@ int kmallocstress(int, char **);
 int kmalloctest3(int, char **);
 int kmalloctest4(int, char **);
 int nettest(int, char **);
+int copybench(int, char **);
+int ioschedbench(int, char **);
 
 /* Routine for running a user-level program. */
 int runprogram(char *progname);
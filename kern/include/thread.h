@@ -60,6 +60,22 @@ pid_t t_pid;
 #define SAME_STACK(p1, p2)     (((p1) & STACK_MASK) == ((p2) & STACK_MASK))
 
 
+/*
+ * Per-thread resource usage counters. Charged to the running thread
+ * as things happen, and added into the owning process's struct
+ * rusage when the thread leaves it (see proc_remthread).
+ */
+struct threadusage {
+	unsigned tu_uticks;		/* hardclocks spent in user mode */
+	unsigned tu_sticks;		/* hardclocks spent in the kernel */
+	unsigned tu_nvcsw;		/* voluntary context switches */
+	unsigned tu_nivcsw;		/* involuntary context switches */
+	unsigned tu_faults;		/* VM faults */
+	unsigned tu_inblock;		/* filesystem blocks read */
+	unsigned tu_oublock;		/* filesystem blocks written */
+	unsigned tu_nsyscalls;		/* system calls */
+};
+
 /* States a thread can be in. */
 typedef enum {
 	S_RUN,		/* running */
@@ -103,6 +119,7 @@ struct thread {
 	 * rather than per-cpu or global?
 	 */
 	bool t_in_interrupt;		/* Are we in an interrupt? */
+	bool t_intr_user;		/* Did it interrupt user mode? */
 	int t_curspl;			/* Current spl*() state */
 	int t_iplhigh_count;		/* # of times IPL has been raised */
 
@@ -111,6 +128,7 @@ struct thread {
 	 */
 	pid_t t_pid;
 	int termination_state;
+	struct threadusage t_usage;	/* Resource accounting */
 	/* add more here as needed */
 };
 
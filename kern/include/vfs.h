@@ -81,6 +81,37 @@ int vfs_lookup(char *path, struct vnode **result);
 int vfs_lookparent(char *path, struct vnode **result,
 		   char *buf, size_t buflen);
 
+/*
+ * Name lookup cache (vfsncache.c). Remembers what VOP_LOOKUP said
+ * for a name in a directory, including that it doesn't exist, so
+ * path lookups can skip the filesystem. Anything that creates,
+ * removes or renames a name must call vfs_ncremove afterwards.
+ *
+ *    vfs_nclookup   - Look up NAME in DIR. Returns false if it isn't
+ *                     cached. Otherwise returns true and sets RESULT
+ *                     to a new reference to the vnode, or to NULL if
+ *                     the name is known not to exist.
+ *    vfs_ncgen      - Call before VOP_LOOKUP, and pass the value to
+ *                     vfs_ncenter.
+ *    vfs_ncenter    - Cache VN (NULL for ENOENT) as NAME in DIR, unless
+ *                     something has been invalidated since GEN.
+ *    vfs_ncremove   - Forget NAME in DIR.
+ *    vfs_ncpurgevn  - Forget everything in or referring to VN.
+ *    vfs_ncpurgefs  - Forget everything on FS, so it can be unmounted.
+ *    vfs_ncbootstrap - Called from vfs_bootstrap.
+ *
+ * Cache entries hold vnode references.
+ */
+
+bool vfs_nclookup(struct vnode *dir, const char *name, struct vnode **result);
+unsigned vfs_ncgen(void);
+void vfs_ncenter(struct vnode *dir, const char *name, struct vnode *vn,
+		 unsigned gen);
+void vfs_ncremove(struct vnode *dir, const char *name);
+void vfs_ncpurgevn(struct vnode *vn);
+void vfs_ncpurgefs(struct fs *fs);
+void vfs_ncbootstrap(void);
+
 /*
  * VFS layer high-level operations on pathnames
  * Because lookup may destroy pathnames, these all may too.
@@ -107,6 +107,14 @@ struct vnode {
  *                      DATA. The interpretation of the data is specific
  *                      to each ioctl.
  *
+ *    vop_poll        - Check which of the poll events EVENTS (see
+ *                      kern/poll.h) the object is ready for, and return
+ *                      them, plus any of POLLERR and POLLHUP that apply,
+ *                      in *REVENTS. Objects that can become ready later
+ *                      must call poll_record() first and poll_wakeup()
+ *                      when they change state; see poll.h. Objects that
+ *                      never block can use vopgeneric_poll.
+ *
  *    vop_stat        - Return info about a file. The pointer is a
  *                      pointer to struct stat; see kern/stat.h.
  *
@@ -189,6 +197,7 @@ struct vnode_ops {
 	int (*vop_getdirentry)(struct vnode *dir, struct uio *uio);
 	int (*vop_write)(struct vnode *file, struct uio *uio);
 	int (*vop_ioctl)(struct vnode *object, int op, userptr_t data);
+	int (*vop_poll)(struct vnode *object, int events, int *revents);
 	int (*vop_stat)(struct vnode *object, struct stat *statbuf);
 	int (*vop_gettype)(struct vnode *object, mode_t *result);
 	bool (*vop_isseekable)(struct vnode *object);
@@ -233,6 +242,7 @@ struct vnode_ops {
 #define VOP_GETDIRENTRY(vn, uio)        (__VOP(vn,getdirentry)(vn, uio))
 #define VOP_WRITE(vn, uio)              (__VOP(vn, write)(vn, uio))
 #define VOP_IOCTL(vn, code, buf)        (__VOP(vn, ioctl)(vn,code,buf))
+#define VOP_POLL(vn, ev, rev)           (__VOP(vn, poll)(vn, ev, rev))
 #define VOP_STAT(vn, ptr) 	        (__VOP(vn, stat)(vn, ptr))
 #define VOP_GETTYPE(vn, result)         (__VOP(vn, gettype)(vn, result))
 #define VOP_ISSEEKABLE(vn)              (__VOP(vn, isseekable)(vn))
@@ -279,6 +289,11 @@ int vnode_init(struct vnode *, const struct vnode_ops *ops,
  */
 void vnode_cleanup(struct vnode *);
 
+/*
+ * vop_poll for objects that are always ready to read and write.
+ */
+int vopgeneric_poll(struct vnode *vn, int events, int *revents);
+
 /*
  * Common stubs for vnode functions that just fail, in various ways.
  */
@@ -95,29 +95,101 @@ bitmap_getdata(struct bitmap *b)
         return b->v;
 }
 
+/*
+ * The allocator scans 32 bits at a time. The bytes are assembled
+ * explicitly, lowest index in the lowest bit, so this doesn't depend
+ * on endianness or alignment. Bits past the end of the map read as
+ * set.
+ */
+static
+inline
+uint32_t
+bitmap_getword(struct bitmap *b, unsigned wx)
+{
+        unsigned nbytes = DIVROUNDUP(b->nbits, BITS_PER_WORD);
+        unsigned ix = wx * 4;
+        uint32_t w = 0;
+        unsigned i;
+
+        for (i=0; i<4; i++) {
+                w |= (uint32_t)(ix+i < nbytes ? b->v[ix+i] : WORD_ALLBITS)
+                        << (i * BITS_PER_WORD);
+        }
+        return w;
+}
+
+/*
+ * Index of the lowest set bit in X, which must not be 0. (There's
+ * no libgcc in the kernel, and MIPS-I has no count-zeros instruction,
+ * so __builtin_ctz is out.)
+ */
+static
+inline
+unsigned
+bitmap_ctz(uint32_t x)
+{
+        unsigned n = 0;
+
+        KASSERT(x != 0);
+        if ((x & 0xffff) == 0) {
+                n += 16;
+                x >>= 16;
+        }
+        if ((x & 0xff) == 0) {
+                n += 8;
+                x >>= 8;
+        }
+        if ((x & 0xf) == 0) {
+                n += 4;
+                x >>= 4;
+        }
+        if ((x & 0x3) == 0) {
+                n += 2;
+                x >>= 2;
+        }
+        if ((x & 0x1) == 0) {
+                n += 1;
+        }
+        return n;
+}
+
 int
-bitmap_alloc(struct bitmap *b, unsigned *index)
+bitmap_alloc_near(struct bitmap *b, unsigned goal, unsigned *index)
 {
-        unsigned ix;
-        unsigned maxix = DIVROUNDUP(b->nbits, BITS_PER_WORD);
-        unsigned offset;
+        unsigned nwords = DIVROUNDUP(b->nbits, 32);
+        unsigned wx, i, bit;
+        uint32_t free;
 
-        for (ix=0; ix<maxix; ix++) {
-                if (b->v[ix]!=WORD_ALLBITS) {
-                        for (offset = 0; offset < BITS_PER_WORD; offset++) {
-                                WORD_TYPE mask = ((WORD_TYPE)1) << offset;
-
-                                if ((b->v[ix] & mask)==0) {
-                                        b->v[ix] |= mask;
-                                        *index = (ix*BITS_PER_WORD)+offset;
-                                        KASSERT(*index < b->nbits);
-                                        return 0;
-                                }
-                        }
-                        KASSERT(0);
-                }
+        if (goal >= b->nbits) {
+                goal = 0;
         }
-        return ENOSPC;
+
+        /*
+         * Start with the word holding GOAL, ignoring the bits before
+         * it, then go on to the end and wrap around. The goal's word
+         * is looked at again last, in full, to catch bits before GOAL.
+         */
+        wx = goal / 32;
+        free = ~bitmap_getword(b, wx) & ((uint32_t)0xffffffff << (goal % 32));
+        for (i=0; free == 0 && i < nwords; i++) {
+                wx = (wx + 1) % nwords;
+                free = ~bitmap_getword(b, wx);
+        }
+        if (free == 0) {
+                return ENOSPC;
+        }
+
+        bit = wx * 32 + bitmap_ctz(free);
+        KASSERT(bit < b->nbits);
+        b->v[bit / BITS_PER_WORD] |= (WORD_TYPE)1 << (bit % BITS_PER_WORD);
+        *index = bit;
+        return 0;
+}
+
+int
+bitmap_alloc(struct bitmap *b, unsigned *index)
+{
+        return bitmap_alloc_near(b, 0, index);
 }
 
 static
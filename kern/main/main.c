@@ -45,6 +45,8 @@
 #include <vm.h>
 #include <mainbus.h>
 #include <vfs.h>
+#include <poll.h>
+#include <buf.h>
 #include <device.h>
 #include <syscall.h>
 #include <test.h>
@@ -110,6 +112,8 @@ boot(void)
 	proc_bootstrap();
 	thread_bootstrap();
 	hardclock_bootstrap();
+	poll_bootstrap();
+	buf_bootstrap();
 	vfs_bootstrap();
 	kheap_nextgeneration();
 
@@ -125,6 +129,7 @@ boot(void)
 
 	/* Late phase of initialization. */
 	vm_bootstrap();
+	timepage_bootstrap();
 	kprintf_bootstrap();
 	thread_start_cpus();
 
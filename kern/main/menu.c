@@ -41,6 +41,7 @@
 #include <proc.h>
 #include <vfs.h>
 #include <sfs.h>
+#include <iosched.h>
 #include <syscall.h>
 #include <test.h>
 #include "opt-sfs.h"
@@ -239,6 +240,27 @@ cmd_sync(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Command for setting a disk's scheduling policy.
+ */
+static
+int
+cmd_iosched(int nargs, char **args)
+{
+	int result;
+
+	if (nargs != 3) {
+		kprintf("Usage: iosched disk fifo|clook|deadline\n");
+		return EINVAL;
+	}
+
+	result = iosched_setpolicy(args[1], args[2]);
+	if (result) {
+		kprintf("iosched: %s\n", strerror(result));
+	}
+	return result;
+}
+
 /*
  * Command for dropping to the debugger.
  */
@@ -533,6 +555,7 @@ static const char *opsmenu[] = {
 	"[cd]      Change directory          ",
 	"[pwd]     Print current directory   ",
 	"[sync]    Sync filesystems          ",
+	"[iosched] Set disk scheduling policy",
 	"[debug]   Drop to debugger          ",
 	"[panic]   Intentional panic         ",
 	"[deadlock] Intentional deadlock     ",
@@ -577,6 +600,8 @@ static const char *testmenu[] = {
 	"[fs4] FS write stress 2             ",
 	"[fs5] FS long stress                ",
 	"[fs6] FS create stress              ",
+	"[cpb] Copy benchmarks               ",
+	"[iosb] Disk scheduler benchmark     ",
 	NULL
 };
 
@@ -641,6 +666,7 @@ static struct {
 	{ "cd",		cmd_chdir },
 	{ "pwd",	cmd_pwd },
 	{ "sync",	cmd_sync },
+	{ "iosched",	cmd_iosched },
 	{ "debug",	cmd_debug },
 	{ "panic",	cmd_panic },
 	{ "deadlock",	cmd_deadlock },
@@ -707,6 +733,10 @@ static struct {
 	{ "fs5",	longstress },
 	{ "fs6",	createstress },
 
+	/* benchmarks */
+	{ "cpb",	copybench },
+	{ "iosb",	ioschedbench },
+
 	{ NULL, NULL }
 };
 
@@ -43,6 +43,7 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <spl.h>
 #include <proc.h>
 #include <current.h>
@@ -52,6 +53,9 @@
 #include <fcntl.h>
 #include <synch.h>
 #include <vfs.h>
+#include <file.h>
+#include <clock.h>
+#include <thread.h>
 
 #include <vm.h>
 /*
@@ -59,6 +63,8 @@
  */
 struct proc *kproc;
 struct proc *process_table [PID_MAX];
+struct lock *proctable_lock;
+unsigned proctable_hiwater;
 
 /*
  * Create a proc structure.
@@ -95,6 +101,10 @@ proc_create(const char *name)
 	} else {
 		proc->proc_id = -1;
 	}
+	proc->parent_id = 0;
+	proc->p_pgid = proc->proc_id;
+	bzero(&proc->p_rusage, sizeof(proc->p_rusage));
+	bzero(&proc->p_cusage, sizeof(proc->p_cusage));
 	proc->exit_status = false;
 	proc->exit_code =-1;
 	proc->lock = lock_create("Process_lock");
@@ -188,47 +198,8 @@ proc_destroy(struct proc *proc)
 		as_destroy(as);
 	}
 
-	for(int i = 3; i < OPEN_MAX; i++) {
-        if(proc->file_table[i] != NULL){
-            lock_acquire(proc->file_table[i]->lock);
-            proc->file_table[i]->destroy_count--;
-			if(proc->file_table[i]->destroy_count > 0) {
-				lock_release(proc->file_table[i]->lock);
-                proc->file_table[i] = NULL;
-				//destroy file handle if count reaches 0
-        	}else {
-				lock_release(proc->file_table[i]->lock);
-                KASSERT(proc->file_table[i]->destroy_count == 0);
-                lock_destroy(proc->file_table[i]->lock);
-                vfs_close(proc->file_table[i]->vnode);
-                kfree(proc->file_table[i]);
-                proc->file_table[i] = NULL;
-        	}
-
-        }
-    }
-
-	if (curproc->parent_id == 1){
-		for(int i = 0; i < 3; i++) {
-        if(proc->file_table[i] != NULL){
-            lock_acquire(proc->file_table[i]->lock);
-            proc->file_table[i]->destroy_count--;
-			if(proc->file_table[i]->destroy_count > 0) {
-				lock_release(proc->file_table[i]->lock);
-                proc->file_table[i] = NULL;
-				//destroy file handle if count reaches 0
-        	}else {
-				lock_release(proc->file_table[i]->lock);
-                KASSERT(proc->file_table[i]->destroy_count == 0);
-                lock_destroy(proc->file_table[i]->lock);
-                vfs_close(proc->file_table[i]->vnode);
-                kfree(proc->file_table[i]);
-                proc->file_table[i] = NULL;
-        	}
-
-        	}
-    	}
-	}
+	/* Normally already done by sys_exit. */
+	filetable_closeall(proc);
 
 	lock_destroy(proc->lock);
 	cv_destroy(proc->cv);
@@ -250,6 +221,10 @@ proc_bootstrap(void)
 	if (kproc == NULL) {
 		panic("proc_create for kproc failed\n");
 	}
+	proctable_lock = lock_create("proctable");
+	if (proctable_lock == NULL) {
+		panic("lock_create for proctable_lock failed\n");
+	}
 }
 
 /*
@@ -274,158 +249,27 @@ proc_create_runprogram(const char *name)
 	newproc->p_addrspace = NULL;
 
 	/* VFS fields */
+	lock_acquire(proctable_lock);
 	err = pid_alloc (&newproc->proc_id);
 	if (err) {
+		lock_release(proctable_lock);
         return NULL;
     }
 	newproc->parent_id = curproc->proc_id;
+	newproc->p_pgid = newproc->proc_id;
 	process_table[newproc->proc_id-1] = newproc;
+	lock_release(proctable_lock);
 	for (int i = 0; i < OPEN_MAX; i++)
 		newproc->file_table[i] = NULL;
 
-	arg_lock = lock_create("Argument lock");
-	KASSERT(arg_lock != NULL);	
-	// console initialization STDIN
-	err =-1;
-	char *con0 = kstrdup("con:");
-	KASSERT(con0!=NULL);
-
-	newproc->file_table[0] = (struct file_handle *)kmalloc(sizeof(struct file_handle));
-	if (newproc->file_table[0] == NULL) {
-		kfree(con0);
-		return NULL;
-	}
-
-	err = vfs_open(con0, O_RDONLY, 0664, &newproc->file_table[0]->vnode);
+	err = filetable_stdio(newproc);
 	if (err) {
-	    kfree(con0);
-		kfree(newproc->file_table[0]);
+		lock_acquire(proctable_lock);
+		proctable_remove(newproc);
+		lock_release(proctable_lock);
+		proc_destroy(newproc);
 		return NULL;
 	}
-	kfree(con0);
-
-	newproc->file_table[0]->offset = 0;
-	newproc->file_table[0]->con_file = true;
-	newproc->file_table[0]->destroy_count = 1;
-	newproc->file_table[0]->mode_open = O_RDONLY;
-	newproc->file_table[0]->lock = lock_create("STDIN");
-	if (newproc->file_table[0]->lock == NULL) {
-		kfree(con0);
-		vfs_close(newproc->file_table[0]->vnode);
-        kfree(newproc->file_table[0]);
-		return NULL;
-	}
-
-
-	// console initialization STDOUT
-    char *con1 = kstrdup("con:");
-       if (con1 == NULL) {
-        kfree(con0);
-		lock_destroy(newproc->file_table[0]->lock);
-		vfs_close(newproc->file_table[0]->vnode);
-        kfree(newproc->file_table[0]);
-		return NULL;
-        }
-
-	err =-1;
-	newproc->file_table[1] = (struct file_handle *)kmalloc(sizeof(struct file_handle));
-    if (newproc->file_table[1] == NULL) {
-		lock_destroy(newproc->file_table[0]->lock);
-        vfs_close(newproc->file_table[0]->vnode);
-        kfree(newproc->file_table[0]);
-        kfree(con0);
-		kfree(con1);
-        return NULL;
-    }
-	err = vfs_open(con1, O_WRONLY, 0664, &newproc->file_table[1]->vnode);
-    if (err) {
-		lock_destroy(newproc->file_table[0]->lock);
-        vfs_close(newproc->file_table[0]->vnode);
-        kfree(newproc->file_table[0]);
-        kfree(newproc->file_table[1]);
-		kfree(con0);
-		kfree(con1);
-        return NULL;
-    }
-	newproc->file_table[1]->offset = 0;
-	newproc->file_table[1]->con_file = true;
-	newproc->file_table[1]->destroy_count = 1;
-    newproc->file_table[1]->mode_open = O_WRONLY;
-    newproc->file_table[1]->lock = lock_create("STDOUT");
-    if (newproc->file_table[1]->lock == NULL) {
-		lock_destroy(newproc->file_table[0]->lock);
-		vfs_close(newproc->file_table[0]->vnode);
-        kfree(newproc->file_table[0]);
-        vfs_close(newproc->file_table[1]->vnode);
-		kfree(con0);
-		kfree(con1);
-        kfree(newproc->file_table[1]);
-		return NULL;
-    }
-
-	// console initialization STDERR
-	char *con2 = kstrdup("con:");
-    if (con2 == NULL) {
-        kfree(con0);
-        lock_destroy(newproc->file_table[0]->lock);
-        vfs_close(newproc->file_table[0]->vnode);
-        kfree(newproc->file_table[0]);
-        kfree(con1);
-        vfs_close(newproc->file_table[1]->vnode);
-		lock_destroy(newproc->file_table[1]->lock);
-        kfree(newproc->file_table[1]);
-		return NULL;
-        }
-	err =-1;
-	newproc->file_table[2] = (struct file_handle *)kmalloc(sizeof(struct file_handle));
-	if (newproc->file_table[2] == NULL) {
-        lock_destroy(newproc->file_table[0]->lock);
-        vfs_close(newproc->file_table[0]->vnode);
-        kfree(newproc->file_table[0]);
-        vfs_close(newproc->file_table[1]->vnode);
-        lock_destroy(newproc->file_table[1]->lock);
-        kfree(newproc->file_table[1]);
-		kfree(con0);
-		kfree(con1);
-		kfree(con2);
-		return NULL;
-    }
-
-	err = -1;
-    err = vfs_open(con2, O_WRONLY, 0664, &newproc->file_table[2]->vnode);
-	if (err) {
-		lock_destroy(newproc->file_table[0]->lock);
-		vfs_close(newproc->file_table[0]->vnode);
-		kfree(newproc->file_table[0]);
-		vfs_close(newproc->file_table[1]->vnode);
-		lock_destroy(newproc->file_table[1]->lock);
-		kfree(newproc->file_table[1]);
-		kfree(con0);
-		kfree(con1);
-		kfree(con2);
-		kfree(newproc->file_table[2]);
-        return NULL;
-    }
-
-	newproc->file_table[2]->offset = 0;
-	newproc->file_table[2]->con_file = true;
-    newproc->file_table[2]->destroy_count = 1;
-    newproc->file_table[2]->mode_open = O_WRONLY;
-	newproc->file_table[2]->lock = lock_create("STDERR");
-    if (newproc->file_table[2]->lock == NULL) {
-        lock_destroy(newproc->file_table[0]->lock);
-        vfs_close(newproc->file_table[0]->vnode);
-        kfree(newproc->file_table[0]);
-        vfs_close(newproc->file_table[1]->vnode);
-		lock_destroy(newproc->file_table[1]->lock);
-        kfree(newproc->file_table[1]);
-		kfree(con0);
-		kfree(con1);
-		kfree(con2);
-        vfs_close(newproc->file_table[2]->vnode);
-		kfree(newproc->file_table[2]);
-		return NULL;
-    }
 
 	/*
 	 * Lock the current process to copy its current directory.
@@ -469,6 +313,88 @@ proc_addthread(struct proc *proc, struct thread *t)
 	return 0;
 }
 
+/*
+ * Add some number of hardclock ticks to a timeval.
+ */
+static
+void
+timeval_addticks(struct timeval *tv, unsigned ticks)
+{
+	tv->tv_sec += ticks / HZ;
+	tv->tv_usec += (ticks % HZ) * (1000000 / HZ);
+	if (tv->tv_usec >= 1000000) {
+		tv->tv_usec -= 1000000;
+		tv->tv_sec++;
+	}
+}
+
+/*
+ * Add a thread's counters into a struct rusage.
+ */
+static
+void
+rusage_addthread(struct rusage *ru, const struct threadusage *tu)
+{
+	timeval_addticks(&ru->ru_utime, tu->tu_uticks);
+	timeval_addticks(&ru->ru_stime, tu->tu_sticks);
+	ru->ru_minflt += tu->tu_faults;
+	ru->ru_inblock += tu->tu_inblock;
+	ru->ru_oublock += tu->tu_oublock;
+	ru->ru_nvcsw += tu->tu_nvcsw;
+	ru->ru_nivcsw += tu->tu_nivcsw;
+	ru->ru_nsyscalls += tu->tu_nsyscalls;
+}
+
+void
+rusage_add(struct rusage *to, const struct rusage *from)
+{
+	to->ru_utime.tv_sec += from->ru_utime.tv_sec;
+	to->ru_utime.tv_usec += from->ru_utime.tv_usec;
+	if (to->ru_utime.tv_usec >= 1000000) {
+		to->ru_utime.tv_usec -= 1000000;
+		to->ru_utime.tv_sec++;
+	}
+	to->ru_stime.tv_sec += from->ru_stime.tv_sec;
+	to->ru_stime.tv_usec += from->ru_stime.tv_usec;
+	if (to->ru_stime.tv_usec >= 1000000) {
+		to->ru_stime.tv_usec -= 1000000;
+		to->ru_stime.tv_sec++;
+	}
+	if (from->ru_maxrss > to->ru_maxrss) {
+		to->ru_maxrss = from->ru_maxrss;
+	}
+	to->ru_minflt += from->ru_minflt;
+	to->ru_majflt += from->ru_majflt;
+	to->ru_inblock += from->ru_inblock;
+	to->ru_oublock += from->ru_oublock;
+	to->ru_msgrcv += from->ru_msgrcv;
+	to->ru_msgsnd += from->ru_msgsnd;
+	to->ru_nsignals += from->ru_nsignals;
+	to->ru_nvcsw += from->ru_nvcsw;
+	to->ru_nivcsw += from->ru_nivcsw;
+	to->ru_nsyscalls += from->ru_nsyscalls;
+}
+
+/*
+ * Get the resource usage of a process. Usage is only rolled up into
+ * the process when a thread leaves it, so add in the current
+ * thread's running counts if it belongs to PROC. (Other threads of
+ * PROC, if there are any, are not counted until they exit.)
+ *
+ * p_lock is a spinlock, so holding it also keeps hardclock from
+ * updating curthread's counters while we read them.
+ */
+void
+proc_getrusage(struct proc *proc, struct rusage *ru)
+{
+	spinlock_acquire(&proc->p_lock);
+	*ru = proc->p_rusage;
+	if (curthread->t_proc == proc) {
+		rusage_addthread(ru, &curthread->t_usage);
+	}
+	spinlock_release(&proc->p_lock);
+}
+
 /*
  * Remove a thread from its process. Either the thread or the process
  * might or might not be current.
@@ -490,6 +416,9 @@ proc_remthread(struct thread *t)
 	spinlock_acquire(&proc->p_lock);
 	KASSERT(proc->p_numthreads > 0);
 	proc->p_numthreads--;
+	/* Roll the thread's usage up into the process and start over. */
+	rusage_addthread(&proc->p_rusage, &t->t_usage);
+	bzero(&t->t_usage, sizeof(t->t_usage));
 	spinlock_release(&proc->p_lock);
 
 	spl = splhigh();
@@ -558,7 +487,11 @@ int process_create(pid_t ppid, pid_t cpid, struct thread * selfThread){
 	return 0;
 }
 
+/*
+ * Allocate a pid. Caller holds proctable_lock.
+ */
 int pid_alloc (pid_t* pid) {
+	KASSERT(lock_do_i_hold(proctable_lock));
 	//first clean up process table of zombies 
 	for (int j=1; j<1000 ;j++){
 		if (process_table[j]!=NULL){
@@ -571,8 +504,73 @@ int pid_alloc (pid_t* pid) {
     for (int i=1; i<1000 ;i++){
         if (process_table[i]== NULL){
             *pid = i+1;
+            if ((unsigned)i >= proctable_hiwater) {
+                proctable_hiwater = i+1;
+            }
             return 0;
         }
     }
     return -1; // process table is full
+}
+
+struct proc *
+proc_lookup(pid_t pid)
+{
+	KASSERT(lock_do_i_hold(proctable_lock));
+
+	if (pid < PID_MIN || pid > PID_MAX) {
+		return NULL;
+	}
+	return process_table[pid-1];
+}
+
+void
+proctable_remove(struct proc *proc)
+{
+	KASSERT(lock_do_i_hold(proctable_lock));
+	KASSERT(process_table[proc->proc_id-1] == proc);
+
+	process_table[proc->proc_id-1] = NULL;
+}
+
+/*
+ * Create a proc structure for a child of the current process. The
+ * child gets a fresh pid, is entered in the process table, and
+ * inherits its parent's process group and current directory. It has
+ * no address space and no threads; the caller supplies both.
+ */
+int
+proc_create_fork(struct proc **ret)
+{
+	struct proc *newproc;
+	int err;
+
+	newproc = proc_create(curproc->p_name);
+	if (newproc == NULL) {
+		return ENOMEM;
+	}
+
+	lock_acquire(proctable_lock);
+	err = pid_alloc(&newproc->proc_id);
+	if (err) {
+		lock_release(proctable_lock);
+		proc_destroy(newproc);
+		return ENPROC;
+	}
+	newproc->parent_id = curproc->proc_id;
+	newproc->p_pgid = curproc->p_pgid;
+	process_table[newproc->proc_id-1] = newproc;
+	lock_release(proctable_lock);
+
+	spinlock_acquire(&curproc->p_lock);
+	if (curproc->p_cwd != NULL) {
+		VOP_INCREF(curproc->p_cwd);
+		newproc->p_cwd = curproc->p_cwd;
+	}
+	spinlock_release(&curproc->p_lock);
+
+	filetable_fork(curproc, newproc);
+
+	*ret = newproc;
+	return 0;
 }
\ No newline at end of file
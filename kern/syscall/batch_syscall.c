@@ -0,0 +1,114 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/batch.h>
+#include <lib.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+/* Entries copied in and out at a time. */
+#define BATCH_CHUNK 8
+
+/*
+ * Run one entry, leaving its results in the entry.
+ */
+static
+void
+batch_run(struct batch_ent *be)
+{
+	int r = 0;
+	off_t pos = 0;
+
+	switch (be->be_op) {
+	    case BATCH_READ:
+		be->be_error = sys_read(be->be_fd, be->be_buf, be->be_len, &r);
+		pos = r;
+		break;
+	    case BATCH_WRITE:
+		be->be_error = sys_write(be->be_fd, be->be_buf, be->be_len,
+					 &r);
+		pos = r;
+		break;
+	    case BATCH_PREAD:
+		be->be_error = sys_pread(be->be_fd, be->be_buf, be->be_len,
+					 be->be_pos, &r);
+		pos = r;
+		break;
+	    case BATCH_PWRITE:
+		be->be_error = sys_pwrite(be->be_fd, be->be_buf, be->be_len,
+					  be->be_pos, &r);
+		pos = r;
+		break;
+	    case BATCH_LSEEK:
+		be->be_error = sys_lseek(be->be_fd, be->be_pos,
+					 be->be_whence, &pos);
+		break;
+	    case BATCH_CLOSE:
+		be->be_error = sys_close(be->be_fd);
+		break;
+	    default:
+		be->be_error = EINVAL;
+		break;
+	}
+	be->be_result = be->be_error ? -1 : pos;
+}
+
+/*
+ * Run everything queued in the user's batch ring with one trap. The
+ * entries are copied in and out a chunk at a time rather than one by
+ * one. Returns the number of entries run.
+ */
+int
+sys___batch(userptr_t uring, int *retval)
+{
+	struct batch_ring *ring = (struct batch_ring *)uring;
+	struct batch_ent ents[BATCH_CHUNK];
+	unsigned head, tail, slot, n, i;
+	int result;
+
+	result = copyin((userptr_t)&ring->br_head, &head, sizeof(head));
+	if (result) {
+		return result;
+	}
+	result = copyin((userptr_t)&ring->br_tail, &tail, sizeof(tail));
+	if (result) {
+		return result;
+	}
+	if (tail - head > BATCH_RINGSIZE) {
+		return EINVAL;
+	}
+
+	*retval = tail - head;
+	while (head != tail) {
+		/* a run of consecutive slots, not past the end of the ring */
+		slot = head % BATCH_RINGSIZE;
+		n = tail - head;
+		if (n > BATCH_CHUNK) {
+			n = BATCH_CHUNK;
+		}
+		if (n > BATCH_RINGSIZE - slot) {
+			n = BATCH_RINGSIZE - slot;
+		}
+
+		result = copyin((userptr_t)&ring->br_ents[slot], ents,
+				n * sizeof(ents[0]));
+		if (result) {
+			return result;
+		}
+		for (i = 0; i < n; i++) {
+			batch_run(&ents[i]);
+		}
+		result = copyout(ents, (userptr_t)&ring->br_ents[slot],
+				 n * sizeof(ents[0]));
+		if (result) {
+			return result;
+		}
+
+		head += n;
+		result = copyout(&head, (userptr_t)&ring->br_head,
+				 sizeof(head));
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
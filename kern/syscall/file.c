@@ -0,0 +1,165 @@
+/*
+ * Open-file objects and per-process file tables. See file.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <proc.h>
+#include <current.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <file.h>
+
+int
+file_create(struct vnode *vn, int flags, struct file_handle **ret)
+{
+	struct file_handle *fh;
+
+	fh = kmalloc(sizeof(*fh));
+	if (fh == NULL) {
+		return ENOMEM;
+	}
+	fh->lock = lock_create("file_handle");
+	if (fh->lock == NULL) {
+		kfree(fh);
+		return ENOMEM;
+	}
+
+	fh->vnode = vn;
+	fh->offset = 0;
+	spinlock_init(&fh->count_lock);
+	fh->destroy_count = 1;
+	fh->mode_open = flags;
+	fh->con_file = !VOP_ISSEEKABLE(vn);
+
+	*ret = fh;
+	return 0;
+}
+
+int
+file_open(char *path, int flags, mode_t mode, struct file_handle **ret)
+{
+	struct vnode *vn;
+	int err;
+
+	err = vfs_open(path, flags, mode, &vn);
+	if (err) {
+		return err;
+	}
+	err = file_create(vn, flags, ret);
+	if (err) {
+		vfs_close(vn);
+		return err;
+	}
+	return 0;
+}
+
+void
+file_incref(struct file_handle *fh)
+{
+	spinlock_acquire(&fh->count_lock);
+	KASSERT(fh->destroy_count > 0);
+	fh->destroy_count++;
+	spinlock_release(&fh->count_lock);
+}
+
+void
+file_decref(struct file_handle *fh)
+{
+	bool last;
+
+	spinlock_acquire(&fh->count_lock);
+	KASSERT(fh->destroy_count > 0);
+	fh->destroy_count--;
+	last = (fh->destroy_count == 0);
+	spinlock_release(&fh->count_lock);
+
+	if (last) {
+		vfs_close(fh->vnode);
+		spinlock_cleanup(&fh->count_lock);
+		lock_destroy(fh->lock);
+		kfree(fh);
+	}
+}
+
+int
+fd_lookup(int fd, struct file_handle **ret)
+{
+	if (fd < 0 || fd >= OPEN_MAX) {
+		return EBADF;
+	}
+	if (curproc->file_table[fd] == NULL) {
+		return EBADF;
+	}
+	*ret = curproc->file_table[fd];
+	return 0;
+}
+
+int
+filetable_place(struct proc *proc, struct file_handle *fh, int *fd)
+{
+	int i;
+
+	for (i = 0; i < OPEN_MAX; i++) {
+		if (proc->file_table[i] == NULL) {
+			proc->file_table[i] = fh;
+			*fd = i;
+			return 0;
+		}
+	}
+	return EMFILE;
+}
+
+void
+filetable_fork(struct proc *parent, struct proc *child)
+{
+	int i;
+
+	for (i = 0; i < OPEN_MAX; i++) {
+		if (parent->file_table[i] != NULL) {
+			file_incref(parent->file_table[i]);
+			child->file_table[i] = parent->file_table[i];
+		}
+	}
+}
+
+void
+filetable_closeall(struct proc *proc)
+{
+	int i;
+
+	for (i = 0; i < OPEN_MAX; i++) {
+		if (proc->file_table[i] != NULL) {
+			file_decref(proc->file_table[i]);
+			proc->file_table[i] = NULL;
+		}
+	}
+}
+
+int
+filetable_stdio(struct proc *proc)
+{
+	static const int modes[3] = { O_RDONLY, O_WRONLY, O_WRONLY };
+	struct file_handle *fh;
+	char path[5];
+	int i, fd, err;
+
+	for (i = 0; i < 3; i++) {
+		KASSERT(proc->file_table[i] == NULL);
+
+		/* vfs_open may destroy the path, so use a fresh copy */
+		strcpy(path, "con:");
+		err = file_open(path, modes[i], 0664, &fh);
+		if (err) {
+			filetable_closeall(proc);
+			return err;
+		}
+		err = filetable_place(proc, fh, &fd);
+		KASSERT(err == 0 && fd == i);
+	}
+	return 0;
+}
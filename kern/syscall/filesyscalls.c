@@ -1,38 +1,581 @@
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/ioctl.h>
+#include <kern/seek.h>
+#include <kern/stat.h>
 #include <kern/unistd.h>
 #include <lib.h>
 #include <uio.h>
+#include <proc.h>
+#include <synch.h>
 #include <syscall.h>
 #include <vnode.h>
 #include <vfs.h>
+#include <file.h>
+#include <pipe.h>
+#include <poll.h>
+#include <clock.h>
+#include <copyinout.h>
 #include <current.h>
 
-int sys_write(userptr_t buffer, int nbytes, int *retval)
-{	
-	int i;
+/*
+ * Common code for all the read and write calls: hand a uio that
+ * already describes the whole user request (one or more buffers) to
+ * the vnode in a single VOP call.
+ *
+ * Ordinary I/O starts at the handle's offset and advances it; the
+ * handle's lock keeps that consistent if the handle is shared.
+ * Positional I/O (pread/pwrite) uses the offset already in the uio,
+ * leaves the handle's offset alone, and so doesn't need the lock.
+ * Nor does I/O on pipes and the console, which have no offset and
+ * may block for as long as they like.
+ */
+static
+int
+file_rwuio(int fd, struct uio *u, bool positional, int *retval)
+{
+	struct file_handle *fh;
+	size_t len = u->uio_resid;
+	int how;
+	int err;
+
+	err = fd_lookup(fd, &fh);
+	if (err) {
+		return err;
+	}
+
+	how = fh->mode_open & O_ACCMODE;
+	if ((u->uio_rw == UIO_READ && how == O_WRONLY) ||
+	    (u->uio_rw == UIO_WRITE && how == O_RDONLY)) {
+		return EBADF;
+	}
+
+	if (positional) {
+		if (!VOP_ISSEEKABLE(fh->vnode)) {
+			return ESPIPE;
+		}
+		if (u->uio_offset < 0) {
+			return EINVAL;
+		}
+	}
+
+	if (positional || !VOP_ISSEEKABLE(fh->vnode)) {
+		if (!positional) {
+			/* Pipe or console: no offset at all. */
+			u->uio_offset = 0;
+		}
+		if (u->uio_rw == UIO_READ) {
+			err = VOP_READ(fh->vnode, u);
+		}
+		else {
+			err = VOP_WRITE(fh->vnode, u);
+		}
+		if (err) {
+			return err;
+		}
+		*retval = len - u->uio_resid;
+		return 0;
+	}
+
+	lock_acquire(fh->lock);
+	if (u->uio_rw == UIO_WRITE && (fh->mode_open & O_APPEND)) {
+		struct stat st;
+
+		err = VOP_STAT(fh->vnode, &st);
+		if (err) {
+			lock_release(fh->lock);
+			return err;
+		}
+		fh->offset = st.st_size;
+	}
+	u->uio_offset = fh->offset;
+	if (u->uio_rw == UIO_READ) {
+		err = VOP_READ(fh->vnode, u);
+	}
+	else {
+		err = VOP_WRITE(fh->vnode, u);
+	}
+	if (err) {
+		lock_release(fh->lock);
+		return err;
+	}
+	fh->offset = u->uio_offset;
+	lock_release(fh->lock);
+
+	*retval = len - u->uio_resid;
+	return 0;
+}
+
+int sys_write(int fd, userptr_t buffer, size_t nbytes, int *retval)
+{
+	struct iovec iov;
+	struct uio u;
+
+	uio_uinit(&iov, &u, buffer, nbytes, 0, UIO_WRITE);
+	return file_rwuio(fd, &u, false, retval);
+}
+
+int sys_read(int fd, userptr_t buffer, size_t nbytes, int *retval)
+{
+	struct iovec iov;
+	struct uio u;
+
+	uio_uinit(&iov, &u, buffer, nbytes, 0, UIO_READ);
+	return file_rwuio(fd, &u, false, retval);
+}
+
+int sys_pwrite(int fd, userptr_t buffer, size_t nbytes, off_t pos,
+	       int *retval)
+{
+	struct iovec iov;
+	struct uio u;
+
+	uio_uinit(&iov, &u, buffer, nbytes, pos, UIO_WRITE);
+	return file_rwuio(fd, &u, true, retval);
+}
+
+int sys_pread(int fd, userptr_t buffer, size_t nbytes, off_t pos,
+	      int *retval)
+{
+	struct iovec iov;
+	struct uio u;
+
+	uio_uinit(&iov, &u, buffer, nbytes, pos, UIO_READ);
+	return file_rwuio(fd, &u, true, retval);
+}
+
+/*
+ * Common code for readv and writev. The user's iovec array is copied
+ * in once and used directly as the uio's iovecs (user and kernel
+ * struct iovec have the same layout), so the whole request is a
+ * single VOP call.
+ */
+static
+int
+file_rwv(int fd, userptr_t uiov, int iovcnt, enum uio_rw rw, int *retval)
+{
+	struct iovec *iov;
+	struct uio u;
+	size_t total;
+	int i, err;
+
+	if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+
+	iov = kmalloc(iovcnt * sizeof(*iov));
+	if (iov == NULL) {
+		return ENOMEM;
+	}
+	err = copyin(uiov, iov, iovcnt * sizeof(*iov));
+	if (err) {
+		kfree(iov);
+		return err;
+	}
+
+	total = 0;
+	for (i = 0; i < iovcnt; i++) {
+		if (total + iov[i].iov_len < total) {
+			/* overflow */
+			kfree(iov);
+			return EINVAL;
+		}
+		total += iov[i].iov_len;
+	}
+
+	u.uio_iov = iov;
+	u.uio_iovcnt = iovcnt;
+	u.uio_offset = 0;
+	u.uio_resid = total;
+	u.uio_segflg = UIO_USERSPACE;
+	u.uio_rw = rw;
+	u.uio_space = proc_getas();
+
+	err = file_rwuio(fd, &u, false, retval);
+	kfree(iov);
+	return err;
+}
+
+int sys_writev(int fd, userptr_t iov, int iovcnt, int *retval)
+{
+	return file_rwv(fd, iov, iovcnt, UIO_WRITE, retval);
+}
+
+int sys_readv(int fd, userptr_t iov, int iovcnt, int *retval)
+{
+	return file_rwv(fd, iov, iovcnt, UIO_READ, retval);
+}
+
+int sys_open(userptr_t path, int flags, mode_t mode, int *retval)
+{
+	struct file_handle *fh;
+	char *kpath;
+	int fd, err;
+
+	if ((flags & O_ACCMODE) == O_ACCMODE) {
+		return EINVAL;
+	}
+
+	kpath = kmalloc(PATH_MAX);
+	if (kpath == NULL) {
+		return ENOMEM;
+	}
+	err = copyinstr(path, kpath, PATH_MAX, NULL);
+	if (err) {
+		kfree(kpath);
+		return err;
+	}
+
+	err = file_open(kpath, flags, mode, &fh);
+	kfree(kpath);
+	if (err) {
+		return err;
+	}
+
+	err = filetable_place(curproc, fh, &fd);
+	if (err) {
+		file_decref(fh);
+		return err;
+	}
+	*retval = fd;
+	return 0;
+}
+
+int sys_close(int fd)
+{
+	struct file_handle *fh;
+	int err;
+
+	err = fd_lookup(fd, &fh);
+	if (err) {
+		return err;
+	}
+	curproc->file_table[fd] = NULL;
+	file_decref(fh);
+	return 0;
+}
+
+int sys_lseek(int fd, off_t pos, int whence, off_t *retval)
+{
+	struct file_handle *fh;
+	struct stat st;
+	off_t newpos;
+	int err;
+
+	err = fd_lookup(fd, &fh);
+	if (err) {
+		return err;
+	}
+	if (!VOP_ISSEEKABLE(fh->vnode)) {
+		return ESPIPE;
+	}
+
+	lock_acquire(fh->lock);
+	switch (whence) {
+	    case SEEK_SET:
+		newpos = pos;
+		break;
+	    case SEEK_CUR:
+		newpos = fh->offset + pos;
+		break;
+	    case SEEK_END:
+		err = VOP_STAT(fh->vnode, &st);
+		if (err) {
+			lock_release(fh->lock);
+			return err;
+		}
+		newpos = st.st_size + pos;
+		break;
+	    default:
+		lock_release(fh->lock);
+		return EINVAL;
+	}
+	if (newpos < 0) {
+		lock_release(fh->lock);
+		return EINVAL;
+	}
+	fh->offset = newpos;
+	lock_release(fh->lock);
 
-	for(i=0; i<nbytes; i++)
-		kprintf("%c", ((char *)buffer)[i]);
-		
-	(*retval) = 1; //number of written char
-	
+	*retval = newpos;
 	return 0;
+}
+
+/*
+ * dup2 makes NEWFD refer to the same open-file object as OLDFD, so
+ * they share the seek position. This is what the shell uses for
+ * redirection after opening the target once.
+ */
+int sys_dup2(int oldfd, int newfd, int *retval)
+{
+	struct file_handle *fh;
+	int err;
+
+	err = fd_lookup(oldfd, &fh);
+	if (err) {
+		return err;
+	}
+	if (newfd < 0 || newfd >= OPEN_MAX) {
+		return EBADF;
+	}
+
+	if (oldfd != newfd) {
+		file_incref(fh);
+		if (curproc->file_table[newfd] != NULL) {
+			file_decref(curproc->file_table[newfd]);
+		}
+		curproc->file_table[newfd] = fh;
+	}
+	*retval = newfd;
+	return 0;
+}
+
+int sys_dup(int oldfd, int *retval)
+{
+	struct file_handle *fh;
+	int err;
+
+	err = fd_lookup(oldfd, &fh);
+	if (err) {
+		return err;
+	}
+	file_incref(fh);
+	err = filetable_place(curproc, fh, retval);
+	if (err) {
+		file_decref(fh);
+		return err;
+	}
+	return 0;
+}
+
+int sys_pipe(userptr_t fds)
+{
+	struct vnode *rv, *wv;
+	struct file_handle *rfh, *wfh;
+	int kfds[2];
+	int err;
+
+	err = pipe_create(&rv, &wv);
+	if (err) {
+		return err;
+	}
+	err = file_create(rv, O_RDONLY, &rfh);
+	if (err) {
+		vfs_close(rv);
+		vfs_close(wv);
+		return err;
+	}
+	err = file_create(wv, O_WRONLY, &wfh);
+	if (err) {
+		file_decref(rfh);
+		vfs_close(wv);
+		return err;
+	}
+
+	err = filetable_place(curproc, rfh, &kfds[0]);
+	if (err) {
+		goto fail;
+	}
+	err = filetable_place(curproc, wfh, &kfds[1]);
+	if (err) {
+		curproc->file_table[kfds[0]] = NULL;
+		goto fail;
+	}
+
+	err = copyout(kfds, fds, sizeof(kfds));
+	if (err) {
+		curproc->file_table[kfds[0]] = NULL;
+		curproc->file_table[kfds[1]] = NULL;
+		goto fail;
+	}
+	return 0;
+
+ fail:
+	file_decref(rfh);
+	file_decref(wfh);
+	return err;
+}
+
+/*
+ * fcntl. Only the file status flags are supported; of those, only
+ * O_APPEND and O_NONBLOCK can be changed.
+ */
+int sys_fcntl(int fd, int cmd, int arg, int *retval)
+{
+	struct file_handle *fh;
+	int err;
+
+	err = fd_lookup(fd, &fh);
+	if (err) {
+		return err;
+	}
+
+	switch (cmd) {
+	    case F_GETFL:
+		*retval = fh->mode_open;
+		return 0;
+	    case F_SETFL:
+		lock_acquire(fh->lock);
+		fh->mode_open &= ~(O_APPEND | O_NONBLOCK);
+		fh->mode_open |= arg & (O_APPEND | O_NONBLOCK);
+		pipe_setnonblock(fh->vnode, (arg & O_NONBLOCK) != 0);
+		lock_release(fh->lock);
+		*retval = 0;
+		return 0;
+	}
+	return EINVAL;
+}
+
+/*
+ * ioctl: the operation is up to the object. FIORESERVE changes the
+ * file, so it needs a handle open for writing.
+ */
+int sys_ioctl(int fd, int code, userptr_t data)
+{
+	struct file_handle *fh;
+	int err;
 
+	err = fd_lookup(fd, &fh);
+	if (err) {
+		return err;
+	}
+	if (code == FIORESERVE && (fh->mode_open & O_ACCMODE) == O_RDONLY) {
+		return EBADF;
+	}
+	return VOP_IOCTL(fh->vnode, code, data);
 }
 
-int sys_read(userptr_t buffer, int nbytes)
+/*
+ * splice: move data between a pipe and another file inside the
+ * kernel. The non-pipe side's seek position is used and advanced.
+ * Its handle's lock isn't held while we wait on the pipe, which
+ * could be forever; so, as with lseek racing a read, concurrent I/O
+ * through the same handle may see either offset.
+ */
+int sys_splice(int fromfd, int tofd, size_t len, int *retval)
 {
-	int i;
-	char localbuff[2];
-	
-	for(i=0; i<nbytes; i++){
-		kgets(localbuff, 1);
-		if(localbuff[0] == '\0')
-			return 1;
-		else
-			((char *)buffer)[i] = localbuff[0];
+	struct file_handle *from, *to, *fh;
+	off_t pos;
+	size_t moved;
+	int err;
+
+	err = fd_lookup(fromfd, &from);
+	if (err) {
+		return err;
+	}
+	err = fd_lookup(tofd, &to);
+	if (err) {
+		return err;
+	}
+	if ((from->mode_open & O_ACCMODE) == O_WRONLY ||
+	    (to->mode_open & O_ACCMODE) == O_RDONLY) {
+		return EBADF;
+	}
+
+	/* The file side, if it has a seek position. */
+	if (VOP_ISSEEKABLE(from->vnode)) {
+		fh = from;
+	}
+	else if (VOP_ISSEEKABLE(to->vnode)) {
+		fh = to;
+	}
+	else {
+		fh = NULL;
+	}
+
+	pos = 0;
+	if (fh != NULL) {
+		lock_acquire(fh->lock);
+		pos = fh->offset;
+		lock_release(fh->lock);
 	}
-	
+	err = pipe_splice(from->vnode, to->vnode, &pos, len, &moved);
+	if (fh != NULL && moved > 0) {
+		lock_acquire(fh->lock);
+		fh->offset = pos;
+		lock_release(fh->lock);
+	}
+	if (err) {
+		return err;
+	}
+	*retval = moved;
+	return 0;
+}
+
+/*
+ * poll. Each pass asks every descriptor's vnode whether it is ready
+ * (which also registers us with it); if none is, we sleep until one
+ * of them changes state or the timeout, in milliseconds, runs out.
+ * A negative timeout means forever and zero means don't wait.
+ */
+int sys_poll(userptr_t ufds, unsigned nfds, int timeout, int *retval)
+{
+	struct pollfd *fds;
+	struct file_handle *fh;
+	struct timespec deadline, delta;
+	unsigned gen, i;
+	int revents, nready, err;
+
+	if (nfds > OPEN_MAX) {
+		return EINVAL;
+	}
+
+	fds = kmalloc((nfds > 0 ? nfds : 1) * sizeof(*fds));
+	if (fds == NULL) {
+		return ENOMEM;
+	}
+	err = copyin(ufds, fds, nfds * sizeof(*fds));
+	if (err) {
+		kfree(fds);
+		return err;
+	}
+
+	if (timeout > 0) {
+		gettime(&deadline);
+		delta.tv_sec = timeout / 1000;
+		delta.tv_nsec = (timeout % 1000) * 1000000;
+		timespec_add(&deadline, &delta, &deadline);
+	}
+
+	while (1) {
+		gen = poll_generation();
+		nready = 0;
+		for (i = 0; i < nfds; i++) {
+			revents = 0;
+			if (fds[i].fd < 0) {
+				/* ignored */
+			}
+			else if (fd_lookup(fds[i].fd, &fh)) {
+				revents = POLLNVAL;
+			}
+			else {
+				err = VOP_POLL(fh->vnode, fds[i].events,
+					       &revents);
+				if (err) {
+					kfree(fds);
+					return err;
+				}
+			}
+			fds[i].revents = revents;
+			if (revents != 0) {
+				nready++;
+			}
+		}
+		if (nready > 0 || timeout == 0) {
+			break;
+		}
+		if (poll_sleep(gen, timeout > 0 ? &deadline : NULL)) {
+			/* timed out */
+			break;
+		}
+	}
+
+	err = copyout(fds, ufds, nfds * sizeof(*fds));
+	kfree(fds);
+	if (err) {
+		return err;
+	}
+	*retval = nready;
 	return 0;
-}
\ No newline at end of file
+}
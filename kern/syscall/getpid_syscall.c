@@ -2,9 +2,10 @@
 #include <syscall.h>
 #include <thread.h>
 #include <current.h>
+#include <proc.h>
 
 int sys_getpid(pid_t *retval){
 
-    *retval = curthread -> t_pid;
+    *retval = curproc->proc_id;
     return 0;
 }
\ No newline at end of file
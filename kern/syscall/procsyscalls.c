@@ -5,179 +5,660 @@
 #include <addrspace.h>
 #include <lib.h>
 #include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <spinlock.h>
+#include <vfs.h>
 #include <proc.h>
 #include <limits.h>
 #include <mips/trapframe.h>
 #include <vnode.h>
+#include <file.h>
 #include <synch.h>
 #include <copyinout.h>
 #include <kern/wait.h>
 
 
+/*
+ * Hand our children over to the kernel process, which never waits
+ * for anybody. Children that have already exited can be destroyed
+ * right away; the rest will be reaped by pid_alloc once they exit.
+ * Caller holds proctable_lock.
+ */
+static
+void
+proc_orphan_children(struct proc *parent)
+{
+	struct proc *child;
+	unsigned i;
+
+	for (i = 1; i < proctable_hiwater; i++) {
+		child = process_table[i];
+		if (child == NULL || child->parent_id != parent->proc_id) {
+			continue;
+		}
+		if (child->exit_status) {
+			proctable_remove(child);
+			proc_destroy(child);
+		}
+		else {
+			child->parent_id = kproc->proc_id;
+		}
+	}
+}
+
 void sys_exit(int exitcode)
 {
-    int i;
-    int j;
-// iterate through process table to check pid of the calling process 
-    for (i=1; i<PID_MAX ;i++){
-        if (process_table[i]!= NULL) {
-            if (process_table[i]->proc_id == curproc->proc_id)
-                break;
-            if (i== PID_MAX-1)
-                panic("Current process is not present in the process table");
-        }
-
-    }
-// abandon the children give to grandparent 
-    for (j=1; j<PID_MAX; j++){
-        if (process_table[j]!= NULL){
-            if (process_table[j]->parent_id == curproc->proc_id){
-            lock_acquire(process_table[j]->lock);
-            process_table[j]->parent_id = curproc->parent_id;
-            lock_release(process_table[j]->lock);
-        }
-        }
-    }
-    lock_acquire(curproc->lock);
-    curproc->exit_status=true;
-    curproc->exit_code = _MKWAIT_EXIT (exitcode);
-    KASSERT(curproc->exit_status == process_table[i]->exit_status);
-	KASSERT(curproc->exit_code == process_table[i]->exit_code);
-	cv_signal(curproc->cv, curproc->lock);
-	lock_release(curproc->lock);
+	struct proc *proc = curproc;
+	struct proc *parent;
+	struct addrspace *as;
+
+	/* The address space is no use to a zombie; give it back now. */
+	as = proc_setas(NULL);
+	as_deactivate();
+	as_destroy(as);
+
+	/* Close files now, so e.g. pipe readers see EOF promptly. */
+	filetable_closeall(proc);
+
+	lock_acquire(proctable_lock);
+	proc_orphan_children(proc);
+
+	proc->exit_code = _MKWAIT_EXIT(exitcode);
+	proc->exit_status = true;
+
+	/*
+	 * Move ourselves into the kernel process before telling the
+	 * parent, so that once it sees exit_status it can destroy the
+	 * proc without waiting for us to get through thread_exit.
+	 */
+	proc_remthread(curthread);
+	proc_addthread(kproc, curthread);
+
+	parent = proc_lookup(proc->parent_id);
+	if (parent != NULL) {
+		cv_broadcast(parent->cv, proctable_lock);
+	}
+	lock_release(proctable_lock);
+
 	thread_exit();
 }
 
 
 
 
-int sys_fork(struct trapframe *tf, int* retval)
+int sys_fork(struct trapframe *tf, pid_t *retval)
 {
-	struct thread* new_thread;
-	struct addrspace* child_addrspace;
+	struct proc *newproc;
+	struct trapframe *child_tf;
 	int err;
 
-	//start by copying the address  space (virtual memory space of the process) from the parent
-	err = as_copy(curthread->t_addrspace, &child_addrspace);
-	if(err)
-	{
-		*retval = -1;
+	err = proc_create_fork(&newproc);
+	if (err) {
 		return err;
 	}
 
-	//create a new trapframe in the kernel space and signal if there is not enough memory
-	struct trapframe *child_tf = (struct trapframe*)kmalloc(sizeof(struct trapframe));
+	//start by copying the address  space (virtual memory space of the process) from the parent
+	err = as_copy(proc_getas(), &newproc->p_addrspace);
+	if (err) {
+		goto fail;
+	}
 
+	//the trapframe lives on our kernel stack; the child needs its own copy
+	child_tf = kmalloc(sizeof(*child_tf));
+	if (child_tf == NULL) {
+		err = ENOMEM;
+		goto fail;
+	}
 	*child_tf = *tf;
-	if(child_tf == NULL)
-	{
+
+	err = thread_fork(curthread->t_name, newproc, enter_forked_process,
+			  child_tf, 0);
+	if (err) {
+		kfree(child_tf);
+		goto fail;
+	}
+
+	//return value in case of parent: child pid
+	*retval = newproc->proc_id;
+	return 0;
+
+ fail:
+	lock_acquire(proctable_lock);
+	proctable_remove(newproc);
+	lock_release(proctable_lock);
+	proc_destroy(newproc);
+	return err;
+}
+
+/*
+ * Buffers for execv. Each holds the program path and the argument
+ * block, laid out exactly as it will appear on the new user stack.
+ *
+ * Execs take a buffer from the free list (or allocate one if the
+ * list is empty) and put it back when done, so they never wait for
+ * each other. Buffers are never freed; the list only grows to the
+ * largest number of execs that have been in progress at once.
+ */
+struct argbuf {
+	struct argbuf *ab_next;
+	char ab_path[PATH_MAX];
+	char ab_data[ARG_MAX];
+};
+
+/* How many argv pointers to copy in at once. */
+#define ARGV_CHUNK  16
+
+static struct spinlock argbuf_lock = SPINLOCK_INITIALIZER;
+static struct argbuf *argbuf_freelist;
+
+static
+struct argbuf *
+argbuf_get(void)
+{
+	struct argbuf *ab;
+
+	spinlock_acquire(&argbuf_lock);
+	ab = argbuf_freelist;
+	if (ab != NULL) {
+		argbuf_freelist = ab->ab_next;
+	}
+	spinlock_release(&argbuf_lock);
+
+	if (ab == NULL) {
+		ab = kmalloc(sizeof(*ab));
+	}
+	return ab;
+}
+
+static
+void
+argbuf_put(struct argbuf *ab)
+{
+	spinlock_acquire(&argbuf_lock);
+	ab->ab_next = argbuf_freelist;
+	argbuf_freelist = ab;
+	spinlock_release(&argbuf_lock);
+}
+
+/*
+ * Copy the argv array at UARGV into AB->ab_data: first the pointers,
+ * which become the new argv array, then each string, packed right
+ * after the array. Each string is copied once, with copyinstr,
+ * straight into its final place. On return the pointers hold the
+ * strings' offsets within ab_data; *ARGCRET gets the count and
+ * *LENRET the total number of bytes used.
+ */
+static
+int
+execv_copyargs(userptr_t uargv, struct argbuf *ab, int *argcret,
+	       size_t *lenret)
+{
+	userptr_t *ptrs = (userptr_t *)ab->ab_data;
+	const size_t maxptrs = ARG_MAX / sizeof(userptr_t);
+	size_t argc, chunk, i, off, len;
+	vaddr_t uaddr;
+	int result;
+
+	if ((vaddr_t)uargv % sizeof(userptr_t) != 0) {
+		return EFAULT;
+	}
+
+	/*
+	 * The pointers go in a few at a time, without crossing a page
+	 * boundary, so that we don't fault on a page past the end of
+	 * the array.
+	 */
+	argc = 0;
+	while (1) {
+		uaddr = (vaddr_t)uargv + argc * sizeof(userptr_t);
+		chunk = (PAGE_SIZE - uaddr % PAGE_SIZE) / sizeof(userptr_t);
+		if (chunk > ARGV_CHUNK) {
+			chunk = ARGV_CHUNK;
+		}
+		if (chunk > maxptrs - argc) {
+			chunk = maxptrs - argc;
+		}
+		if (chunk == 0) {
+			return E2BIG;
+		}
+		result = copyin((const_userptr_t)uaddr, &ptrs[argc],
+				chunk * sizeof(userptr_t));
+		if (result) {
+			return result;
+		}
+		for (i = argc; i < argc + chunk; i++) {
+			if (ptrs[i] == NULL) {
+				break;
+			}
+		}
+		if (i < argc + chunk) {
+			argc = i;
+			break;
+		}
+		argc += chunk;
+	}
+
+	off = (argc + 1) * sizeof(userptr_t);
+	for (i = 0; i < argc; i++) {
+		if (off >= ARG_MAX) {
+			return E2BIG;
+		}
+		result = copyinstr(ptrs[i], ab->ab_data + off, ARG_MAX - off,
+				   &len);
+		if (result == ENAMETOOLONG) {
+			return E2BIG;
+		}
+		if (result) {
+			return result;
+		}
+		ptrs[i] = (userptr_t)off;
+		off += len;
+	}
+	ptrs[argc] = NULL;
+
+	*argcret = argc;
+	*lenret = off;
+	return 0;
+}
+
+/*
+ * First half of execv and spawn: copy in the program path and the
+ * arguments (see execv_copyargs), and open the program. The name to
+ * give the process comes back in *NAMERET.
+ */
+static
+int
+exec_prepare(userptr_t prog, userptr_t args, struct argbuf *ab, int *argcret,
+	     size_t *lenret, struct vnode **vret, char **nameret)
+{
+	char *name;
+	int result;
+
+	result = copyinstr(prog, ab->ab_path, PATH_MAX, NULL);
+	if (result) {
+		return result;
+	}
+	if (ab->ab_path[0] == 0) {
+		return EINVAL;
+	}
+	result = execv_copyargs(args, ab, argcret, lenret);
+	if (result) {
+		return result;
+	}
+
+	/* vfs_open may destroy the path, so take the name first */
+	name = kstrdup(ab->ab_path);
+	if (name == NULL) {
 		return ENOMEM;
 	}
+	result = vfs_open(ab->ab_path, O_RDONLY, 0, vret);
+	if (result) {
+		kfree(name);
+		return result;
+	}
+	*nameret = name;
+	return 0;
+}
 
-	//call thread_fork, to create a new thread based on an existing one, entrypoint is the func in which he starts to execute
-	err = thread_fork("new thread", child_entrypoint, child_tf, child_addrspace, &new_thread);
+/*
+ * Second half: make a new address space, install it in the current
+ * process, and load the program V into it. Then put the argument
+ * block from AB at the top of the stack, turning the offsets into
+ * user addresses; the whole block goes out in one copy.
+ *
+ * On success the new address space is left installed and the old
+ * one is handed back in *OLDASRET. On failure the old one is put
+ * back.
+ */
+static
+int
+exec_load(struct vnode *v, struct argbuf *ab, int argc, size_t len,
+	  struct addrspace **oldasret, vaddr_t *entryret, vaddr_t *argbaseret)
+{
+	struct addrspace *newas, *oldas;
+	vaddr_t entrypoint, stackptr, argbase;
+	userptr_t *ptrs;
+	size_t total;
+	int i, result;
 
-	if(err)
-	{
-		kfree(child_tf);
-		as_destroy(child_addrspace);
-		*retval = -1;
-		return err;
+	newas = as_create();
+	if (newas == NULL) {
+		return ENOMEM;
 	}
+	oldas = proc_setas(newas);
+	as_activate();
 
+	result = load_elf(v, &entrypoint);
+	if (result) {
+		goto fail;
+	}
+	result = as_define_stack(newas, &stackptr);
+	if (result) {
+		goto fail;
+	}
 
-	//return value in case of parent: child pid
-	*retval = new_thread->pid; 
+	total = ROUNDUP(len, 8);
+	argbase = stackptr - total;
+	ptrs = (userptr_t *)ab->ab_data;
+	for (i = 0; i < argc; i++) {
+		ptrs[i] = (userptr_t)(argbase + (vaddr_t)ptrs[i]);
+	}
+	result = copyout(ab->ab_data, (userptr_t)argbase, total);
+	if (result) {
+		goto fail;
+	}
+
+	*oldasret = oldas;
+	*entryret = entrypoint;
+	*argbaseret = argbase;
 	return 0;
+
+ fail:
+	proc_setas(oldas);
+	as_activate();
+	as_destroy(newas);
+	return result;
 }
 
-//entry point for the child process
-void child_entrypoint(void* data1, long data2) //i don t know why this values
+int
+sys_execv(userptr_t prog, userptr_t args)
 {
-	//take the new trapframe from input
-	struct trapframe tf;
-	tf = (struct trapframe*) data1;
+	struct argbuf *ab;
+	struct addrspace *oldas;
+	struct vnode *v;
+	vaddr_t entrypoint, argbase;
+	size_t len;
+	char *name, *swap;
+	int argc, result;
 
-	//load and activate child address space
-	curthread->t_addrspace = (struct addrspace*) data2;
-	as_activate(curthread->t_addrspace);
+	ab = argbuf_get();
+	if (ab == NULL) {
+		return ENOMEM;
+	}
 
+	result = exec_prepare(prog, args, ab, &argc, &len, &v, &name);
+	if (result) {
+		argbuf_put(ab);
+		return result;
+	}
+	result = exec_load(v, ab, argc, len, &oldas, &entrypoint, &argbase);
+	vfs_close(v);
+	argbuf_put(ab);
+	if (result) {
+		/* Still in the old image; the caller gets the error. */
+		kfree(name);
+		return result;
+	}
 
-	//modify child trapframe in order to signal a success for child
-	tf.tf_a3 = 0; //explain here why those values
-	tf.tf_v0 = 0; 
-	tf.tf_epc += 4; //to avoid to recall the same syscall more times
+	/* No going back now. */
+	as_destroy(oldas);
 
-	//finish, now we can return to user mode
-	mips_usermode(&tf);
+	spinlock_acquire(&curproc->p_lock);
+	swap = curproc->p_name;
+	curproc->p_name = name;
+	spinlock_release(&curproc->p_lock);
+	kfree(swap);
 
+	enter_new_process(argc, (userptr_t)argbase, NULL /*env*/,
+			  argbase, entrypoint);
 
+	/* enter_new_process does not return. */
+	panic("enter_new_process returned\n");
+	return EINVAL;
 }
 
+/*
+ * Where a spawned child starts. Everything was set up by the parent;
+ * all that's left is to switch to the child's address space and go.
+ */
+struct spawn_start {
+	vaddr_t ss_entrypoint;
+	vaddr_t ss_argbase;
+	int ss_argc;
+};
 
+static
+void
+spawn_enter(void *data, unsigned long junk)
+{
+	struct spawn_start *ss = data;
+	struct spawn_start start;
+
+	(void)junk;
+
+	start = *ss;
+	kfree(ss);
+
+	as_activate();
+	enter_new_process(start.ss_argc, (userptr_t)start.ss_argbase,
+			  NULL /*env*/, start.ss_argbase, start.ss_entrypoint);
+}
+
+/*
+ * spawn: start PROG with arguments ARGS in a new child process, as
+ * fork followed by execv in the child would, but without copying our
+ * address space first. The parent loads the program into a fresh
+ * address space itself (the same way execv does), swaps its own back
+ * in, and hands the new one to the child. The child inherits open
+ * files, the current directory and the process group as with fork.
+ *
+ * Errors in loading the program are returned to the caller, and no
+ * child is created.
+ */
+int
+sys_spawn(userptr_t prog, userptr_t args, pid_t *retval)
+{
+	struct argbuf *ab;
+	struct addrspace *oldas, *newas;
+	struct spawn_start *ss;
+	struct proc *newproc;
+	struct vnode *v;
+	size_t len;
+	char *name;
+	int result;
 
-int sys_waitpid (pid_t pid, int *status, int options, pid_t * retval) {
-    int err = 0;
-    int i;
+	ss = kmalloc(sizeof(*ss));
+	if (ss == NULL) {
+		return ENOMEM;
+	}
+	ab = argbuf_get();
+	if (ab == NULL) {
+		kfree(ss);
+		return ENOMEM;
+	}
+
+	result = exec_prepare(prog, args, ab, &ss->ss_argc, &len, &v, &name);
+	if (result) {
+		argbuf_put(ab);
+		kfree(ss);
+		return result;
+	}
+	result = exec_load(v, ab, ss->ss_argc, len, &oldas,
+			   &ss->ss_entrypoint, &ss->ss_argbase);
+	vfs_close(v);
+	argbuf_put(ab);
+	if (result) {
+		kfree(name);
+		kfree(ss);
+		return result;
+	}
+	newas = proc_setas(oldas);
+	as_activate();
+
+	result = proc_create_fork(&newproc);
+	if (result) {
+		as_destroy(newas);
+		kfree(name);
+		kfree(ss);
+		return result;
+	}
+	newproc->p_addrspace = newas;
+	kfree(newproc->p_name);
+	newproc->p_name = name;
+
+	result = thread_fork(name, newproc, spawn_enter, ss, 0);
+	if (result) {
+		kfree(ss);
+		lock_acquire(proctable_lock);
+		proctable_remove(newproc);
+		lock_release(proctable_lock);
+		proc_destroy(newproc);
+		return result;
+	}
+
+	*retval = newproc->proc_id;
+	return 0;
+}
+
+/*
+ * Does CHILD match the pid argument of waitpid? Positive values name
+ * a single process, WAIT_ANY matches every child, WAIT_MYPGRP the
+ * children in our own process group, and other negative values the
+ * children in process group -PID.
+ */
+static
+bool
+wait_matches(struct proc *child, pid_t pid)
+{
+	if (child->parent_id != curproc->proc_id) {
+		return false;
+	}
+	if (pid > 0) {
+		return child->proc_id == pid;
+	}
+	if (pid == WAIT_ANY) {
+		return true;
+	}
+	if (pid == WAIT_MYPGRP) {
+		return child->p_pgid == curproc->p_pgid;
+	}
+	return child->p_pgid == -pid;
+}
+
+/*
+ * Common code for waitpid and wait4.
+ *
+ * All the children of a process sleep on the same channel (the
+ * parent's cv), so waiting for "any child" costs one scan of the
+ * process table per wakeup rather than one sleep per child.
+ */
+static
+int
+proc_wait(pid_t pid, userptr_t status, int options, userptr_t rusage,
+	  pid_t *retval)
+{
+	struct proc *child;
+	bool found;
+	unsigned i;
+	int err;
+
+	if (options & ~(WNOHANG | WUNTRACED)) {
+		return EINVAL;
+	}
+	if (pid > 0 && pid == curproc->proc_id) {
+		return ECHILD;
+	}
+
+	lock_acquire(proctable_lock);
+
+	if (pid > 0) {
+		child = proc_lookup(pid);
+		if (child == NULL) {
+			lock_release(proctable_lock);
+			return ESRCH;
+		}
+		if (child->parent_id != curproc->proc_id) {
+			lock_release(proctable_lock);
+			return ECHILD;
+		}
+	}
+
+	while (1) {
+		found = false;
+		child = NULL;
+		for (i = 1; i < proctable_hiwater; i++) {
+			if (process_table[i] == NULL ||
+			    !wait_matches(process_table[i], pid)) {
+				continue;
+			}
+			found = true;
+			if (process_table[i]->exit_status) {
+				child = process_table[i];
+				break;
+			}
+		}
+		if (child != NULL) {
+			break;
+		}
+		if (!found) {
+			lock_release(proctable_lock);
+			return ECHILD;
+		}
+		if (options & WNOHANG) {
+			lock_release(proctable_lock);
+			*retval = 0;
+			return 0;
+		}
+		cv_wait(curproc->cv, proctable_lock);
+	}
+
+	/*
+	 * Copy the results out before reaping, so that if the user
+	 * pointers are bad the child's status is not lost.
+	 */
+	if (status != NULL) {
+		err = copyout(&child->exit_code, status,
+			      sizeof(child->exit_code));
+		if (err) {
+			lock_release(proctable_lock);
+			return err;
+		}
+	}
+	if (rusage != NULL) {
+		err = copyout(&child->p_rusage, rusage,
+			      sizeof(child->p_rusage));
+		if (err) {
+			lock_release(proctable_lock);
+			return err;
+		}
+	}
+
+	proctable_remove(child);
+	lock_release(proctable_lock);
+
+	rusage_add(&curproc->p_cusage, &child->p_rusage);
+	rusage_add(&curproc->p_cusage, &child->p_cusage);
+
+	*retval = child->proc_id;
+	proc_destroy(child);
+	return 0;
+}
+
+int sys_waitpid (pid_t pid, int *status, int options, pid_t * retval)
+{
+	return proc_wait(pid, (userptr_t)status, options, NULL, retval);
+}
+
+int sys_wait4 (pid_t pid, int *status, int options, userptr_t rusage,
+	       pid_t *retval)
+{
+	return proc_wait(pid, (userptr_t)status, options, rusage, retval);
+}
+
+int sys_getrusage(int who, userptr_t usage)
+{
+	struct rusage ru;
 
-    if (curproc->proc_id == pid){
-        return ECHILD;
-    }
-    if(options != 0){
+	switch (who) {
+	    case RUSAGE_SELF:
+		proc_getrusage(curproc, &ru);
+		break;
+	    case RUSAGE_CHILDREN:
+		/* Only we update this, so no lock is needed. */
+		ru = curproc->p_cusage;
+		break;
+	    default:
 		return EINVAL;
 	}
-    // check if process with pid exits
-    for (i=1;i<PID_MAX;i++){
-        if (process_table[i] != NULL){
-            if (process_table[i]->proc_id == pid){
-                break;
-            }
-        }
-        if (i==PID_MAX-1)
-        return ESRCH;
-    }
-    // check if process with pid  exits
-    KASSERT (process_table[i]!= NULL);
-    // check if it is the parent process
-    if (process_table[i]->parent_id != curproc->proc_id){
-        return ECHILD;
-    } 
-
-    lock_acquire(process_table[i]->lock);
-    // verify if the state is already exit 
-    
-    if (process_table[i]->exit_status){
-        if (status != NULL){
-            err = copyout(&process_table[i]->exit_code,(userptr_t) status, sizeof(process_table[i]->exit_code));
-            if (err){
-                lock_release(process_table[i]->lock);
-                proc_destroy(process_table[i]);
-                process_table[i]=NULL;
-                return err;
-            }
-        }
-        lock_release(process_table[i]->lock);
-        *retval=process_table[i]->proc_id;
-        proc_destroy(process_table[i]);
-        process_table[i]=NULL;
-        return 0;        
-    } else {
-            // if the process has not exited yet we are here
-        cv_wait(process_table[i]->cv,process_table[i]->lock);
-        if (status != NULL){
-        err = copyout(&process_table[i]->exit_code,(userptr_t) status, sizeof(process_table[i]->exit_code));
-            if (err){
-                lock_release(process_table[i]->lock);
-                proc_destroy(process_table[i]);
-                process_table[i]=NULL;
-                return err;
-            }
-        }
-        lock_release(process_table[i]->lock);
-        *retval=process_table[i]->proc_id;
-        proc_destroy(process_table[i]);
-        process_table[i]=NULL;
-        return 0;    
-    }
-    
+	return copyout(&ru, usage, sizeof(ru));
 }
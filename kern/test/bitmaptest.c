@@ -39,7 +39,7 @@ bitmaptest(int nargs, char **args)
 {
 	struct bitmap *b;
 	char data[TESTSIZE];
-	uint32_t x;
+	uint32_t x, goal, j;
 	int i;
 
 	(void)nargs;
@@ -101,6 +101,33 @@ bitmaptest(int nargs, char **args)
 		KASSERT(data[i]==0);
 	}
 
+	/*
+	 * bitmap_alloc_near should give the first clear bit at or after
+	 * the goal, wrapping around.
+	 */
+	for (i=0; i<TESTSIZE; i++) {
+		if (random()%2) {
+			bitmap_unmark(b, i);
+			data[i] = 1;
+		}
+	}
+	for (;;) {
+		goal = random() % TESTSIZE;
+		for (j=0; j<TESTSIZE; j++) {
+			if (data[(goal+j) % TESTSIZE]) {
+				break;
+			}
+		}
+		if (j == TESTSIZE) {
+			KASSERT(bitmap_alloc_near(b, goal, &x)!=0);
+			break;
+		}
+		KASSERT(bitmap_alloc_near(b, goal, &x)==0);
+		KASSERT(x == (goal+j) % TESTSIZE);
+		KASSERT(bitmap_isset(b, x));
+		data[x] = 0;
+	}
+
 	kprintf("Bitmap test complete\n");
 	return 0;
 }
@@ -0,0 +1,276 @@
+/*
+ * Microbenchmarks for memcpy/memmove and the user/kernel copy
+ * routines (copyin, copyout, copyinstr).
+ *
+ * The user-side buffers live in a scratch address space that we
+ * install in the current process for the duration of the test, so
+ * this must be run from the menu, not from a user process.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <copyinout.h>
+#include <test.h>
+
+#define BENCHSIZE	(4 * PAGE_SIZE)	/* bytes per block copy */
+#define BENCHVADDR	0x400000	/* where the user buffer goes */
+#define DEFLOOPS	200		/* default repetitions */
+
+static char *kbuf1, *kbuf2;
+static userptr_t ubuf;
+
+/*
+ * Print one result line: LOOPS operations of LEN bytes each took
+ * from BEFORE to now.
+ */
+static
+void
+report(const char *what, unsigned loops, size_t len,
+       const struct timespec *before)
+{
+	struct timespec after;
+	uint64_t ns, bytes;
+
+	gettime(&after);
+	timespec_sub(&after, before, &after);
+	ns = (uint64_t)after.tv_sec * 1000000000 + after.tv_nsec;
+	if (ns == 0) {
+		ns = 1;
+	}
+	bytes = (uint64_t)loops * len;
+
+	kprintf("%-24s %6lu bytes: %8llu ns/op, %6llu KB/s\n",
+		what, (unsigned long)len,
+		(unsigned long long)(ns / loops),
+		(unsigned long long)(bytes * 1000000000 / 1024 / ns));
+}
+
+static
+void
+bench_memcpy(unsigned loops, unsigned dstoff, unsigned srcoff, size_t len)
+{
+	struct timespec before;
+	char name[32];
+	unsigned i;
+
+	snprintf(name, sizeof(name), "memcpy +%u/+%u", dstoff, srcoff);
+	gettime(&before);
+	for (i=0; i<loops; i++) {
+		memcpy(kbuf1 + dstoff, kbuf2 + srcoff, len);
+	}
+	report(name, loops, len, &before);
+	for (i=0; i<len; i++) {
+		KASSERT(kbuf1[dstoff + i] == kbuf2[srcoff + i]);
+	}
+}
+
+static
+void
+bench_memmove(unsigned loops, unsigned shift, size_t len)
+{
+	struct timespec before;
+	char name[32];
+	unsigned i;
+
+	snprintf(name, sizeof(name), "memmove up %u", shift);
+	gettime(&before);
+	for (i=0; i<loops; i++) {
+		memmove(kbuf1 + shift, kbuf1, len);
+	}
+	report(name, loops, len, &before);
+}
+
+static
+void
+bench_copyin(unsigned loops, unsigned off, size_t len)
+{
+	struct timespec before;
+	char name[32];
+	unsigned i;
+	int result;
+
+	snprintf(name, sizeof(name), "copyin +%u", off);
+	gettime(&before);
+	for (i=0; i<loops; i++) {
+		result = copyin(ubuf + off, kbuf1, len);
+		KASSERT(result == 0);
+	}
+	report(name, loops, len, &before);
+}
+
+static
+void
+bench_copyout(unsigned loops, unsigned off, size_t len)
+{
+	struct timespec before;
+	char name[32];
+	unsigned i;
+	int result;
+
+	snprintf(name, sizeof(name), "copyout +%u", off);
+	gettime(&before);
+	for (i=0; i<loops; i++) {
+		result = copyout(kbuf2, ubuf + off, len);
+		KASSERT(result == 0);
+	}
+	report(name, loops, len, &before);
+}
+
+/*
+ * Put a string of length LEN (not counting the terminator) at offset
+ * OFF in the user buffer and time copying it in.
+ */
+static
+void
+bench_copyinstr(unsigned loops, unsigned off, size_t len)
+{
+	struct timespec before;
+	char name[32];
+	unsigned i;
+	size_t got;
+	int result;
+
+	KASSERT(off + len < BENCHSIZE);
+	memset(kbuf2, 'x', len);
+	kbuf2[len] = 0;
+	result = copyout(kbuf2, ubuf + off, len + 1);
+	KASSERT(result == 0);
+
+	snprintf(name, sizeof(name), "copyinstr +%u", off);
+	gettime(&before);
+	for (i=0; i<loops; i++) {
+		result = copyinstr(ubuf + off, kbuf1, BENCHSIZE, &got);
+		KASSERT(result == 0);
+	}
+	report(name, loops, len + 1, &before);
+	KASSERT(got == len + 1);
+	KASSERT(strcmp(kbuf1, kbuf2) == 0);
+
+	/* Too long for the buffer must still be caught. */
+	result = copyinstr(ubuf + off, kbuf1, len, &got);
+	KASSERT(result == ENAMETOOLONG);
+}
+
+/*
+ * Set up the scratch address space and install it in the current
+ * process. The one that was there before is handed back in OLDAS.
+ */
+static
+int
+copytest_setup(struct addrspace **oldas)
+{
+	struct addrspace *as;
+	vaddr_t stackptr;
+	int result;
+
+	as = as_create();
+	if (as == NULL) {
+		return ENOMEM;
+	}
+	result = as_define_region(as, BENCHVADDR, BENCHSIZE, 1, 1, 0);
+	if (result == 0) {
+		result = as_define_region(as, BENCHVADDR + BENCHSIZE,
+					  PAGE_SIZE, 1, 1, 0);
+	}
+	if (result == 0) {
+		result = as_prepare_load(as);
+	}
+	if (result == 0) {
+		result = as_complete_load(as);
+	}
+	if (result == 0) {
+		result = as_define_stack(as, &stackptr);
+	}
+	if (result) {
+		as_destroy(as);
+		return result;
+	}
+
+	*oldas = proc_setas(as);
+	as_activate();
+	ubuf = (userptr_t)BENCHVADDR;
+	return 0;
+}
+
+static
+void
+copytest_cleanup(struct addrspace *oldas)
+{
+	struct addrspace *as;
+
+	as = proc_setas(oldas);
+	as_activate();
+	as_destroy(as);
+}
+
+int
+copybench(int nargs, char **args)
+{
+	static const size_t sizes[] = { 16, 256, BENCHSIZE };
+	struct addrspace *oldas;
+	unsigned loops, i;
+	size_t len;
+	int result;
+
+	loops = DEFLOOPS;
+	if (nargs > 1) {
+		loops = atoi(args[1]);
+	}
+	if (loops == 0) {
+		kprintf("Usage: cpb [loops]\n");
+		return EINVAL;
+	}
+
+	/* Leave room to offset the copies by a few bytes. */
+	kbuf1 = kmalloc(BENCHSIZE + 16);
+	kbuf2 = kmalloc(BENCHSIZE + 16);
+	if (kbuf1 == NULL || kbuf2 == NULL) {
+		kfree(kbuf1);
+		kfree(kbuf2);
+		return ENOMEM;
+	}
+	for (i=0; i<BENCHSIZE + 16; i++) {
+		kbuf2[i] = random();
+	}
+
+	result = copytest_setup(&oldas);
+	if (result) {
+		kfree(kbuf1);
+		kfree(kbuf2);
+		return result;
+	}
+
+	kprintf("Starting copy benchmarks (%u loops)...\n", loops);
+	for (i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++) {
+		len = sizes[i];
+		bench_memcpy(loops, 0, 0, len);
+		bench_memcpy(loops, 0, 1, len);
+		bench_memcpy(loops, 3, 1, len);
+		bench_memmove(loops, 4, len);
+		bench_memmove(loops, 3, len);
+		bench_copyout(loops, 0, len);
+		bench_copyin(loops, 0, len);
+		bench_copyin(loops, 1, len);
+	}
+	bench_copyinstr(loops, 0, 15);
+	bench_copyinstr(loops, 1, 63);
+	bench_copyinstr(loops, 0, 1023);
+	bench_copyinstr(loops, 3, 1023);
+
+	/* A string running off the end of the region faults. */
+	memset(kbuf2, 'y', PAGE_SIZE);
+	result = copyout(kbuf2, ubuf + BENCHSIZE, PAGE_SIZE);
+	KASSERT(result == 0);
+	result = copyinstr(ubuf + BENCHSIZE + 5, kbuf1, BENCHSIZE, NULL);
+	KASSERT(result == EFAULT);
+
+	copytest_cleanup(oldas);
+	kfree(kbuf1);
+	kfree(kbuf2);
+	kprintf("Copy benchmarks done.\n");
+	return 0;
+}
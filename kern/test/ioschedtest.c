@@ -0,0 +1,237 @@
+/*
+ * Disk scheduler benchmark.
+ *
+ * Runs the same concurrent read workloads against the raw device
+ * under each scheduling policy and reports throughput and request
+ * latency. Only reads, so it's safe to point at a disk with a
+ * filesystem on it, but results are cleaner on an idle one.
+ *
+ * Usage: iosb [disk [threads]]      (default lhd1, 4 threads)
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <clock.h>
+#include <synch.h>
+#include <thread.h>
+#include <uio.h>
+#include <stat.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <iosched.h>
+#include <test.h>
+
+#define IOSB_BLOCK	512
+#define IOSB_SEQSIZE	4096	/* bytes per sequential read */
+#define IOSB_NREQS	64	/* reads per thread */
+#define IOSB_MAXTHREADS	16
+
+struct iosb_thread {
+	struct vnode *it_vn;
+	off_t it_base;		/* start of this thread's region */
+	off_t it_span;		/* its size */
+	bool it_seq;		/* sequential or random */
+	uint64_t it_bytes;
+	uint64_t it_totns;	/* total and worst latency */
+	uint64_t it_maxns;
+	int it_result;
+};
+
+static struct semaphore *iosb_done;
+
+static
+uint64_t
+iosb_ns(const struct timespec *ts)
+{
+	return (uint64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static
+void
+iosb_thread(void *vit, unsigned long junk)
+{
+	struct iosb_thread *it = vit;
+	struct timespec before, after;
+	struct iovec iov;
+	struct uio ku;
+	char *buf;
+	size_t len;
+	off_t pos;
+	uint64_t ns;
+	unsigned i;
+	int result;
+
+	(void)junk;
+
+	len = it->it_seq ? IOSB_SEQSIZE : IOSB_BLOCK;
+	buf = kmalloc(len);
+	if (buf == NULL) {
+		it->it_result = ENOMEM;
+		V(iosb_done);
+		return;
+	}
+
+	for (i=0; i<IOSB_NREQS; i++) {
+		if (it->it_seq) {
+			pos = it->it_base + ((off_t)i * len) % it->it_span;
+		}
+		else {
+			pos = it->it_base + IOSB_BLOCK *
+				(random() % (it->it_span / IOSB_BLOCK));
+		}
+
+		uio_kinit(&iov, &ku, buf, len, pos, UIO_READ);
+		gettime(&before);
+		result = VOP_READ(it->it_vn, &ku);
+		gettime(&after);
+		if (result) {
+			it->it_result = result;
+			break;
+		}
+
+		timespec_sub(&after, &before, &after);
+		ns = iosb_ns(&after);
+		it->it_bytes += len;
+		it->it_totns += ns;
+		if (ns > it->it_maxns) {
+			it->it_maxns = ns;
+		}
+	}
+
+	kfree(buf);
+	V(iosb_done);
+}
+
+/*
+ * Run one workload with NTHREADS threads and print a result line.
+ * Sequential threads each stream through their own slice of the
+ * disk; random ones read single blocks from anywhere.
+ */
+static
+int
+iosb_run(struct vnode *vn, off_t disksize, const char *policy, bool seq,
+	 unsigned nthreads)
+{
+	struct iosb_thread its[IOSB_MAXTHREADS];
+	struct timespec before, after;
+	uint64_t bytes, totns, maxns, ns;
+	unsigned i, nreqs;
+	int result;
+
+	gettime(&before);
+	for (i=0; i<nthreads; i++) {
+		its[i].it_vn = vn;
+		its[i].it_seq = seq;
+		its[i].it_span = seq ? disksize / nthreads : disksize;
+		its[i].it_span -= its[i].it_span % IOSB_SEQSIZE;
+		its[i].it_base = seq ? its[i].it_span * i : 0;
+		its[i].it_bytes = its[i].it_totns = its[i].it_maxns = 0;
+		its[i].it_result = 0;
+		result = thread_fork("iosb", NULL, iosb_thread, &its[i], 0);
+		if (result) {
+			panic("iosb: thread_fork: %s\n", strerror(result));
+		}
+	}
+	for (i=0; i<nthreads; i++) {
+		P(iosb_done);
+	}
+	gettime(&after);
+	timespec_sub(&after, &before, &after);
+	ns = iosb_ns(&after);
+
+	bytes = totns = maxns = 0;
+	for (i=0; i<nthreads; i++) {
+		if (its[i].it_result) {
+			return its[i].it_result;
+		}
+		bytes += its[i].it_bytes;
+		totns += its[i].it_totns;
+		if (its[i].it_maxns > maxns) {
+			maxns = its[i].it_maxns;
+		}
+	}
+	nreqs = nthreads * IOSB_NREQS;
+
+	kprintf("%-8s %-4s %7llu KB/s  latency avg %6llu us  max %6llu us\n",
+		policy, seq ? "seq" : "rand",
+		(unsigned long long)(bytes * 1000000000 / 1024 / (ns ? ns : 1)),
+		(unsigned long long)(totns / nreqs / 1000),
+		(unsigned long long)(maxns / 1000));
+	return 0;
+}
+
+int
+ioschedbench(int nargs, char **args)
+{
+	const char *disk = "lhd1";
+	unsigned nthreads = 4;
+	char path[32];
+	struct vnode *vn;
+	struct stat st;
+	int policy, result;
+
+	if (nargs > 1) {
+		disk = args[1];
+	}
+	if (nargs > 2) {
+		nthreads = atoi(args[2]);
+	}
+	if (nargs > 3 || nthreads == 0 || nthreads > IOSB_MAXTHREADS) {
+		kprintf("Usage: iosb [disk [threads]]\n");
+		return EINVAL;
+	}
+
+	snprintf(path, sizeof(path), "%sraw:", disk);
+	result = vfs_open(path, O_RDONLY, 0, &vn);
+	if (result) {
+		kprintf("iosb: %s: %s\n", disk, strerror(result));
+		return result;
+	}
+	result = VOP_STAT(vn, &st);
+	if (result) {
+		vfs_close(vn);
+		return result;
+	}
+
+	/* Each sequential thread needs at least one whole run to itself. */
+	if (st.st_size / nthreads < IOSB_SEQSIZE) {
+		kprintf("iosb: %s is too small for %u threads\n",
+			disk, nthreads);
+		vfs_close(vn);
+		return EINVAL;
+	}
+
+	iosb_done = sem_create("iosb", 0);
+	if (iosb_done == NULL) {
+		vfs_close(vn);
+		return ENOMEM;
+	}
+
+	kprintf("Disk scheduler benchmark: %s, %u threads, "
+		"%u reads each\n", disk, nthreads, IOSB_NREQS);
+	for (policy=0; policy<IOSCHED_NPOLICIES && result==0; policy++) {
+		result = iosched_setpolicy(disk, iosched_policyname(policy));
+		if (result == 0) {
+			result = iosb_run(vn, st.st_size,
+					  iosched_policyname(policy),
+					  true, nthreads);
+		}
+		if (result == 0) {
+			result = iosb_run(vn, st.st_size,
+					  iosched_policyname(policy),
+					  false, nthreads);
+		}
+	}
+	if (result) {
+		kprintf("iosb: %s\n", strerror(result));
+	}
+
+	/* Put the default back. */
+	iosched_setpolicy(disk, iosched_policyname(IOSCHED_CLOOK));
+
+	sem_destroy(iosb_done);
+	vfs_close(vn);
+	return result;
+}
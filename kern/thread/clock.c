@@ -28,10 +28,14 @@
  */
 
 #include <types.h>
+#include <kern/timepage.h>
 #include <lib.h>
 #include <cpu.h>
+#include <membar.h>
+#include <vm.h>
 #include <wchan.h>
 #include <clock.h>
+#include <poll.h>
 #include <thread.h>
 #include <current.h>
 
@@ -72,6 +76,48 @@ hardclock_bootstrap(void)
 	}
 }
 
+/*
+ * The time page, which user processes read the time from. Only CPU 0
+ * writes it, so the writer side of the sequence count needs no lock.
+ */
+static struct timepage *timepage;
+
+void
+timepage_bootstrap(void)
+{
+	vaddr_t va;
+
+	va = alloc_kpages(1);
+	if (va == 0) {
+		panic("timepage_bootstrap: Out of memory\n");
+	}
+	bzero((void *)va, PAGE_SIZE);
+	timepage = (struct timepage *)va;
+}
+
+vaddr_t
+timepage_kvaddr(void)
+{
+	KASSERT(timepage != NULL);
+	return (vaddr_t)timepage;
+}
+
+static
+void
+timepage_update(void)
+{
+	struct timespec ts;
+
+	gettime(&ts);
+
+	timepage->tp_seq++;
+	membar_store_store();
+	timepage->tp_sec = ts.tv_sec;
+	timepage->tp_nsec = ts.tv_nsec;
+	membar_store_store();
+	timepage->tp_seq++;
+}
+
 /*
  * This is called once per second, on one processor, by the timer
  * code.
@@ -94,7 +140,23 @@ hardclock(void)
 {
 	/*
 	 * Collect statistics here as desired.
+	 *
+	 * Charge the tick to whatever thread we interrupted, unless
+	 * we were idle, in which case that thread is asleep.
 	 */
+	if (!curcpu->c_isidle) {
+		if (curthread->t_intr_user) {
+			curthread->t_usage.tu_uticks++;
+		}
+		else {
+			curthread->t_usage.tu_sticks++;
+		}
+	}
+
+	if (curcpu->c_number == 0 && timepage != NULL) {
+		timepage_update();
+	}
+	pollclock();
 
 	curcpu->c_hardclocks++;
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
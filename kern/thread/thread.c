@@ -144,10 +144,12 @@ thread_create(const char *name)
 
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
+	thread->t_intr_user = false;
 	thread->t_curspl = IPL_HIGH;
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
 	/* If you add to struct thread, be sure to initialize here */
+	bzero(&thread->t_usage, sizeof(thread->t_usage));
 
 	return thread;
 }
@@ -599,9 +601,17 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	    case S_RUN:
 		panic("Illegal S_RUN in thread_switch\n");
 	    case S_READY:
+		/* Preempted from the timer interrupt, or yielded? */
+		if (cur->t_in_interrupt) {
+			cur->t_usage.tu_nivcsw++;
+		}
+		else {
+			cur->t_usage.tu_nvcsw++;
+		}
 		thread_make_runnable(cur, true /*have lock*/);
 		break;
 	    case S_SLEEP:
+		cur->t_usage.tu_nvcsw++;
 		cur->t_wchan_name = wc->wc_name;
 		/*
 		 * Add the thread to the list in the wait channel, and
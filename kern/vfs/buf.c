@@ -0,0 +1,798 @@
+/*
+ * Block buffer cache. See buf.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <uio.h>
+#include <thread.h>
+#include <current.h>
+#include <device.h>
+#include <buf.h>
+
+#define BUF_MAXBUFS	128	/* most buffers we'll allocate */
+#define BUF_HASHSIZE	64	/* buckets in the lookup table */
+#define BUF_MAXRUN	32	/* most blocks in one device transfer */
+#define BUF_RAQUEUE	64	/* pending read-ahead requests */
+#define BUF_RARUNS	4	/* read-ahead transfers in flight */
+
+struct buf {
+	struct device *b_dev;		/* NULL if not assigned */
+	daddr_t b_block;
+	void *b_data;
+	unsigned b_refcount;		/* holder plus waiters */
+	bool b_busy;			/* somebody holds it */
+	bool b_valid;			/* data is good */
+	bool b_dirty;			/* data needs writing back */
+	struct buf *b_hashnext;
+	struct buf *b_lrunext;		/* only while b_refcount is 0 */
+	struct buf *b_lruprev;
+};
+
+/*
+ * buf_lock protects everything here except the contents of held
+ * buffers. Threads waiting for a buffer to be released, or for any
+ * buffer to become free, sleep on buf_wchan.
+ */
+static struct spinlock buf_lock;
+static struct wchan *buf_wchan;
+
+static struct buf *buf_hash[BUF_HASHSIZE];
+static struct buf *buf_lruhead, *buf_lrutail;	/* oldest at head */
+static struct buf *buf_all[BUF_MAXBUFS];
+static unsigned buf_count;
+
+/*
+ * Read-ahead requests, waiting for the read-ahead thread, which
+ * sleeps on buf_rawchan. Also protected by buf_lock.
+ */
+static struct {
+	struct device *ra_dev;
+	daddr_t ra_block;
+} buf_raq[BUF_RAQUEUE];
+static unsigned buf_raqhead, buf_raqcount;
+static struct wchan *buf_rawchan;
+
+/*
+ * The device the read-ahead thread is collecting a run for, between
+ * taking a request off the queue and starting the transfer (after
+ * which it holds the buffers). buf_detach waits for this to change.
+ */
+static struct device *buf_radev;
+
+/*
+ * A read-ahead transfer in flight. These come from a fixed pool; the
+ * read-ahead thread also waits on buf_rawchan for one to be free.
+ */
+struct buf_rarun {
+	struct devreq rr_req;
+	struct uio rr_uio;
+	struct iovec rr_iov[BUF_MAXRUN];
+	struct buf *rr_bufs[BUF_MAXRUN];
+	unsigned rr_n;
+	struct buf_rarun *rr_next;	/* on the free list */
+};
+static struct buf_rarun buf_raruns[BUF_RARUNS];
+static struct buf_rarun *buf_rarunfree;
+
+////////////////////////////////////////////////////////////
+// Lookup table and LRU list
+
+static
+unsigned
+buf_hashfn(struct device *dev, daddr_t block)
+{
+	return ((uintptr_t)dev / sizeof(void *) + block) % BUF_HASHSIZE;
+}
+
+static
+struct buf *
+buf_lookup(struct device *dev, daddr_t block)
+{
+	struct buf *b;
+
+	for (b = buf_hash[buf_hashfn(dev, block)]; b != NULL;
+	     b = b->b_hashnext) {
+		if (b->b_dev == dev && b->b_block == block) {
+			return b;
+		}
+	}
+	return NULL;
+}
+
+static
+void
+buf_hashinsert(struct buf *b)
+{
+	unsigned h = buf_hashfn(b->b_dev, b->b_block);
+
+	b->b_hashnext = buf_hash[h];
+	buf_hash[h] = b;
+}
+
+static
+void
+buf_hashremove(struct buf *b)
+{
+	struct buf **pb;
+
+	pb = &buf_hash[buf_hashfn(b->b_dev, b->b_block)];
+	while (*pb != b) {
+		KASSERT(*pb != NULL);
+		pb = &(*pb)->b_hashnext;
+	}
+	*pb = b->b_hashnext;
+	b->b_hashnext = NULL;
+}
+
+/* Put B on the LRU list, at the old end if ATHEAD. */
+static
+void
+buf_lruinsert(struct buf *b, bool athead)
+{
+	if (athead) {
+		b->b_lruprev = NULL;
+		b->b_lrunext = buf_lruhead;
+		if (buf_lruhead != NULL) {
+			buf_lruhead->b_lruprev = b;
+		}
+		else {
+			buf_lrutail = b;
+		}
+		buf_lruhead = b;
+	}
+	else {
+		b->b_lrunext = NULL;
+		b->b_lruprev = buf_lrutail;
+		if (buf_lrutail != NULL) {
+			buf_lrutail->b_lrunext = b;
+		}
+		else {
+			buf_lruhead = b;
+		}
+		buf_lrutail = b;
+	}
+}
+
+static
+void
+buf_lruremove(struct buf *b)
+{
+	if (b->b_lruprev != NULL) {
+		b->b_lruprev->b_lrunext = b->b_lrunext;
+	}
+	else {
+		buf_lruhead = b->b_lrunext;
+	}
+	if (b->b_lrunext != NULL) {
+		b->b_lrunext->b_lruprev = b->b_lruprev;
+	}
+	else {
+		buf_lrutail = b->b_lruprev;
+	}
+	b->b_lrunext = b->b_lruprev = NULL;
+}
+
+/*
+ * Take hold of B, waiting for the current holder if there is one.
+ * Called with buf_lock held.
+ */
+static
+void
+buf_hold(struct buf *b)
+{
+	if (b->b_refcount == 0) {
+		buf_lruremove(b);
+	}
+	b->b_refcount++;
+	while (b->b_busy) {
+		wchan_sleep(buf_wchan, &buf_lock);
+	}
+	b->b_busy = true;
+}
+
+/*
+ * Let go of B. Called with buf_lock held.
+ */
+static
+void
+buf_unhold(struct buf *b)
+{
+	KASSERT(b->b_busy);
+	KASSERT(b->b_refcount > 0);
+
+	b->b_busy = false;
+	b->b_refcount--;
+	if (b->b_refcount == 0) {
+		buf_lruinsert(b, !b->b_valid);
+	}
+	wchan_wakeall(buf_wchan, &buf_lock);
+}
+
+////////////////////////////////////////////////////////////
+// Device I/O
+
+/*
+ * Set up KU, with IOV, to transfer N held buffers for consecutive
+ * blocks.
+ */
+static
+void
+buf_setupuio(struct buf **bufs, unsigned n, struct iovec *iov,
+	     struct uio *ku, enum uio_rw rw)
+{
+	unsigned i;
+
+	KASSERT(n > 0 && n <= BUF_MAXRUN);
+	for (i=0; i<n; i++) {
+		KASSERT(bufs[i]->b_busy);
+		KASSERT(bufs[i]->b_dev == bufs[0]->b_dev);
+		KASSERT(bufs[i]->b_block == bufs[0]->b_block + i);
+		iov[i].iov_kbase = bufs[i]->b_data;
+		iov[i].iov_len = BUF_SIZE;
+	}
+	ku->uio_iov = iov;
+	ku->uio_iovcnt = n;
+	ku->uio_offset = (off_t)bufs[0]->b_block * BUF_SIZE;
+	ku->uio_resid = n * BUF_SIZE;
+	ku->uio_segflg = UIO_SYSSPACE;
+	ku->uio_rw = rw;
+	ku->uio_space = NULL;
+}
+
+/*
+ * Read or write N held buffers for consecutive blocks in one device
+ * transfer, retrying I/O errors.
+ */
+static
+int
+buf_devio(struct buf **bufs, unsigned n, enum uio_rw rw)
+{
+	struct iovec iov[BUF_MAXRUN];
+	struct uio ku;
+	daddr_t block = bufs[0]->b_block;
+	int result;
+	int tries = 0;
+
+	if (rw == UIO_READ) {
+		curthread->t_usage.tu_inblock += n;
+	}
+	else {
+		curthread->t_usage.tu_oublock += n;
+	}
+
+ retry:
+	buf_setupuio(bufs, n, iov, &ku, rw);
+	result = DEVOP_IO(bufs[0]->b_dev, &ku);
+	if (result == EINVAL) {
+		/*
+		 * The block was out of range or something else that's
+		 * the caller's fault.
+		 */
+		panic("buf: block %u: DEVOP_IO returned EINVAL\n", block);
+	}
+	if (result == EIO) {
+		if (tries == 0) {
+			kprintf("buf: block %u I/O error, retrying\n", block);
+		}
+		if (tries < 10) {
+			tries++;
+			goto retry;
+		}
+		kprintf("buf: block %u I/O error, giving up after %d "
+			"retries\n", block, tries);
+	}
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// Getting buffers
+
+static
+struct buf *
+buf_create(void)
+{
+	struct buf *b;
+
+	b = kmalloc(sizeof(*b));
+	if (b == NULL) {
+		return NULL;
+	}
+	b->b_data = kmalloc(BUF_SIZE);
+	if (b->b_data == NULL) {
+		kfree(b);
+		return NULL;
+	}
+	b->b_dev = NULL;
+	b->b_block = 0;
+	b->b_refcount = 0;
+	b->b_busy = false;
+	b->b_valid = false;
+	b->b_dirty = false;
+	b->b_hashnext = NULL;
+	b->b_lrunext = b->b_lruprev = NULL;
+	return b;
+}
+
+/*
+ * Try to add a new buffer to the pool. Called with buf_lock held,
+ * but releases it while allocating. Returns false if the pool is
+ * full or there's no memory.
+ */
+static
+bool
+buf_grow(void)
+{
+	struct buf *b;
+
+	if (buf_count >= BUF_MAXBUFS) {
+		return false;
+	}
+	spinlock_release(&buf_lock);
+	b = buf_create();
+	spinlock_acquire(&buf_lock);
+	if (b == NULL) {
+		return false;
+	}
+	if (buf_count >= BUF_MAXBUFS) {
+		/* Somebody else filled it up while we were allocating. */
+		spinlock_release(&buf_lock);
+		kfree(b->b_data);
+		kfree(b);
+		spinlock_acquire(&buf_lock);
+		return false;
+	}
+	buf_all[buf_count++] = b;
+	buf_lruinsert(b, true);
+	return true;
+}
+
+/*
+ * Get the buffer for BLOCK of DEV, held, without reading it.
+ */
+int
+buf_get(struct device *dev, daddr_t block, struct buf **ret)
+{
+	struct buf *b;
+	int result;
+
+	KASSERT(dev->d_blocksize == BUF_SIZE);
+
+	spinlock_acquire(&buf_lock);
+	while (1) {
+		b = buf_lookup(dev, block);
+		if (b != NULL) {
+			buf_hold(b);
+			break;
+		}
+
+		/*
+		 * Not cached. Recycle the least recently used buffer,
+		 * first adding new ones while we're under the limit.
+		 * Any of these steps may sleep, after which somebody
+		 * else may have loaded the block, so start over.
+		 */
+		if (buf_lruhead == NULL || buf_lruhead->b_valid) {
+			if (buf_grow()) {
+				continue;
+			}
+		}
+		b = buf_lruhead;
+		if (b == NULL) {
+			/* Everything's held; wait for a release. */
+			wchan_sleep(buf_wchan, &buf_lock);
+			continue;
+		}
+		if (b->b_dirty) {
+			/* Write it back first. */
+			buf_hold(b);
+			spinlock_release(&buf_lock);
+			result = buf_devio(&b, 1, UIO_WRITE);
+			spinlock_acquire(&buf_lock);
+			if (result == 0) {
+				b->b_dirty = false;
+			}
+			buf_unhold(b);
+			if (result) {
+				spinlock_release(&buf_lock);
+				return result;
+			}
+			if (b->b_refcount == 0) {
+				/* Still the oldest; keep it next in line. */
+				buf_lruremove(b);
+				buf_lruinsert(b, true);
+			}
+			continue;
+		}
+
+		/* Take it over. */
+		buf_lruremove(b);
+		if (b->b_dev != NULL) {
+			buf_hashremove(b);
+		}
+		b->b_dev = dev;
+		b->b_block = block;
+		b->b_valid = false;
+		b->b_refcount = 1;
+		b->b_busy = true;
+		buf_hashinsert(b);
+		break;
+	}
+	spinlock_release(&buf_lock);
+
+	*ret = b;
+	return 0;
+}
+
+/*
+ * Get the buffer for BLOCK of DEV, held, with its contents.
+ */
+int
+buf_read(struct device *dev, daddr_t block, struct buf **ret)
+{
+	struct buf *b;
+	int result;
+
+	result = buf_get(dev, block, &b);
+	if (result) {
+		return result;
+	}
+	if (!b->b_valid) {
+		result = buf_devio(&b, 1, UIO_READ);
+		if (result) {
+			buf_release(b);
+			return result;
+		}
+		b->b_valid = true;
+	}
+	*ret = b;
+	return 0;
+}
+
+void *
+buf_data(struct buf *b)
+{
+	KASSERT(b->b_busy);
+	return b->b_data;
+}
+
+bool
+buf_valid(struct buf *b)
+{
+	KASSERT(b->b_busy);
+	return b->b_valid;
+}
+
+void
+buf_markdirty(struct buf *b)
+{
+	KASSERT(b->b_busy);
+	b->b_valid = true;
+	b->b_dirty = true;
+}
+
+void
+buf_release(struct buf *b)
+{
+	spinlock_acquire(&buf_lock);
+	buf_unhold(b);
+	spinlock_release(&buf_lock);
+}
+
+void
+buf_discard(struct device *dev, daddr_t block)
+{
+	struct buf *b;
+
+	spinlock_acquire(&buf_lock);
+	b = buf_lookup(dev, block);
+	if (b != NULL && b->b_refcount == 0) {
+		buf_hashremove(b);
+		b->b_dev = NULL;
+		b->b_valid = false;
+		b->b_dirty = false;
+		/* Reuse it first. */
+		buf_lruremove(b);
+		buf_lruinsert(b, true);
+	}
+	spinlock_release(&buf_lock);
+}
+
+////////////////////////////////////////////////////////////
+// Read-ahead
+
+/*
+ * Drop queued read-ahead requests for DEV. Called with buf_lock held.
+ */
+static
+void
+buf_raqpurge(struct device *dev)
+{
+	unsigned i, j, n;
+
+	n = 0;
+	for (i = 0; i < buf_raqcount; i++) {
+		j = (buf_raqhead + i) % BUF_RAQUEUE;
+		if (buf_raq[j].ra_dev != dev) {
+			buf_raq[(buf_raqhead + n) % BUF_RAQUEUE] = buf_raq[j];
+			n++;
+		}
+	}
+	buf_raqcount = n;
+}
+
+void
+buf_prefetch(struct device *dev, daddr_t block)
+{
+	unsigned i, j;
+
+	KASSERT(dev->d_blocksize == BUF_SIZE);
+
+	spinlock_acquire(&buf_lock);
+	if (buf_lookup(dev, block) != NULL || buf_raqcount == BUF_RAQUEUE) {
+		/* Already have it, or too much queued already. */
+		spinlock_release(&buf_lock);
+		return;
+	}
+	for (i = 0; i < buf_raqcount; i++) {
+		j = (buf_raqhead + i) % BUF_RAQUEUE;
+		if (buf_raq[j].ra_dev == dev && buf_raq[j].ra_block == block) {
+			spinlock_release(&buf_lock);
+			return;
+		}
+	}
+	j = (buf_raqhead + buf_raqcount) % BUF_RAQUEUE;
+	buf_raq[j].ra_dev = dev;
+	buf_raq[j].ra_block = block;
+	buf_raqcount++;
+	wchan_wakeone(buf_rawchan, &buf_lock);
+	spinlock_release(&buf_lock);
+}
+
+/*
+ * Take the next read-ahead request off the queue if it's for block
+ * BLOCK of DEV, so runs of consecutive blocks can be read together.
+ * Called with buf_lock held.
+ */
+static
+bool
+buf_raqnext(struct device *dev, daddr_t block)
+{
+	if (buf_raqcount > 0 &&
+	    buf_raq[buf_raqhead].ra_dev == dev &&
+	    buf_raq[buf_raqhead].ra_block == block) {
+		buf_raqhead = (buf_raqhead + 1) % BUF_RAQUEUE;
+		buf_raqcount--;
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Completion callback for a read-ahead transfer. May be called from
+ * the disk's interrupt handler. Read-ahead is only a hint, so on
+ * error the buffers are just let go without being marked valid.
+ */
+static
+void
+buf_radone(struct devreq *dr, int result)
+{
+	struct buf_rarun *rr = dr->dr_data;
+	unsigned i;
+
+	spinlock_acquire(&buf_lock);
+	for (i = 0; i < rr->rr_n; i++) {
+		if (result == 0) {
+			rr->rr_bufs[i]->b_valid = true;
+		}
+		buf_unhold(rr->rr_bufs[i]);
+	}
+	rr->rr_next = buf_rarunfree;
+	buf_rarunfree = rr;
+	wchan_wakeone(buf_rawchan, &buf_lock);
+	spinlock_release(&buf_lock);
+}
+
+/*
+ * The read-ahead thread. Takes requests off the queue, collects runs
+ * of consecutive blocks that aren't cached yet, and starts each run
+ * as one asynchronous transfer, without waiting for it. Anyone who
+ * wants one of the blocks in the meantime waits for the buffer like
+ * for any other holder.
+ */
+static
+void
+buf_rathread(void *junk1, unsigned long junk2)
+{
+	struct buf_rarun *rr;
+	struct device *dev;
+	daddr_t block;
+	unsigned n;
+	int result;
+
+	(void)junk1;
+	(void)junk2;
+
+	spinlock_acquire(&buf_lock);
+	while (1) {
+		while (buf_raqcount == 0 || buf_rarunfree == NULL) {
+			wchan_sleep(buf_rawchan, &buf_lock);
+		}
+		rr = buf_rarunfree;
+		buf_rarunfree = rr->rr_next;
+		dev = buf_raq[buf_raqhead].ra_dev;
+		block = buf_raq[buf_raqhead].ra_block;
+		buf_raqhead = (buf_raqhead + 1) % BUF_RAQUEUE;
+		buf_raqcount--;
+		buf_radev = dev;
+		spinlock_release(&buf_lock);
+
+		n = 0;
+		while (1) {
+			result = buf_get(dev, block + n, &rr->rr_bufs[n]);
+			if (result) {
+				break;
+			}
+			if (rr->rr_bufs[n]->b_valid) {
+				/* Somebody got here first; the run ends. */
+				buf_release(rr->rr_bufs[n]);
+				break;
+			}
+			n++;
+			if (n == BUF_MAXRUN) {
+				break;
+			}
+			spinlock_acquire(&buf_lock);
+			if (!buf_raqnext(dev, block + n)) {
+				spinlock_release(&buf_lock);
+				break;
+			}
+			spinlock_release(&buf_lock);
+		}
+
+		if (n > 0) {
+			curthread->t_usage.tu_inblock += n;
+			rr->rr_n = n;
+			buf_setupuio(rr->rr_bufs, n, rr->rr_iov, &rr->rr_uio,
+				     UIO_READ);
+			rr->rr_req.dr_uio = &rr->rr_uio;
+			rr->rr_req.dr_done = buf_radone;
+			rr->rr_req.dr_data = rr;
+			result = dev_ioasync(dev, &rr->rr_req);
+			if (result) {
+				buf_radone(&rr->rr_req, result);
+			}
+			spinlock_acquire(&buf_lock);
+		}
+		else {
+			spinlock_acquire(&buf_lock);
+			rr->rr_next = buf_rarunfree;
+			buf_rarunfree = rr;
+		}
+		buf_radev = NULL;
+		wchan_wakeall(buf_wchan, &buf_lock);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// Write-back
+
+/*
+ * Write back the dirty buffers of DEV in increasing block order, so
+ * the disk head makes one pass.
+ */
+int
+buf_sync(struct device *dev)
+{
+	struct buf *b, *next;
+	daddr_t last;
+	bool first;
+	unsigned i;
+	int result;
+
+	spinlock_acquire(&buf_lock);
+	first = true;
+	last = 0;
+	while (1) {
+		/* Find the lowest dirty block after the last one we did. */
+		next = NULL;
+		for (i = 0; i < buf_count; i++) {
+			b = buf_all[i];
+			if (b->b_dev != dev || !b->b_dirty) {
+				continue;
+			}
+			if (!first && b->b_block <= last) {
+				continue;
+			}
+			if (next == NULL || b->b_block < next->b_block) {
+				next = b;
+			}
+		}
+		if (next == NULL) {
+			break;
+		}
+		first = false;
+		last = next->b_block;
+
+		buf_hold(next);
+		if (next->b_dirty) {
+			spinlock_release(&buf_lock);
+			result = buf_devio(&next, 1, UIO_WRITE);
+			spinlock_acquire(&buf_lock);
+			if (result) {
+				buf_unhold(next);
+				spinlock_release(&buf_lock);
+				return result;
+			}
+			next->b_dirty = false;
+		}
+		buf_unhold(next);
+	}
+	spinlock_release(&buf_lock);
+	return 0;
+}
+
+int
+buf_detach(struct device *dev)
+{
+	struct buf *b;
+	unsigned i;
+	int result;
+
+	result = buf_sync(dev);
+	if (result) {
+		return result;
+	}
+
+	spinlock_acquire(&buf_lock);
+	buf_raqpurge(dev);
+	while (buf_radev == dev) {
+		/* The read-ahead thread is still starting a run for it. */
+		wchan_sleep(buf_wchan, &buf_lock);
+	}
+ again:
+	for (i = 0; i < buf_count; i++) {
+		b = buf_all[i];
+		if (b->b_dev != dev) {
+			continue;
+		}
+		if (b->b_refcount > 0) {
+			/* Only the read-ahead thread should have one. */
+			wchan_sleep(buf_wchan, &buf_lock);
+			goto again;
+		}
+		KASSERT(!b->b_dirty);
+		buf_hashremove(b);
+		b->b_dev = NULL;
+		b->b_valid = false;
+		buf_lruremove(b);
+		buf_lruinsert(b, true);
+	}
+	spinlock_release(&buf_lock);
+	return 0;
+}
+
+void
+buf_bootstrap(void)
+{
+	unsigned i;
+	int result;
+
+	spinlock_init(&buf_lock);
+	buf_wchan = wchan_create("buf");
+	buf_rawchan = wchan_create("bufra");
+	if (buf_wchan == NULL || buf_rawchan == NULL) {
+		panic("buf_bootstrap: Out of memory\n");
+	}
+	for (i = 0; i < BUF_RARUNS; i++) {
+		buf_raruns[i].rr_next = buf_rarunfree;
+		buf_rarunfree = &buf_raruns[i];
+	}
+	result = thread_fork("bufra", NULL, buf_rathread, NULL, 0);
+	if (result) {
+		panic("buf_bootstrap: thread_fork: %s\n", strerror(result));
+	}
+}
@@ -150,6 +150,40 @@ dev_ioctl(struct vnode *v, int op, userptr_t data)
 	return DEVOP_IOCTL(d, op, data);
 }
 
+/*
+ * Called for poll(). Devices that never block needn't supply
+ * devop_poll.
+ */
+static
+int
+dev_poll(struct vnode *v, int events, int *revents)
+{
+	struct device *d = v->vn_data;
+
+	if (d->d_ops->devop_poll == NULL) {
+		return vopgeneric_poll(v, events, revents);
+	}
+	return DEVOP_POLL(d, events, revents);
+}
+
+/*
+ * Start an asynchronous transfer; see device.h.
+ */
+int
+dev_ioasync(struct device *d, struct devreq *dr)
+{
+	int result;
+
+	KASSERT(dr->dr_uio->uio_segflg == UIO_SYSSPACE);
+
+	if (d->d_ops->devop_ioasync == NULL) {
+		result = DEVOP_IO(d, dr->dr_uio);
+		dr->dr_done(dr, result);
+		return 0;
+	}
+	return DEVOP_IOASYNC(d, dr);
+}
+
 /*
  * Called for stat().
  * Set the type and the size (block devices only).
@@ -332,6 +366,7 @@ static const struct vnode_ops dev_vnode_ops = {
 	.vop_getdirentry = vopfail_uio_notdir,
 	.vop_write = dev_write,
 	.vop_ioctl = dev_ioctl,
+	.vop_poll = dev_poll,
 	.vop_stat = dev_stat,
 	.vop_gettype = dev_gettype,
 	.vop_isseekable = dev_isseekable,
@@ -0,0 +1,300 @@
+/*
+ * Disk request scheduler. See iosched.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <uio.h>
+#include <device.h>
+#include <iosched.h>
+
+#define IOSCHED_MAXDEVS	8	/* size of the registry */
+
+struct iosched {
+	char *ios_name;
+	int ios_policy;
+	struct devreq *ios_head;	/* groups, in order of arrival */
+	struct devreq *ios_tail;
+};
+
+static const char *const iosched_names[IOSCHED_NPOLICIES] = {
+	[IOSCHED_FIFO] = "fifo",
+	[IOSCHED_CLOOK] = "clook",
+	[IOSCHED_DEADLINE] = "deadline",
+};
+
+static struct spinlock iosched_reglock = SPINLOCK_INITIALIZER;
+static struct iosched *iosched_reg[IOSCHED_MAXDEVS];
+
+/* Current time in nanoseconds. */
+static
+uint64_t
+iosched_now(void)
+{
+	struct timespec ts;
+
+	gettime(&ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+struct iosched *
+iosched_create(const char *name)
+{
+	struct iosched *ios;
+	unsigned i;
+
+	ios = kmalloc(sizeof(*ios));
+	if (ios == NULL) {
+		return NULL;
+	}
+	ios->ios_name = kstrdup(name);
+	if (ios->ios_name == NULL) {
+		kfree(ios);
+		return NULL;
+	}
+	ios->ios_policy = IOSCHED_CLOOK;
+	ios->ios_head = ios->ios_tail = NULL;
+
+	spinlock_acquire(&iosched_reglock);
+	for (i=0; i<IOSCHED_MAXDEVS; i++) {
+		if (iosched_reg[i] == NULL) {
+			iosched_reg[i] = ios;
+			break;
+		}
+	}
+	spinlock_release(&iosched_reglock);
+	/* If the registry is full it just can't be found by name. */
+
+	return ios;
+}
+
+void
+iosched_destroy(struct iosched *ios)
+{
+	unsigned i;
+
+	KASSERT(ios->ios_head == NULL);
+
+	spinlock_acquire(&iosched_reglock);
+	for (i=0; i<IOSCHED_MAXDEVS; i++) {
+		if (iosched_reg[i] == ios) {
+			iosched_reg[i] = NULL;
+		}
+	}
+	spinlock_release(&iosched_reglock);
+
+	kfree(ios->ios_name);
+	kfree(ios);
+}
+
+/*
+ * Try to merge DR into a waiting group. Returns true if it did.
+ */
+static
+bool
+iosched_merge(struct iosched *ios, struct devreq *dr)
+{
+	struct devreq *g, *prev, *last;
+
+	prev = NULL;
+	for (g = ios->ios_head; g != NULL; prev = g, g = g->dr_next) {
+		if (g->dr_uio->uio_rw != dr->dr_uio->uio_rw) {
+			continue;
+		}
+		if ((g->dr_end - g->dr_pos) + (dr->dr_end - dr->dr_pos)
+		    > IOSCHED_MAXMERGE) {
+			continue;
+		}
+
+		if (g->dr_end == dr->dr_pos) {
+			/* Goes on the end of the group. */
+			for (last = g; last->dr_merged != NULL;
+			     last = last->dr_merged) {
+				/* nothing */
+			}
+			last->dr_merged = dr;
+			g->dr_end = dr->dr_end;
+			if (dr->dr_expire < g->dr_expire) {
+				g->dr_expire = dr->dr_expire;
+			}
+			return true;
+		}
+
+		if (dr->dr_end == g->dr_pos) {
+			/* Goes on the front; takes the group's place. */
+			dr->dr_merged = g;
+			dr->dr_end = g->dr_end;
+			if (g->dr_expire < dr->dr_expire) {
+				dr->dr_expire = g->dr_expire;
+			}
+			dr->dr_next = g->dr_next;
+			g->dr_next = NULL;
+			if (prev != NULL) {
+				prev->dr_next = dr;
+			}
+			else {
+				ios->ios_head = dr;
+			}
+			if (ios->ios_tail == g) {
+				ios->ios_tail = dr;
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+void
+iosched_add(struct iosched *ios, struct devreq *dr)
+{
+	struct uio *uio = dr->dr_uio;
+	unsigned expire;
+
+	expire = uio->uio_rw == UIO_READ ?
+		IOSCHED_READEXPIRE : IOSCHED_WRITEEXPIRE;
+
+	dr->dr_next = NULL;
+	dr->dr_merged = NULL;
+	dr->dr_pos = uio->uio_offset;
+	dr->dr_end = uio->uio_offset + uio->uio_resid;
+	dr->dr_expire = iosched_now() + (uint64_t)expire * 1000000;
+
+	if (iosched_merge(ios, dr)) {
+		return;
+	}
+
+	if (ios->ios_tail != NULL) {
+		ios->ios_tail->dr_next = dr;
+	}
+	else {
+		ios->ios_head = dr;
+	}
+	ios->ios_tail = dr;
+}
+
+/*
+ * Pick the next group under the clook policy.
+ */
+static
+struct devreq *
+iosched_clook(struct iosched *ios, off_t headpos)
+{
+	struct devreq *g, *ahead, *lowest;
+
+	ahead = lowest = NULL;
+	for (g = ios->ios_head; g != NULL; g = g->dr_next) {
+		if (g->dr_pos >= headpos &&
+		    (ahead == NULL || g->dr_pos < ahead->dr_pos)) {
+			ahead = g;
+		}
+		if (lowest == NULL || g->dr_pos < lowest->dr_pos) {
+			lowest = g;
+		}
+	}
+	return ahead != NULL ? ahead : lowest;
+}
+
+/*
+ * Pick the group that expires first, if it's expired.
+ */
+static
+struct devreq *
+iosched_expired(struct iosched *ios)
+{
+	struct devreq *g, *first;
+
+	first = NULL;
+	for (g = ios->ios_head; g != NULL; g = g->dr_next) {
+		if (first == NULL || g->dr_expire < first->dr_expire) {
+			first = g;
+		}
+	}
+	if (first != NULL && first->dr_expire <= iosched_now()) {
+		return first;
+	}
+	return NULL;
+}
+
+struct devreq *
+iosched_next(struct iosched *ios, off_t headpos)
+{
+	struct devreq *pick, *g, *prev;
+
+	if (ios->ios_head == NULL) {
+		return NULL;
+	}
+
+	switch (ios->ios_policy) {
+	    case IOSCHED_FIFO:
+		pick = ios->ios_head;
+		break;
+	    case IOSCHED_DEADLINE:
+		pick = iosched_expired(ios);
+		if (pick == NULL) {
+			pick = iosched_clook(ios, headpos);
+		}
+		break;
+	    default:
+		pick = iosched_clook(ios, headpos);
+		break;
+	}
+
+	/* Unlink it. */
+	prev = NULL;
+	for (g = ios->ios_head; g != pick; g = g->dr_next) {
+		prev = g;
+	}
+	if (prev != NULL) {
+		prev->dr_next = pick->dr_next;
+	}
+	else {
+		ios->ios_head = pick->dr_next;
+	}
+	if (ios->ios_tail == pick) {
+		ios->ios_tail = prev;
+	}
+	pick->dr_next = NULL;
+	return pick;
+}
+
+const char *
+iosched_policyname(int policy)
+{
+	KASSERT(policy >= 0 && policy < IOSCHED_NPOLICIES);
+	return iosched_names[policy];
+}
+
+int
+iosched_setpolicy(const char *name, const char *policy)
+{
+	unsigned i;
+	int p;
+
+	for (p=0; p<IOSCHED_NPOLICIES; p++) {
+		if (!strcmp(policy, iosched_names[p])) {
+			break;
+		}
+	}
+	if (p == IOSCHED_NPOLICIES) {
+		return EINVAL;
+	}
+
+	spinlock_acquire(&iosched_reglock);
+	for (i=0; i<IOSCHED_MAXDEVS; i++) {
+		if (iosched_reg[i] != NULL &&
+		    !strcmp(iosched_reg[i]->ios_name, name)) {
+			/*
+			 * A single word; the driver will see the new
+			 * value next time it picks a request.
+			 */
+			iosched_reg[i]->ios_policy = p;
+			spinlock_release(&iosched_reglock);
+			return 0;
+		}
+	}
+	spinlock_release(&iosched_reglock);
+	return ENOENT;
+}
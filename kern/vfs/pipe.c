@@ -0,0 +1,693 @@
+/*
+ * Pipes. See pipe.h.
+ *
+ * The buffer is a ring of PIPE_SIZE bytes protected by pi_lock.
+ * Readers and writers wait on separate cvs, and each side only
+ * signals the other when somebody is actually waiting, so a stream
+ * that never fills or drains the buffer does no wakeups at all.
+ * Data is moved with at most two uiomove calls per pass (one on each
+ * side of the wrap point).
+ *
+ * Ring buffers are a page each, which the VM system may not be able
+ * to give back, so they're recycled through a free list instead of
+ * being freed. The list only grows to the most pipes open at once.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <limits.h>
+#include <stat.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <uio.h>
+#include <synch.h>
+#include <vm.h>
+#include <vnode.h>
+#include <poll.h>
+#include <pipe.h>
+
+struct pipe {
+	struct lock *pi_lock;
+	struct cv *pi_readcv;		/* readers wait here for data */
+	struct cv *pi_writecv;		/* writers wait here for space */
+	char *pi_buf;
+	unsigned pi_head;		/* offset of the first byte */
+	unsigned pi_count;		/* bytes in the buffer */
+	unsigned pi_rwaiting;		/* number of sleeping readers */
+	unsigned pi_wwaiting;		/* number of sleeping writers */
+	bool pi_readopen;
+	bool pi_writeopen;
+	bool pi_rnonblock;
+	bool pi_wnonblock;
+	struct pollrec pi_poll;		/* pollers of either end */
+	struct vnode pi_readvn;
+	struct vnode pi_writevn;
+};
+
+/* A free ring buffer; the link lives in the buffer itself. */
+struct pipebuf {
+	struct pipebuf *pb_next;
+};
+
+static const struct vnode_ops pipe_readops;
+static const struct vnode_ops pipe_writeops;
+
+static struct spinlock pipebuf_lock = SPINLOCK_INITIALIZER;
+static struct pipebuf *pipebuf_freelist;
+
+static
+char *
+pipebuf_get(void)
+{
+	struct pipebuf *pb;
+
+	spinlock_acquire(&pipebuf_lock);
+	pb = pipebuf_freelist;
+	if (pb != NULL) {
+		pipebuf_freelist = pb->pb_next;
+	}
+	spinlock_release(&pipebuf_lock);
+
+	if (pb == NULL) {
+		return kmalloc(PIPE_SIZE);
+	}
+	return (char *)pb;
+}
+
+static
+void
+pipebuf_put(char *buf)
+{
+	struct pipebuf *pb = (struct pipebuf *)buf;
+
+	spinlock_acquire(&pipebuf_lock);
+	pb->pb_next = pipebuf_freelist;
+	pipebuf_freelist = pb;
+	spinlock_release(&pipebuf_lock);
+}
+
+static
+void
+pipe_destroy(struct pipe *p)
+{
+	pipebuf_put(p->pi_buf);
+	cv_destroy(p->pi_writecv);
+	cv_destroy(p->pi_readcv);
+	lock_destroy(p->pi_lock);
+	kfree(p);
+}
+
+////////////////////////////////////////////////////////////
+// vnode ops
+
+static
+int
+pipe_eachopen(struct vnode *vn, int openflags)
+{
+	(void)vn;
+	(void)openflags;
+	return 0;
+}
+
+/*
+ * Called when the last reference to one end goes away. Wake up
+ * anybody on the other side so they see EOF or EPIPE, and free the
+ * pipe once both ends are gone.
+ */
+static
+int
+pipe_reclaim(struct vnode *vn)
+{
+	struct pipe *p = vn->vn_data;
+	bool gone;
+
+	lock_acquire(p->pi_lock);
+	if (vn == &p->pi_readvn) {
+		p->pi_readopen = false;
+		cv_broadcast(p->pi_writecv, p->pi_lock);
+	}
+	else {
+		KASSERT(vn == &p->pi_writevn);
+		p->pi_writeopen = false;
+		cv_broadcast(p->pi_readcv, p->pi_lock);
+	}
+	poll_wakeup(&p->pi_poll);
+	vnode_cleanup(vn);
+	gone = !p->pi_readopen && !p->pi_writeopen;
+	lock_release(p->pi_lock);
+
+	if (gone) {
+		pipe_destroy(p);
+	}
+	return 0;
+}
+
+static
+int
+pipe_read(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *p = vn->vn_data;
+	size_t len;
+	int result = 0;
+
+	lock_acquire(p->pi_lock);
+	while (p->pi_count == 0) {
+		if (!p->pi_writeopen) {
+			/* EOF */
+			lock_release(p->pi_lock);
+			return 0;
+		}
+		if (p->pi_rnonblock) {
+			lock_release(p->pi_lock);
+			return EAGAIN;
+		}
+		p->pi_rwaiting++;
+		cv_wait(p->pi_readcv, p->pi_lock);
+		p->pi_rwaiting--;
+	}
+
+	while (uio->uio_resid > 0 && p->pi_count > 0) {
+		len = p->pi_count;
+		if (len > PIPE_SIZE - p->pi_head) {
+			len = PIPE_SIZE - p->pi_head;
+		}
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		result = uiomove(p->pi_buf + p->pi_head, len, uio);
+		if (result) {
+			break;
+		}
+		p->pi_head = (p->pi_head + len) % PIPE_SIZE;
+		p->pi_count -= len;
+	}
+	if (p->pi_count == 0) {
+		/* keep the next write contiguous */
+		p->pi_head = 0;
+	}
+
+	if (p->pi_wwaiting > 0) {
+		cv_broadcast(p->pi_writecv, p->pi_lock);
+	}
+	poll_wakeup(&p->pi_poll);
+	lock_release(p->pi_lock);
+	return result;
+}
+
+/*
+ * Write. A write of at most PIPE_BUF bytes waits until it can go in
+ * all at once; anything bigger is copied in as space appears and may
+ * be interleaved with other writers. If a non-blocking write or a
+ * write to a widowed pipe gets partway, the short count is returned
+ * rather than the error.
+ */
+static
+int
+pipe_write(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *p = vn->vn_data;
+	size_t origresid = uio->uio_resid;
+	size_t need, space, tail, len;
+	int result = 0;
+
+	need = uio->uio_resid <= PIPE_BUF ? uio->uio_resid : 1;
+
+	lock_acquire(p->pi_lock);
+	while (uio->uio_resid > 0) {
+		if (!p->pi_readopen) {
+			result = EPIPE;
+			break;
+		}
+		space = PIPE_SIZE - p->pi_count;
+		if (space < need) {
+			if (p->pi_wnonblock) {
+				result = EAGAIN;
+				break;
+			}
+			p->pi_wwaiting++;
+			cv_wait(p->pi_writecv, p->pi_lock);
+			p->pi_wwaiting--;
+			continue;
+		}
+
+		tail = (p->pi_head + p->pi_count) % PIPE_SIZE;
+		len = space;
+		if (len > PIPE_SIZE - tail) {
+			len = PIPE_SIZE - tail;
+		}
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		result = uiomove(p->pi_buf + tail, len, uio);
+		if (result) {
+			break;
+		}
+		p->pi_count += len;
+		need = 1;
+
+		if (p->pi_rwaiting > 0) {
+			cv_broadcast(p->pi_readcv, p->pi_lock);
+		}
+		poll_wakeup(&p->pi_poll);
+	}
+	lock_release(p->pi_lock);
+
+	if (uio->uio_resid < origresid && (result == EAGAIN || result == EPIPE)) {
+		result = 0;
+	}
+	return result;
+}
+
+/*
+ * Poll. The read end is readable when there's data, and reports
+ * POLLHUP once the writer is gone; the write end is writable when
+ * PIPE_BUF bytes would fit, and reports POLLERR once the reader is
+ * gone.
+ */
+static
+int
+pipe_poll(struct vnode *vn, int events, int *revents)
+{
+	struct pipe *p = vn->vn_data;
+
+	lock_acquire(p->pi_lock);
+	poll_record(&p->pi_poll);
+
+	*revents = 0;
+	if (vn == &p->pi_readvn) {
+		if (p->pi_count > 0) {
+			*revents |= events & (POLLIN | POLLRDNORM);
+		}
+		if (!p->pi_writeopen) {
+			*revents |= POLLHUP;
+		}
+	}
+	else {
+		if (!p->pi_readopen) {
+			*revents |= POLLERR;
+		}
+		else if (PIPE_SIZE - p->pi_count >= PIPE_BUF) {
+			*revents |= events & (POLLOUT | POLLWRNORM);
+		}
+	}
+	lock_release(p->pi_lock);
+	return 0;
+}
+
+/* Read on the write end or write on the read end. */
+static
+int
+pipe_badio(struct vnode *vn, struct uio *uio)
+{
+	(void)vn;
+	(void)uio;
+	return EBADF;
+}
+
+static
+int
+pipe_ioctl(struct vnode *vn, int op, userptr_t data)
+{
+	(void)vn;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+static
+int
+pipe_stat(struct vnode *vn, struct stat *buf)
+{
+	struct pipe *p = vn->vn_data;
+
+	bzero(buf, sizeof(*buf));
+
+	lock_acquire(p->pi_lock);
+	buf->st_size = p->pi_count;
+	lock_release(p->pi_lock);
+
+	buf->st_mode = S_IFIFO | 0600;
+	buf->st_nlink = 1;
+	buf->st_blksize = PIPE_SIZE;
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *vn, mode_t *ret)
+{
+	(void)vn;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+static
+bool
+pipe_isseekable(struct vnode *vn)
+{
+	(void)vn;
+	return false;
+}
+
+static
+int
+pipe_fsync(struct vnode *vn)
+{
+	(void)vn;
+	return EINVAL;
+}
+
+static
+int
+pipe_truncate(struct vnode *vn, off_t len)
+{
+	(void)vn;
+	(void)len;
+	return EINVAL;
+}
+
+static const struct vnode_ops pipe_readops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+
+	.vop_read = pipe_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = pipe_badio,
+	.vop_ioctl = pipe_ioctl,
+	.vop_poll = pipe_poll,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_perm,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+static const struct vnode_ops pipe_writeops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+
+	.vop_read = pipe_badio,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = pipe_write,
+	.vop_ioctl = pipe_ioctl,
+	.vop_poll = pipe_poll,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_perm,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+////////////////////////////////////////////////////////////
+// splice
+
+/*
+ * Set up a kernel uio covering LEN bytes of the ring starting at
+ * offset START, which takes two iovecs if it runs past the wrap point.
+ */
+static
+void
+pipe_ringuio(struct pipe *p, struct iovec *iov, struct uio *u,
+	     unsigned start, size_t len, off_t pos, enum uio_rw rw)
+{
+	size_t first;
+
+	first = PIPE_SIZE - start;
+	if (first > len) {
+		first = len;
+	}
+	iov[0].iov_kbase = p->pi_buf + start;
+	iov[0].iov_len = first;
+	iov[1].iov_kbase = p->pi_buf;
+	iov[1].iov_len = len - first;
+
+	u->uio_iov = iov;
+	u->uio_iovcnt = len > first ? 2 : 1;
+	u->uio_offset = pos;
+	u->uio_resid = len;
+	u->uio_segflg = UIO_SYSSPACE;
+	u->uio_rw = rw;
+	u->uio_space = NULL;
+}
+
+/*
+ * File to pipe: VOP_READ straight into the free part of the ring.
+ */
+static
+int
+pipe_splicein(struct pipe *p, struct vnode *file, off_t *pos, size_t len,
+	      size_t *moved)
+{
+	struct iovec iov[2];
+	struct uio u;
+	size_t space, got;
+	int result = 0;
+
+	lock_acquire(p->pi_lock);
+	while (len > 0) {
+		if (!p->pi_readopen) {
+			result = EPIPE;
+			break;
+		}
+		space = PIPE_SIZE - p->pi_count;
+		if (space == 0) {
+			if (*moved > 0) {
+				break;
+			}
+			if (p->pi_wnonblock) {
+				result = EAGAIN;
+				break;
+			}
+			p->pi_wwaiting++;
+			cv_wait(p->pi_writecv, p->pi_lock);
+			p->pi_wwaiting--;
+			continue;
+		}
+		if (space > len) {
+			space = len;
+		}
+
+		pipe_ringuio(p, iov, &u, (p->pi_head + p->pi_count) % PIPE_SIZE,
+			     space, *pos, UIO_READ);
+		result = VOP_READ(file, &u);
+		if (result) {
+			break;
+		}
+		got = space - u.uio_resid;
+		if (got == 0) {
+			/* EOF on the file */
+			break;
+		}
+		p->pi_count += got;
+		*pos = u.uio_offset;
+		*moved += got;
+		len -= got;
+
+		if (p->pi_rwaiting > 0) {
+			cv_broadcast(p->pi_readcv, p->pi_lock);
+		}
+		poll_wakeup(&p->pi_poll);
+	}
+	lock_release(p->pi_lock);
+	return result;
+}
+
+/*
+ * Pipe to file: VOP_WRITE straight out of the full part of the ring.
+ */
+static
+int
+pipe_spliceout(struct pipe *p, struct vnode *file, off_t *pos, size_t len,
+	       size_t *moved)
+{
+	struct iovec iov[2];
+	struct uio u;
+	size_t avail, put;
+	int result = 0;
+
+	lock_acquire(p->pi_lock);
+	while (len > 0) {
+		avail = p->pi_count;
+		if (avail == 0) {
+			if (*moved > 0 || !p->pi_writeopen) {
+				break;
+			}
+			if (p->pi_rnonblock) {
+				result = EAGAIN;
+				break;
+			}
+			p->pi_rwaiting++;
+			cv_wait(p->pi_readcv, p->pi_lock);
+			p->pi_rwaiting--;
+			continue;
+		}
+		if (avail > len) {
+			avail = len;
+		}
+
+		pipe_ringuio(p, iov, &u, p->pi_head, avail, *pos, UIO_WRITE);
+		result = VOP_WRITE(file, &u);
+		put = avail - u.uio_resid;
+		p->pi_head = (p->pi_head + put) % PIPE_SIZE;
+		p->pi_count -= put;
+		*pos += put;
+		*moved += put;
+		len -= put;
+		if (result || put == 0) {
+			break;
+		}
+
+		if (p->pi_wwaiting > 0) {
+			cv_broadcast(p->pi_writecv, p->pi_lock);
+		}
+	}
+	if (p->pi_count == 0) {
+		p->pi_head = 0;
+	}
+	if (*moved > 0) {
+		if (p->pi_wwaiting > 0) {
+			cv_broadcast(p->pi_writecv, p->pi_lock);
+		}
+		poll_wakeup(&p->pi_poll);
+	}
+	lock_release(p->pi_lock);
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// external interface
+
+int
+pipe_create(struct vnode **readret, struct vnode **writeret)
+{
+	struct pipe *p;
+
+	p = kmalloc(sizeof(*p));
+	if (p == NULL) {
+		return ENOMEM;
+	}
+	p->pi_buf = pipebuf_get();
+	if (p->pi_buf == NULL) {
+		goto fail_pipe;
+	}
+	p->pi_lock = lock_create("pipe");
+	if (p->pi_lock == NULL) {
+		goto fail_buf;
+	}
+	p->pi_readcv = cv_create("pipe read");
+	if (p->pi_readcv == NULL) {
+		goto fail_lock;
+	}
+	p->pi_writecv = cv_create("pipe write");
+	if (p->pi_writecv == NULL) {
+		goto fail_readcv;
+	}
+
+	p->pi_head = 0;
+	p->pi_count = 0;
+	p->pi_rwaiting = 0;
+	p->pi_wwaiting = 0;
+	p->pi_readopen = true;
+	p->pi_writeopen = true;
+	p->pi_rnonblock = false;
+	p->pi_wnonblock = false;
+	pollrec_init(&p->pi_poll);
+	vnode_init(&p->pi_readvn, &pipe_readops, NULL, p);
+	vnode_init(&p->pi_writevn, &pipe_writeops, NULL, p);
+
+	*readret = &p->pi_readvn;
+	*writeret = &p->pi_writevn;
+	return 0;
+
+ fail_readcv:
+	cv_destroy(p->pi_readcv);
+ fail_lock:
+	lock_destroy(p->pi_lock);
+ fail_buf:
+	pipebuf_put(p->pi_buf);
+ fail_pipe:
+	kfree(p);
+	return ENOMEM;
+}
+
+void
+pipe_setnonblock(struct vnode *vn, bool nonblock)
+{
+	struct pipe *p;
+
+	if (vn->vn_ops != &pipe_readops && vn->vn_ops != &pipe_writeops) {
+		return;
+	}
+	p = vn->vn_data;
+
+	lock_acquire(p->pi_lock);
+	if (vn == &p->pi_readvn) {
+		p->pi_rnonblock = nonblock;
+	}
+	else {
+		p->pi_wnonblock = nonblock;
+	}
+	lock_release(p->pi_lock);
+}
+
+/*
+ * Splice. Exactly one of FROM and TO must be the appropriate end of a
+ * pipe; the other is read or written at *POS, which is updated. The
+ * data goes between the file and the pipe buffer with a single kernel
+ * copy and never passes through user memory. Like read, this waits
+ * only until something has been moved.
+ */
+int
+pipe_splice(struct vnode *from, struct vnode *to, off_t *pos, size_t len,
+	    size_t *moved)
+{
+	int result;
+
+	*moved = 0;
+	if (from->vn_ops == &pipe_readops && to->vn_ops != &pipe_writeops) {
+		result = pipe_spliceout(from->vn_data, to, pos, len, moved);
+	}
+	else if (to->vn_ops == &pipe_writeops &&
+		 from->vn_ops != &pipe_readops) {
+		result = pipe_splicein(to->vn_data, from, pos, len, moved);
+	}
+	else {
+		return EINVAL;
+	}
+
+	if (*moved > 0 && (result == EAGAIN || result == EPIPE)) {
+		result = 0;
+	}
+	return result;
+}
@@ -0,0 +1,123 @@
+/*
+ * Poll wait machinery. See poll.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <membar.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <clock.h>
+#include <poll.h>
+
+static struct spinlock poll_lock;
+static struct wchan *poll_wchan;
+static volatile unsigned poll_gen;	/* bumped on each wakeup */
+static volatile unsigned poll_ntimed;	/* sleepers with a deadline */
+
+void
+poll_bootstrap(void)
+{
+	spinlock_init(&poll_lock);
+	poll_wchan = wchan_create("poll");
+	if (poll_wchan == NULL) {
+		panic("poll_bootstrap: Out of memory\n");
+	}
+}
+
+void
+pollrec_init(struct pollrec *pr)
+{
+	pr->pr_wanted = false;
+}
+
+void
+poll_record(struct pollrec *pr)
+{
+	pr->pr_wanted = true;
+	membar_store_any();
+}
+
+void
+poll_wakeup(struct pollrec *pr)
+{
+	if (!pr->pr_wanted) {
+		return;
+	}
+	pr->pr_wanted = false;
+
+	spinlock_acquire(&poll_lock);
+	poll_gen++;
+	wchan_wakeall(poll_wchan, &poll_lock);
+	spinlock_release(&poll_lock);
+}
+
+unsigned
+poll_generation(void)
+{
+	unsigned gen;
+
+	spinlock_acquire(&poll_lock);
+	gen = poll_gen;
+	spinlock_release(&poll_lock);
+	return gen;
+}
+
+/*
+ * Returns true if DEADLINE has passed.
+ */
+static
+bool
+poll_expired(const struct timespec *deadline)
+{
+	struct timespec now;
+
+	gettime(&now);
+	return now.tv_sec > deadline->tv_sec ||
+		(now.tv_sec == deadline->tv_sec &&
+		 now.tv_nsec >= deadline->tv_nsec);
+}
+
+bool
+poll_sleep(unsigned gen, const struct timespec *deadline)
+{
+	bool expired = false;
+
+	spinlock_acquire(&poll_lock);
+	if (deadline != NULL) {
+		poll_ntimed++;
+	}
+	while (poll_gen == gen) {
+		if (deadline != NULL) {
+			spinlock_release(&poll_lock);
+			expired = poll_expired(deadline);
+			spinlock_acquire(&poll_lock);
+			if (expired) {
+				break;
+			}
+			if (poll_gen != gen) {
+				break;
+			}
+		}
+		wchan_sleep(poll_wchan, &poll_lock);
+	}
+	if (deadline != NULL) {
+		poll_ntimed--;
+	}
+	spinlock_release(&poll_lock);
+	return expired;
+}
+
+/*
+ * Wake up pollers that have a deadline so they can check the clock.
+ */
+void
+pollclock(void)
+{
+	if (poll_ntimed == 0) {
+		return;
+	}
+	spinlock_acquire(&poll_lock);
+	wchan_wakeall(poll_wchan, &poll_lock);
+	spinlock_release(&poll_lock);
+}
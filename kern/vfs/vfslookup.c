@@ -234,16 +234,99 @@ getdevice(char *path, char **subpath, struct vnode **startvn)
 	return 0;
 }
 
+/*
+ * Look up one path component NAME in DIR, going through the name
+ * cache. "." and ".." aren't cached; they're left to the filesystem.
+ */
+static
+int
+lookone(struct vnode *dir, char *name, struct vnode **ret)
+{
+	unsigned gen;
+	int result;
+
+	if (!strcmp(name, ".") || !strcmp(name, "..")) {
+		return VOP_LOOKUP(dir, name, ret);
+	}
+
+	if (vfs_nclookup(dir, name, ret)) {
+		return *ret != NULL ? 0 : ENOENT;
+	}
+
+	gen = vfs_ncgen();
+	result = VOP_LOOKUP(dir, name, ret);
+	if (result == 0) {
+		vfs_ncenter(dir, name, *ret, gen);
+	}
+	else if (result == ENOENT) {
+		vfs_ncenter(dir, name, NULL, gen);
+	}
+	return result;
+}
+
+/*
+ * Walk PATH from STARTVN one component at a time and hand back a new
+ * reference to where it ends up. The caller keeps its reference to
+ * STARTVN.
+ */
+static
+int
+walkpath(struct vnode *startvn, char *path, struct vnode **ret)
+{
+	char name[NAME_MAX+1];
+	struct vnode *dir, *next;
+	char *slash;
+	size_t len;
+	int result;
+
+	dir = startvn;
+	VOP_INCREF(dir);
+
+	while (1) {
+		while (*path == '/') {
+			path++;
+		}
+		if (*path == 0) {
+			break;
+		}
+
+		slash = strchr(path, '/');
+		len = slash != NULL ? (size_t)(slash - path) : strlen(path);
+		if (len > NAME_MAX) {
+			VOP_DECREF(dir);
+			return ENAMETOOLONG;
+		}
+		memcpy(name, path, len);
+		name[len] = 0;
+		path += len;
+
+		result = lookone(dir, name, &next);
+		VOP_DECREF(dir);
+		if (result) {
+			return result;
+		}
+		dir = next;
+	}
+
+	*ret = dir;
+	return 0;
+}
+
 /*
  * Name-to-vnode translation.
  * (In BSD, both of these are subsumed by namei().)
+ *
+ * All but the last component are looked up here, through the name
+ * cache; the filesystem then sees one name at a time.
  */
 
 int
 vfs_lookparent(char *path, struct vnode **retval,
 	       char *buf, size_t buflen)
 {
-	struct vnode *startvn;
+	struct vnode *startvn, *dir;
+	char *last;
+	size_t len;
 	int result;
 
 	vfs_biglock_acquire();
@@ -260,14 +343,34 @@ vfs_lookparent(char *path, struct vnode **retval,
 		 * a context where "lookparent" is the desired
 		 * operation.
 		 */
-		result = EINVAL;
+		VOP_DECREF(startvn);
+		vfs_biglock_release();
+		return EINVAL;
+	}
+
+	/* Drop trailing slashes, then split off the last component. */
+	len = strlen(path);
+	while (len > 1 && path[len-1] == '/') {
+		path[--len] = 0;
+	}
+	last = strrchr(path, '/');
+	if (last == NULL) {
+		last = path;
+		dir = startvn;
+		VOP_INCREF(dir);
+		result = 0;
 	}
 	else {
-		result = VOP_LOOKPARENT(startvn, path, retval, buf, buflen);
+		*last++ = 0;
+		result = walkpath(startvn, path, &dir);
 	}
-
 	VOP_DECREF(startvn);
 
+	if (result == 0) {
+		result = VOP_LOOKPARENT(dir, last, retval, buf, buflen);
+		VOP_DECREF(dir);
+	}
+
 	vfs_biglock_release();
 	return result;
 }
@@ -292,7 +395,7 @@ vfs_lookup(char *path, struct vnode **retval)
 		return 0;
 	}
 
-	result = VOP_LOOKUP(startvn, path, retval);
+	result = walkpath(startvn, path, retval);
 
 	VOP_DECREF(startvn);
 	vfs_biglock_release();
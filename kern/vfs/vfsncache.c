@@ -0,0 +1,340 @@
+/*
+ * Name lookup cache: (directory vnode, name) -> vnode.
+ *
+ * A fixed pool of entries, hashed by directory and name and kept on
+ * an LRU list. Unused entries sit at the old end of the list so they
+ * get used first. An entry with no vnode records that the name
+ * doesn't exist.
+ *
+ * Entries hold references to their directory and their vnode, so
+ * neither can be reclaimed and have its address reused while the
+ * entry exists. Those references can only be dropped with the cache
+ * unlocked (VOP_DECREF may sleep), so everything that takes entries
+ * out hands the vnodes back to be released afterwards.
+ *
+ * nc_gen is bumped whenever anything is invalidated. A lookup notes
+ * it before calling into the filesystem and the result is only
+ * cached if it hasn't changed, so a lookup that raced with a create
+ * or remove can't put back what was just taken out.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <vfs.h>
+#include <vnode.h>
+
+#define NC_SIZE		256	/* number of entries */
+#define NC_HASHSIZE	64	/* number of hash buckets */
+#define NC_NAMELEN	31	/* longest name that gets cached */
+#define NC_BATCH	16	/* entries dropped per pass when purging */
+
+struct ncentry {
+	struct vnode *nc_dir;		/* NULL if entry unused */
+	struct vnode *nc_vn;		/* NULL if name doesn't exist */
+	unsigned nc_hash;
+	char nc_name[NC_NAMELEN+1];
+	struct ncentry *nc_hashnext;
+	struct ncentry *nc_lrunext;	/* toward newer */
+	struct ncentry *nc_lruprev;	/* toward older */
+};
+
+static struct spinlock nc_lock = SPINLOCK_INITIALIZER;
+static struct ncentry nc_entries[NC_SIZE];
+static struct ncentry *nc_hashtab[NC_HASHSIZE];
+static struct ncentry *nc_lruhead;	/* oldest */
+static struct ncentry *nc_lrutail;	/* newest */
+static unsigned nc_gen;
+
+static
+unsigned
+nc_hashfunc(struct vnode *dir, const char *name)
+{
+	unsigned h;
+
+	h = (unsigned)(uintptr_t)dir >> 4;
+	for (; *name != 0; name++) {
+		h = h*33 + (unsigned char)*name;
+	}
+	return h;
+}
+
+static
+void
+nc_lruremove(struct ncentry *e)
+{
+	if (e->nc_lruprev != NULL) {
+		e->nc_lruprev->nc_lrunext = e->nc_lrunext;
+	}
+	else {
+		nc_lruhead = e->nc_lrunext;
+	}
+	if (e->nc_lrunext != NULL) {
+		e->nc_lrunext->nc_lruprev = e->nc_lruprev;
+	}
+	else {
+		nc_lrutail = e->nc_lruprev;
+	}
+	e->nc_lrunext = e->nc_lruprev = NULL;
+}
+
+static
+void
+nc_lruaddtail(struct ncentry *e)
+{
+	e->nc_lrunext = NULL;
+	e->nc_lruprev = nc_lrutail;
+	if (nc_lrutail != NULL) {
+		nc_lrutail->nc_lrunext = e;
+	}
+	else {
+		nc_lruhead = e;
+	}
+	nc_lrutail = e;
+}
+
+static
+void
+nc_lruaddhead(struct ncentry *e)
+{
+	e->nc_lruprev = NULL;
+	e->nc_lrunext = nc_lruhead;
+	if (nc_lruhead != NULL) {
+		nc_lruhead->nc_lruprev = e;
+	}
+	else {
+		nc_lrutail = e;
+	}
+	nc_lruhead = e;
+}
+
+/*
+ * Find the entry for NAME in DIR. Call with nc_lock held.
+ */
+static
+struct ncentry *
+nc_find(struct vnode *dir, const char *name, unsigned hash)
+{
+	struct ncentry *e;
+
+	for (e = nc_hashtab[hash % NC_HASHSIZE]; e != NULL;
+	     e = e->nc_hashnext) {
+		if (e->nc_hash == hash && e->nc_dir == dir &&
+		    !strcmp(e->nc_name, name)) {
+			return e;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Take entry E out of use, adding the references it held to REFS.
+ * Call with nc_lock held.
+ */
+static
+void
+nc_drop(struct ncentry *e, struct vnode **refs, unsigned *nrefs)
+{
+	struct ncentry **ep;
+
+	KASSERT(e->nc_dir != NULL);
+
+	for (ep = &nc_hashtab[e->nc_hash % NC_HASHSIZE]; *ep != e;
+	     ep = &(*ep)->nc_hashnext) {
+		KASSERT(*ep != NULL);
+	}
+	*ep = e->nc_hashnext;
+	e->nc_hashnext = NULL;
+
+	refs[(*nrefs)++] = e->nc_dir;
+	if (e->nc_vn != NULL) {
+		refs[(*nrefs)++] = e->nc_vn;
+	}
+	e->nc_dir = NULL;
+	e->nc_vn = NULL;
+
+	nc_lruremove(e);
+	nc_lruaddhead(e);
+}
+
+/*
+ * Release references collected by nc_drop. Call without nc_lock.
+ */
+static
+void
+nc_release(struct vnode **refs, unsigned nrefs)
+{
+	unsigned i;
+
+	for (i=0; i<nrefs; i++) {
+		VOP_DECREF(refs[i]);
+	}
+}
+
+bool
+vfs_nclookup(struct vnode *dir, const char *name, struct vnode **result)
+{
+	struct ncentry *e;
+	unsigned hash;
+
+	if (strlen(name) > NC_NAMELEN) {
+		return false;
+	}
+	hash = nc_hashfunc(dir, name);
+
+	spinlock_acquire(&nc_lock);
+	e = nc_find(dir, name, hash);
+	if (e == NULL) {
+		spinlock_release(&nc_lock);
+		return false;
+	}
+	nc_lruremove(e);
+	nc_lruaddtail(e);
+	if (e->nc_vn != NULL) {
+		VOP_INCREF(e->nc_vn);
+	}
+	*result = e->nc_vn;
+	spinlock_release(&nc_lock);
+	return true;
+}
+
+unsigned
+vfs_ncgen(void)
+{
+	unsigned gen;
+
+	spinlock_acquire(&nc_lock);
+	gen = nc_gen;
+	spinlock_release(&nc_lock);
+	return gen;
+}
+
+void
+vfs_ncenter(struct vnode *dir, const char *name, struct vnode *vn,
+	    unsigned gen)
+{
+	struct vnode *refs[4];
+	unsigned nrefs = 0;
+	struct ncentry *e;
+	unsigned hash;
+
+	if (strlen(name) > NC_NAMELEN) {
+		return;
+	}
+	hash = nc_hashfunc(dir, name);
+
+	spinlock_acquire(&nc_lock);
+	if (gen != nc_gen) {
+		/* Something changed while the caller was looking. */
+		spinlock_release(&nc_lock);
+		return;
+	}
+
+	e = nc_find(dir, name, hash);
+	if (e != NULL) {
+		nc_drop(e, refs, &nrefs);
+	}
+
+	/* Reuse the oldest entry. */
+	e = nc_lruhead;
+	KASSERT(e != NULL);
+	if (e->nc_dir != NULL) {
+		nc_drop(e, refs, &nrefs);
+	}
+
+	VOP_INCREF(dir);
+	e->nc_dir = dir;
+	if (vn != NULL) {
+		VOP_INCREF(vn);
+	}
+	e->nc_vn = vn;
+	e->nc_hash = hash;
+	strcpy(e->nc_name, name);
+	e->nc_hashnext = nc_hashtab[hash % NC_HASHSIZE];
+	nc_hashtab[hash % NC_HASHSIZE] = e;
+	nc_lruremove(e);
+	nc_lruaddtail(e);
+	spinlock_release(&nc_lock);
+
+	nc_release(refs, nrefs);
+}
+
+void
+vfs_ncremove(struct vnode *dir, const char *name)
+{
+	struct vnode *refs[2];
+	unsigned nrefs = 0;
+	struct ncentry *e;
+
+	spinlock_acquire(&nc_lock);
+	nc_gen++;
+	if (strlen(name) <= NC_NAMELEN) {
+		e = nc_find(dir, name, nc_hashfunc(dir, name));
+		if (e != NULL) {
+			nc_drop(e, refs, &nrefs);
+		}
+	}
+	spinlock_release(&nc_lock);
+
+	nc_release(refs, nrefs);
+}
+
+/*
+ * Drop every entry that refers to VN (if not NULL) or to a vnode on
+ * FS (if not NULL).
+ */
+static
+void
+nc_purge(struct vnode *vn, struct fs *fs)
+{
+	struct vnode *refs[NC_BATCH*2];
+	unsigned nrefs, i, n;
+	struct ncentry *e;
+
+	do {
+		nrefs = 0;
+		n = 0;
+		spinlock_acquire(&nc_lock);
+		nc_gen++;
+		for (i=0; i<NC_SIZE && n<NC_BATCH; i++) {
+			e = &nc_entries[i];
+			if (e->nc_dir == NULL) {
+				continue;
+			}
+			if ((vn != NULL &&
+			     (e->nc_dir == vn || e->nc_vn == vn)) ||
+			    (fs != NULL && e->nc_dir->vn_fs == fs)) {
+				nc_drop(e, refs, &nrefs);
+				n++;
+			}
+		}
+		spinlock_release(&nc_lock);
+		nc_release(refs, nrefs);
+	} while (n == NC_BATCH);
+}
+
+void
+vfs_ncpurgevn(struct vnode *vn)
+{
+	nc_purge(vn, NULL);
+}
+
+void
+vfs_ncpurgefs(struct fs *fs)
+{
+	nc_purge(NULL, fs);
+}
+
+void
+vfs_ncbootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<NC_SIZE; i++) {
+		nc_entries[i].nc_dir = NULL;
+		nc_entries[i].nc_vn = NULL;
+		nc_entries[i].nc_hashnext = NULL;
+		nc_lruaddtail(&nc_entries[i]);
+	}
+	nc_gen = 0;
+}
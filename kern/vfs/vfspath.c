@@ -74,6 +74,7 @@ vfs_open(char *path, int openflags, mode_t mode, struct vnode **ret)
 		}
 
 		result = VOP_CREAT(dir, name, excl, mode, &vn);
+		vfs_ncremove(dir, name);
 
 		VOP_DECREF(dir);
 	}
@@ -146,6 +147,7 @@ vfs_remove(char *path)
 	}
 
 	result = VOP_REMOVE(dir, name);
+	vfs_ncremove(dir, name);
 	VOP_DECREF(dir);
 
 	return result;
@@ -179,6 +181,8 @@ vfs_rename(char *oldpath, char *newpath)
 	}
 
 	result = VOP_RENAME(olddir, oldname, newdir, newname);
+	vfs_ncremove(olddir, oldname);
+	vfs_ncremove(newdir, newname);
 
 	VOP_DECREF(newdir);
 	VOP_DECREF(olddir);
@@ -213,6 +217,7 @@ vfs_link(char *oldpath, char *newpath)
 	}
 
 	result = VOP_LINK(newdir, newname, oldfile);
+	vfs_ncremove(newdir, newname);
 
 	VOP_DECREF(newdir);
 	VOP_DECREF(oldfile);
@@ -240,6 +245,7 @@ vfs_symlink(const char *contents, char *path)
 	}
 
 	result = VOP_SYMLINK(newdir, newname, contents);
+	vfs_ncremove(newdir, newname);
 	VOP_DECREF(newdir);
 
 	return result;
@@ -286,6 +292,7 @@ vfs_mkdir(char *path, mode_t mode)
 	}
 
 	result = VOP_MKDIR(parent, name, mode);
+	vfs_ncremove(parent, name);
 
 	VOP_DECREF(parent);
 
@@ -298,7 +305,7 @@ vfs_mkdir(char *path, mode_t mode)
 int
 vfs_rmdir(char *path)
 {
-	struct vnode *parent;
+	struct vnode *parent, *victim;
 	char name[NAME_MAX+1];
 	int result;
 
@@ -307,7 +314,22 @@ vfs_rmdir(char *path)
 		return result;
 	}
 
+	/*
+	 * Get the directory itself too, so the name cache can forget
+	 * whatever it has cached inside it.
+	 */
+	if (VOP_LOOKUP(parent, name, &victim)) {
+		victim = NULL;
+	}
+
 	result = VOP_RMDIR(parent, name);
+	vfs_ncremove(parent, name);
+	if (victim != NULL) {
+		if (result == 0) {
+			vfs_ncpurgevn(victim);
+		}
+		VOP_DECREF(victim);
+	}
 
 	VOP_DECREF(parent);
 
@@ -86,6 +86,9 @@
  * "tm_copyjmp".
  */
 
+/* HASZERO from common/libc/string/strlen.c, for a 32-bit word. */
+#define HASZERO(w)  (((w) - 0x01010101U) & ~(w) & 0x80808080U)
+
 /*
  * Recovery function. If a fatal fault occurs during copyin, copyout,
  * copyinstr, or copyoutstr, execution resumes here. (This behavior is
@@ -229,21 +232,53 @@ copyout(const void *src, userptr_t userdest, size_t len)
  * hit STOPLEN it's because the string has run into the end of
  * userspace. Thus in the latter case we return EFAULT, not
  * ENAMETOOLONG.
+ *
+ * Once SRC is word-aligned we load a word at a time and only drop
+ * back to bytes for the word that holds the terminator. A word is
+ * loaded only if all of it is inside STOPLEN, so this never touches
+ * memory the byte-at-a-time version wouldn't have, and an aligned
+ * word can't straddle a page boundary.
  */
 static
 int
 copystr(char *dest, const char *src, size_t maxlen, size_t stoplen,
 	size_t *gotlen)
 {
-	size_t i;
+	size_t i, limit;
+	uint32_t w;
+
+	limit = maxlen < stoplen ? maxlen : stoplen;
+	i = 0;
+
+	while (i < limit && (uintptr_t)(src + i) % sizeof(w) != 0) {
+		dest[i] = src[i];
+		if (src[i] == 0) {
+			goto found;
+		}
+		i++;
+	}
 
-	for (i=0; i<maxlen && i<stoplen; i++) {
+	while (i + sizeof(w) <= limit) {
+		w = *(const uint32_t *)(src + i);
+		if (HASZERO(w)) {
+			break;
+		}
+		if ((uintptr_t)(dest + i) % sizeof(w) == 0) {
+			*(uint32_t *)(dest + i) = w;
+		}
+		else {
+			dest[i] = src[i];
+			dest[i+1] = src[i+1];
+			dest[i+2] = src[i+2];
+			dest[i+3] = src[i+3];
+		}
+		i += sizeof(w);
+	}
+
+	for (; i < limit; i++) {
 		dest[i] = src[i];
 		if (src[i] == 0) {
-			if (gotlen != NULL) {
-				*gotlen = i+1;
-			}
-			return 0;
+			goto found;
 		}
 	}
 	if (stoplen < maxlen) {
@@ -252,6 +287,12 @@ copystr(char *dest, const char *src, size_t maxlen, size_t stoplen,
 	}
 	/* otherwise just ran out of space */
 	return ENAMETOOLONG;
+
+ found:
+	if (gotlen != NULL) {
+		*gotlen = i+1;
+	}
+	return 0;
 }
 
 /*
@@ -45,6 +45,7 @@
 #include <limits.h>
 #include <errno.h>
 #include <err.h>
+#include <fcntl.h>
 
 #ifdef HOST
 #include "hostcompat.h"
@@ -111,6 +112,39 @@ remember_bg(pid_t pid)
 	assert(0);
 }
 
+/*
+ * forget_bg
+ * clears the slot holding pid, if any.
+ */
+static
+void
+forget_bg(pid_t pid)
+{
+	int i;
+	for (i = 0; i < MAXBG; i++) {
+		if (bgpids[i] == pid) {
+			bgpids[i] = 0;
+		}
+	}
+}
+
+/*
+ * no_bg
+ * true if there are no background jobs outstanding.
+ */
+static
+int
+no_bg(void)
+{
+	int i;
+	for (i = 0; i < MAXBG; i++) {
+		if (bgpids[i] != 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
 /*
  * constructor for exitinfo
  */
@@ -211,45 +245,24 @@ dowait(pid_t pid)
 
 #ifdef WNOHANG
 /*
- * dowaitpoll
- * like dowait, but uses WNOHANG. returns true if we got something.
+ * waitpoll
+ * reap whatever background jobs have exited, in whatever order they
+ * exited in. uses waitpid(-1) so it costs one call per finished job
+ * plus one, rather than one call per outstanding job.
  */
 static
-int
-dowaitpoll(pid_t pid)
+void
+waitpoll(void)
 {
 	struct exitinfo ei;
-	pid_t foundpid;
+	pid_t pid;
 	int status;
 
-	foundpid = waitpid(pid, &status, WNOHANG);
-	if (foundpid < 0) {
-		warn("pid %d", pid);
-	}
-	else if (foundpid != 0) {
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
 		printf("pid %d: ", pid);
 		readstatus(status, &ei);
 		printstatus(&ei, 1);
-		return 1;
-	}
-	return 0;
-}
-
-/*
- * waitpoll
- * poll all background jobs for having exited.
- */
-static
-void
-waitpoll(void)
-{
-	int i;
-	for (i=0; i < MAXBG; i++) {
-		if (bgpids[i] != 0) {
-			if (dowaitpoll(bgpids[i])) {
-				bgpids[i] = 0;
-			}
-		}
+		forget_bg(pid);
 	}
 }
 #endif /* WNOHANG */
@@ -264,26 +277,32 @@ static
 void
 cmd_wait(int ac, char *av[], struct exitinfo *ei)
 {
-	int i;
+	struct exitinfo info;
+	int status;
 	pid_t pid;
 
 	if (ac == 2) {
 		pid = atoi(av[1]);
 		dowait(pid);
-		for (i = 0; i < MAXBG; i++) {
-			if (bgpids[i]==pid) {
-				bgpids[i] = 0;
-			}
-		}
+		forget_bg(pid);
 		exitinfo_exit(ei, 0);
 		return;
 	}
 	else if (ac == 1) {
-		for (i=0; i < MAXBG; i++) {
-			if (bgpids[i] != 0) {
-				dowait(bgpids[i]);
-				bgpids[i] = 0;
+		/*
+		 * Take the jobs as they finish rather than in the
+		 * order they were started, so a slow one doesn't hold
+		 * up reporting the rest.
+		 */
+		while (!no_bg()) {
+			if ((pid = waitpid(-1, &status, 0)) < 0) {
+				warn("wait");
+				break;
 			}
+			printf("pid %d: ", pid);
+			readstatus(status, &info);
+			printstatus(&info, 1);
+			forget_bg(pid);
 		}
 		exitinfo_exit(ei, 0);
 		return;
@@ -355,6 +374,171 @@ static struct {
 	{ NULL, NULL }
 };
 
+/*
+ * redirect
+ * handles "< file", "> file", and ">> file" in the argument list,
+ * which it removes. the file is opened once and dup2'd into place,
+ * so the program inherits the one open file. called in the child,
+ * before exec. returns nonzero on failure.
+ */
+static
+int
+redirect(char **args)
+{
+	int i, j, fd, target, flags;
+
+	for (i = j = 0; args[i] != NULL; i++) {
+		if (!strcmp(args[i], "<")) {
+			target = STDIN_FILENO;
+			flags = O_RDONLY;
+		}
+		else if (!strcmp(args[i], ">")) {
+			target = STDOUT_FILENO;
+			flags = O_WRONLY|O_CREAT|O_TRUNC;
+		}
+		else if (!strcmp(args[i], ">>")) {
+			target = STDOUT_FILENO;
+			flags = O_WRONLY|O_CREAT|O_APPEND;
+		}
+		else {
+			args[j++] = args[i];
+			continue;
+		}
+		if (args[i+1] == NULL) {
+			warnx("%s: missing file name", args[i]);
+			return 1;
+		}
+		i++;
+		fd = open(args[i], flags, 0664);
+		if (fd < 0) {
+			warn("%s", args[i]);
+			return 1;
+		}
+		if (fd != target) {
+			if (dup2(fd, target) < 0) {
+				warn("dup2");
+				return 1;
+			}
+			close(fd);
+		}
+	}
+	args[j] = NULL;
+	return 0;
+}
+
+/*
+ * hasredirect
+ * returns nonzero if args contains any redirections, i.e. if the
+ * child has to do anything between fork and exec.
+ */
+static
+int
+hasredirect(char **args)
+{
+	int i;
+
+	for (i = 0; args[i] != NULL; i++) {
+		if (!strcmp(args[i], "<") || !strcmp(args[i], ">") ||
+		    !strcmp(args[i], ">>")) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * runpipeline
+ * runs "cmd1 | cmd2 | ..." in the foreground. each stage is forked
+ * with its stdin and stdout connected to its neighbours by pipes; the
+ * exit status is that of the last stage. args is modified in place.
+ */
+static
+void
+runpipeline(char **args, struct exitinfo *ei)
+{
+	pid_t pids[NARG_MAX];
+	char **stage, **next;
+	int fds[2], infd, nstages, i;
+	int status;
+
+	infd = -1;
+	nstages = 0;
+	for (stage = args; stage != NULL; stage = next) {
+		next = stage;
+		while (*next != NULL && strcmp(*next, "|")) {
+			next++;
+		}
+		if (*next != NULL) {
+			*next++ = NULL;
+		}
+		else {
+			next = NULL;
+		}
+		if (stage[0] == NULL) {
+			warnx("|: missing command");
+			break;
+		}
+
+		if (next != NULL && pipe(fds) < 0) {
+			warn("pipe");
+			break;
+		}
+
+		pids[nstages] = fork();
+		if (pids[nstages] < 0) {
+			warn("fork");
+			if (next != NULL) {
+				close(fds[0]);
+				close(fds[1]);
+			}
+			break;
+		}
+		if (pids[nstages] == 0) {
+			/* child */
+			if (infd >= 0) {
+				dup2(infd, STDIN_FILENO);
+				close(infd);
+			}
+			if (next != NULL) {
+				close(fds[0]);
+				dup2(fds[1], STDOUT_FILENO);
+				close(fds[1]);
+			}
+			if (redirect(stage)) {
+				_exit(1);
+			}
+			execvp(stage[0], stage);
+			warn("%s", stage[0]);
+			_exit(1);
+		}
+		nstages++;
+
+		if (infd >= 0) {
+			close(infd);
+		}
+		if (next != NULL) {
+			close(fds[1]);
+			infd = fds[0];
+		}
+		else {
+			infd = -1;
+		}
+	}
+	if (infd >= 0) {
+		close(infd);
+	}
+
+	exitinfo_exit(ei, 255);
+	for (i = 0; i < nstages; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			warn("waitpid");
+		}
+		else if (i == nstages - 1 && stage == NULL) {
+			readstatus(status, ei);
+		}
+	}
+}
+
 /*
  * docommand
  * tokenizes the command line using strtok.  if there aren't any commands,
@@ -373,6 +557,7 @@ docommand(char *buf, struct exitinfo *ei)
 	int status;
 	int bg=0;
 	time_t startsecs, endsecs;
+	struct rusage usage;
 	unsigned long startnsecs, endnsecs;
 
 	nargs = 0;
@@ -403,6 +588,13 @@ docommand(char *buf, struct exitinfo *ei)
 
 	/* Not a builtin; run it */
 
+	for (i=0; i<nargs; i++) {
+		if (!strcmp(args[i], "|")) {
+			runpipeline(args, ei);
+			return;
+		}
+	}
+
 	if (nargs > 0 && !strcmp(args[nargs-1], "&")) {
 		/* background */
 		if (!can_bg()) {
@@ -421,7 +613,22 @@ docommand(char *buf, struct exitinfo *ei)
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
+	if (!hasredirect(args)) {
+		/*
+		 * Nothing to do in the child before exec, so have the
+		 * kernel start the program directly instead of copying
+		 * our address space only to throw it away.
+		 */
+		pid = spawnp(args[0], args);
+		if (pid < 0) {
+			warn("%s", args[0]);
+			exitinfo_exit(ei, 1);
+			return;
+		}
+	}
+	else {
+		pid = fork();
+	}
 	switch (pid) {
 		case -1:
 			/* error */
@@ -430,6 +637,9 @@ docommand(char *buf, struct exitinfo *ei)
 			return;
 		case 0:
 			/* child */
+			if (redirect(args)) {
+				_exit(1);
+			}
 			execvp(args[0], args);
 			warn("%s", args[0]);
 			/*
@@ -453,7 +663,7 @@ docommand(char *buf, struct exitinfo *ei)
 		return;
 	}
 
-	if (waitpid(pid, &status, 0) < 0) {
+	if (wait4(pid, &status, 0, &usage) < 0) {
 		warn("waitpid");
 		exitinfo_exit(ei, 255);
 	}
@@ -471,6 +681,15 @@ docommand(char *buf, struct exitinfo *ei)
 		endsecs -= startsecs;
 		warnx("subprocess time: %lu.%09lu seconds",
 		      (unsigned long) endsecs, (unsigned long) endnsecs);
+		warnx("user %lu.%06lu sys %lu.%06lu, %lu blocks in, "
+		      "%lu blocks out, %lu syscalls",
+		      (unsigned long) usage.ru_utime.tv_sec,
+		      (unsigned long) usage.ru_utime.tv_usec,
+		      (unsigned long) usage.ru_stime.tv_sec,
+		      (unsigned long) usage.ru_stime.tv_usec,
+		      (unsigned long) usage.ru_inblock,
+		      (unsigned long) usage.ru_oublock,
+		      (unsigned long) usage.ru_nsyscalls);
 	}
 }
 
@@ -40,9 +40,13 @@
  */
 #include <kern/fcntl.h>
 #include <kern/ioctl.h>
+#include <kern/iovec.h>
+#include <kern/poll.h>
+#include <kern/batch.h>
 #include <kern/reboot.h>
 #include <kern/seek.h>
 #include <kern/time.h>
+#include <kern/resource.h>
 #include <kern/unistd.h>
 #include <kern/wait.h>
 
@@ -148,6 +152,18 @@ int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 int __time(time_t *seconds, unsigned long *nanoseconds);
 ssize_t __getcwd(char *buf, size_t buflen);
+int dup(int filehandle);
+pid_t wait4(pid_t pid, int *returncode, int flags, struct rusage *usage);
+int getrusage(int who, struct rusage *usage);
+ssize_t pread(int filehandle, void *buf, size_t size, off_t pos);
+ssize_t pwrite(int filehandle, const void *buf, size_t size, off_t pos);
+ssize_t readv(int filehandle, const struct iovec *iov, int iovcnt);
+ssize_t writev(int filehandle, const struct iovec *iov, int iovcnt);
+int fcntl(int filehandle, int code, ...);
+ssize_t splice(int fromhandle, int tohandle, size_t len);
+int poll(struct pollfd *fds, unsigned nfds, int timeout);
+int __batch(struct batch_ring *ring);
+pid_t spawn(const char *prog, char *const *args);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -156,7 +172,22 @@ ssize_t __getcwd(char *buf, size_t buflen);
  */
 
 int execvp(const char *prog, char *const *args); /* calls execv */
+pid_t spawnp(const char *prog, char *const *args); /* calls spawn */
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
 
+/* Batched I/O (see <kern/batch.h>): queue requests, then submit. */
+void batch_init(struct batch_ring *ring);
+struct batch_ent *batch_read(struct batch_ring *, int fd, void *buf, size_t len);
+struct batch_ent *batch_write(struct batch_ring *, int fd, const void *buf,
+			      size_t len);
+struct batch_ent *batch_pread(struct batch_ring *, int fd, void *buf,
+			      size_t len, off_t pos);
+struct batch_ent *batch_pwrite(struct batch_ring *, int fd, const void *buf,
+			       size_t len, off_t pos);
+struct batch_ent *batch_lseek(struct batch_ring *, int fd, off_t pos,
+			      int whence);
+struct batch_ent *batch_close(struct batch_ring *, int fd);
+int batch_submit(struct batch_ring *ring);	/* calls __batch */
+
 #endif /* _UNISTD_H_ */
@@ -27,8 +27,11 @@
  * SUCH DAMAGE.
  */
 
+#include <stdint.h>
 #include <string.h>
 
+#define WORDSIZE	sizeof(unsigned long)
+
 /*
  * Standard C string function: compare two memory blocks and return
  * their sort order.
@@ -39,8 +42,48 @@ memcmp(const void *av, const void *bv, size_t len)
 {
 	const unsigned char *a = av;
 	const unsigned char *b = bv;
+	const unsigned long *aw, *bw;
 	size_t i;
 
+	/*
+	 * If the two blocks are aligned the same way, compare bytes
+	 * up to a word boundary and then compare by words (four per
+	 * pass) until something differs. The bytes of the word that
+	 * differs, and any tail, are sorted out by the byte loop.
+	 *
+	 * Blocks aligned differently just get compared by bytes;
+	 * that doesn't come up much.
+	 */
+
+	if (len >= 2 * WORDSIZE &&
+	    ((uintptr_t)a - (uintptr_t)b) % WORDSIZE == 0) {
+		while ((uintptr_t)a % WORDSIZE != 0) {
+			if (*a != *b) {
+				return (int)(*a - *b);
+			}
+			a++;
+			b++;
+			len--;
+		}
+
+		aw = (const unsigned long *)a;
+		bw = (const unsigned long *)b;
+		while (len >= 4 * WORDSIZE &&
+		       aw[0] == bw[0] && aw[1] == bw[1] &&
+		       aw[2] == bw[2] && aw[3] == bw[3]) {
+			aw += 4;
+			bw += 4;
+			len -= 4 * WORDSIZE;
+		}
+		while (len >= WORDSIZE && *aw == *bw) {
+			aw++;
+			bw++;
+			len -= WORDSIZE;
+		}
+		a = (const unsigned char *)aw;
+		b = (const unsigned char *)bw;
+	}
+
 	for (i=0; i<len; i++) {
 		if (a[i] != b[i]) {
 			return (int)(a[i] - b[i]);
@@ -21,5 +21,12 @@ awk '
     }
 ' | awk '{
 	# output something simple that will work in syscalls.S.
-	printf "SYSCALL(%s, %s)\n", $1, $2;
+	# Calls that libc implements itself in C (__time reads the time
+	# page) get their stub renamed to __sys_<name> to fall back on.
+	if ($1 == "__time") {
+		printf "SYSCALLAS(__sys_%s, %s)\n", $1, $1;
+	}
+	else {
+		printf "SYSCALL(%s, %s)\n", $1, $2;
+	}
 }'
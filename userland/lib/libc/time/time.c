@@ -28,15 +28,61 @@
  */
 
 #include <unistd.h>
+#include <kern/timepage.h>
+
+/* The real system call; see gensyscalls.sh. */
+int __sys___time(time_t *seconds, unsigned long *nanoseconds);
 
 /*
- * POSIX C function: retrieve time in seconds since the epoch.
- * Uses the OS/161 system call __time, which does the same thing
- * but also returns nanoseconds.
+ * OS/161 __time: get the time of day in seconds and nanoseconds.
+ * Either pointer may be NULL. Returns 0, like the system call.
+ *
+ * This reads the time page the kernel maps into every process, so it
+ * doesn't trap; see <kern/timepage.h>. If the kernel hasn't filled the
+ * page in yet, fall back on the system call.
  */
+int
+__time(time_t *seconds, unsigned long *nanoseconds)
+{
+	const struct timepage *tp = (const struct timepage *)TIMEPAGE_VADDR;
+	unsigned seq;
+	time_t s;
+	unsigned long ns;
+
+	do {
+		seq = tp->tp_seq;
+		s = tp->tp_sec;
+		ns = tp->tp_nsec;
+	} while ((seq & 1) != 0 || tp->tp_seq != seq);
+
+	if (seq == 0) {
+		if (__sys___time(&s, &ns) < 0) {
+			return -1;
+		}
+	}
 
+	if (seconds != NULL) {
+		*seconds = s;
+	}
+	if (nanoseconds != NULL) {
+		*nanoseconds = ns;
+	}
+	return 0;
+}
+
+/*
+ * POSIX C function: retrieve time in seconds since the epoch.
+ */
 time_t
 time(time_t *t)
 {
-	return __time(t, NULL);
+	time_t s;
+
+	if (__time(&s, NULL) < 0) {
+		return (time_t)-1;
+	}
+	if (t != NULL) {
+		*t = s;
+	}
+	return s;
 }
@@ -0,0 +1,124 @@
+#include <unistd.h>
+#include <errno.h>
+
+/*
+ * Batched I/O. The batch_* queueing functions fill in the next free
+ * entry of the ring and return it, so the caller can look at its
+ * be_result and be_error after batch_submit. They return NULL with
+ * errno set to ENOSPC if the ring is full; submit and try again.
+ */
+
+void
+batch_init(struct batch_ring *ring)
+{
+	ring->br_head = 0;
+	ring->br_tail = 0;
+}
+
+static
+struct batch_ent *
+batch_queue(struct batch_ring *ring, int op, int fd)
+{
+	struct batch_ent *be;
+
+	if (ring->br_tail - ring->br_head >= BATCH_RINGSIZE) {
+		errno = ENOSPC;
+		return NULL;
+	}
+	be = &ring->br_ents[ring->br_tail % BATCH_RINGSIZE];
+	ring->br_tail++;
+
+	be->be_op = op;
+	be->be_fd = fd;
+	be->be_buf = NULL;
+	be->be_len = 0;
+	be->be_whence = 0;
+	be->be_pos = 0;
+	be->be_error = 0;
+	be->be_result = -1;
+	return be;
+}
+
+struct batch_ent *
+batch_read(struct batch_ring *ring, int fd, void *buf, size_t len)
+{
+	struct batch_ent *be;
+
+	be = batch_queue(ring, BATCH_READ, fd);
+	if (be != NULL) {
+		be->be_buf = buf;
+		be->be_len = len;
+	}
+	return be;
+}
+
+struct batch_ent *
+batch_write(struct batch_ring *ring, int fd, const void *buf, size_t len)
+{
+	struct batch_ent *be;
+
+	be = batch_queue(ring, BATCH_WRITE, fd);
+	if (be != NULL) {
+		be->be_buf = (void *)buf;
+		be->be_len = len;
+	}
+	return be;
+}
+
+struct batch_ent *
+batch_pread(struct batch_ring *ring, int fd, void *buf, size_t len, off_t pos)
+{
+	struct batch_ent *be;
+
+	be = batch_queue(ring, BATCH_PREAD, fd);
+	if (be != NULL) {
+		be->be_buf = buf;
+		be->be_len = len;
+		be->be_pos = pos;
+	}
+	return be;
+}
+
+struct batch_ent *
+batch_pwrite(struct batch_ring *ring, int fd, const void *buf, size_t len,
+	     off_t pos)
+{
+	struct batch_ent *be;
+
+	be = batch_queue(ring, BATCH_PWRITE, fd);
+	if (be != NULL) {
+		be->be_buf = (void *)buf;
+		be->be_len = len;
+		be->be_pos = pos;
+	}
+	return be;
+}
+
+struct batch_ent *
+batch_lseek(struct batch_ring *ring, int fd, off_t pos, int whence)
+{
+	struct batch_ent *be;
+
+	be = batch_queue(ring, BATCH_LSEEK, fd);
+	if (be != NULL) {
+		be->be_pos = pos;
+		be->be_whence = whence;
+	}
+	return be;
+}
+
+struct batch_ent *
+batch_close(struct batch_ring *ring, int fd)
+{
+	return batch_queue(ring, BATCH_CLOSE, fd);
+}
+
+/*
+ * Run everything queued. Returns the number of entries run, or -1 if
+ * the ring itself was bad.
+ */
+int
+batch_submit(struct batch_ring *ring)
+{
+	return __batch(ring);
+}
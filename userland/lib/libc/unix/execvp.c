@@ -35,19 +35,23 @@
 #include <limits.h>
 
 /*
- * POSIX C function: exec a program on the search path. Tries
- * execv() repeatedly until one of the choices works.
+ * Try RUN (execv or spawn) on PROG, or if PROG has no slash in it,
+ * on each place PROG might be on the search path, until one of them
+ * works or fails for a reason other than the program not being
+ * there. Returns what RUN returned.
  */
+static
 int
-execvp(const char *prog, char *const *args)
+pathsearch(const char *prog, char *const *args,
+	   int (*run)(const char *, char *const *))
 {
 	const char *searchpath, *s, *t;
 	char progpath[PATH_MAX];
 	size_t len;
+	int result;
 
 	if (strchr(prog, '/') != NULL) {
-		execv(prog, args);
-		return -1;
+		return run(prog, args);
 	}
 
 	searchpath = getenv("PATH");
@@ -74,7 +78,10 @@ execvp(const char *prog, char *const *args)
 		}
 		memcpy(progpath, s, len);
 		snprintf(progpath + len, sizeof(progpath) - len, "/%s", prog);
-		execv(progpath, args);
+		result = run(progpath, args);
+		if (result >= 0) {
+			return result;
+		}
 		switch (errno) {
 		    case ENOENT:
 		    case ENOTDIR:
@@ -89,3 +96,24 @@ execvp(const char *prog, char *const *args)
 	errno = ENOENT;
 	return -1;
 }
+
+/*
+ * POSIX C function: exec a program on the search path. Tries
+ * execv() repeatedly until one of the choices works.
+ */
+int
+execvp(const char *prog, char *const *args)
+{
+	pathsearch(prog, args, execv);
+	return -1;
+}
+
+/*
+ * Start a program on the search path in a new process, the same way.
+ * Returns the child's pid.
+ */
+pid_t
+spawnp(const char *prog, char *const *args)
+{
+	return pathsearch(prog, args, spawn);
+}
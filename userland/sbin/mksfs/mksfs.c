@@ -29,6 +29,7 @@
 
 #include <sys/types.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <limits.h>
@@ -60,6 +61,9 @@
 /* Maximum size of freemap we support */
 #define MAXFREEMAPBLOCKS 32
 
+/* Largest hashed root directory; the kernel won't grow one past this */
+#define MAXDIRBUCKETS 1024
+
 /* Free block bitmap */
 static char freemapbuf[MAXFREEMAPBLOCKS * SFS_BLOCKSIZE];
 
@@ -165,19 +169,93 @@ writefreemap(uint32_t fsblocks)
 }
 
 /*
- * Write out the root directory inode.
+ * Write out the root directory inode. If NBUCKETS isn't 0, make it
+ * a hashed directory with that many (empty) buckets, placed right
+ * after the freemap. This must be done before the freemap is written.
  */
 static
 void
-writerootdir(void)
+writerootdir(uint32_t fsblocks, uint32_t nbuckets)
 {
 	struct sfs_dinode sfi;
+	uint32_t indirect[SFS_DBPERIDB];
+	uint32_t dindirect[SFS_DBPERIDB];
+	uint32_t leaf[SFS_DBPERIDB];
+	char zeros[SFS_BLOCKSIZE];
+	uint32_t block, indirblock, dindirblock, firstleaf, nleaves, i, j;
 
 	/* Initialize the dinode */
 	bzero((void *)&sfi, sizeof(sfi));
-	sfi.sfi_size = SWAP32(0);
+	sfi.sfi_size = SWAP32(nbuckets * SFS_BLOCKSIZE);
 	sfi.sfi_type = SWAP16(SFS_TYPE_DIR);
 	sfi.sfi_linkcount = SWAP16(1);
+	sfi.sfi_dirhash = SWAP32(nbuckets);
+	sfi.sfi_dirmaxprobe = SWAP32(0);
+
+	/*
+	 * Lay out the indirect blocks first, then the buckets. Buckets
+	 * past the indirect block go under the double indirect block,
+	 * in NLEAVES blocks starting at FIRSTLEAF.
+	 */
+	bzero((void *)indirect, sizeof(indirect));
+	bzero((void *)dindirect, sizeof(dindirect));
+	bzero((void *)leaf, sizeof(leaf));
+	bzero(zeros, sizeof(zeros));
+	block = SFS_FREEMAP_START + SFS_FREEMAPBLOCKS(fsblocks);
+	indirblock = dindirblock = 0;
+	nleaves = 0;
+	if (nbuckets > SFS_NDIRECT) {
+		indirblock = block++;
+	}
+	if (nbuckets > SFS_NDIRECT + SFS_DBPERIDB) {
+		dindirblock = block++;
+		nleaves = (nbuckets - SFS_NDIRECT - SFS_DBPERIDB
+			   + SFS_DBPERIDB - 1) / SFS_DBPERIDB;
+	}
+	firstleaf = block;
+	block += nleaves;
+	if (block + nbuckets > fsblocks) {
+		errx(1, "Volume too small for %u directory buckets",
+		     nbuckets);
+	}
+	if (indirblock != 0) {
+		allocblock(indirblock);
+		sfi.sfi_indirect = SWAP32(indirblock);
+	}
+	if (dindirblock != 0) {
+		allocblock(dindirblock);
+		sfi.sfi_dindirect = SWAP32(dindirblock);
+	}
+	for (i=0; i<nleaves; i++) {
+		allocblock(firstleaf + i);
+		dindirect[i] = SWAP32(firstleaf + i);
+	}
+
+	for (i=0; i<nbuckets; i++, block++) {
+		allocblock(block);
+		diskwrite(zeros, block);
+		if (i < SFS_NDIRECT) {
+			sfi.sfi_direct[i] = SWAP32(block);
+			continue;
+		}
+		if (i < SFS_NDIRECT + SFS_DBPERIDB) {
+			indirect[i - SFS_NDIRECT] = SWAP32(block);
+			continue;
+		}
+		j = i - SFS_NDIRECT - SFS_DBPERIDB;
+		leaf[j % SFS_DBPERIDB] = SWAP32(block);
+		if (j % SFS_DBPERIDB == SFS_DBPERIDB - 1 || i == nbuckets - 1) {
+			/* This leaf is done */
+			diskwrite(leaf, firstleaf + j / SFS_DBPERIDB);
+			bzero((void *)leaf, sizeof(leaf));
+		}
+	}
+	if (indirblock != 0) {
+		diskwrite(indirect, indirblock);
+	}
+	if (dindirblock != 0) {
+		diskwrite(dindirect, dindirblock);
+	}
 
 	/* Write it out */
 	diskwrite(&sfi, SFS_ROOTDIR_INO);
@@ -189,15 +267,28 @@ writerootdir(void)
 int
 main(int argc, char **argv)
 {
-	uint32_t size, blocksize;
+	uint32_t size, blocksize, nbuckets = 0;
 	char *volname, *s;
 
 #ifdef HOST
 	hostcompat_init(argc, argv);
 #endif
 
+	/* -H n: make the root directory hashed, with n buckets */
+	if (argc==5 && !strcmp(argv[1], "-H")) {
+		nbuckets = atoi(argv[2]);
+		if (nbuckets == 0 || nbuckets > MAXDIRBUCKETS ||
+		    (nbuckets & (nbuckets - 1)) != 0) {
+			errx(1, "Directory buckets must be a power of 2 "
+			     "no larger than %u", MAXDIRBUCKETS);
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
 	if (argc!=3) {
-		errx(1, "Usage: mksfs device/diskfile volume-name");
+		errx(1, "Usage: mksfs [-H buckets] device/diskfile "
+		     "volume-name");
 	}
 
 	check();
@@ -231,8 +322,8 @@ main(int argc, char **argv)
 	/* Write out the on-disk structures */
 	initfreemap(size);
 	writesuper(volname, size);
+	writerootdir(size, nbuckets);
 	writefreemap(size);
-	writerootdir();
 
 	closedisk();
 
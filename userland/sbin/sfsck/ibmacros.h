@@ -151,9 +151,9 @@
 /* max blocks */
 
 #define INOMAX_D 	NUM_D
-#define INOMAX_I 	(INOMAX_D + SFS_DBPERIDB * NUM_I)
-#define INOMAX_II	(INOMAX_I + SFS_DBPERIDB * NUM_II)
-#define INOMAX_III	(INOMAX_II + SFS_DBPERIDB * NUM_III)
+#define INOMAX_I 	(INOMAX_D + RANGE_I * NUM_I)
+#define INOMAX_II	(INOMAX_I + RANGE_II * NUM_II)
+#define INOMAX_III	(INOMAX_II + RANGE_III * NUM_III)
 
 
 #endif /* IBMACROS_H */
@@ -277,6 +277,26 @@ pass1_inode(uint32_t ino, struct sfs_dinode *sfi, int alreadychanged)
 		changed = 1;
 	}
 
+	if (!isdir && (sfi->sfi_dirhash != 0 || sfi->sfi_dirmaxprobe != 0)) {
+		warnx("Inode %lu: File has directory hash fields set (fixed)",
+		      (unsigned long) ino);
+		setbadness(EXIT_RECOV);
+		sfi->sfi_dirhash = 0;
+		sfi->sfi_dirmaxprobe = 0;
+		changed = 1;
+	}
+	else if (sfi->sfi_dirhash != 0 &&
+		 ((sfi->sfi_dirhash & (sfi->sfi_dirhash - 1)) != 0 ||
+		  sfi->sfi_size != sfi->sfi_dirhash * SFS_BLOCKSIZE)) {
+		/* Dropping the hash always leaves a valid directory */
+		warnx("Inode %lu: Directory hash table does not match "
+		      "size (made linear)", (unsigned long) ino);
+		setbadness(EXIT_RECOV);
+		sfi->sfi_dirhash = 0;
+		sfi->sfi_dirmaxprobe = 0;
+		changed = 1;
+	}
+
 	if (check_inode_blocks(ino, sfi, isdir)) {
 		changed = 1;
 	}
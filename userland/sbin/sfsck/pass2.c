@@ -47,6 +47,32 @@
 #include "passes.h"
 #include "main.h"
 
+/*
+ * Find how far from its home bucket the furthest entry of a hashed
+ * directory is, in blocks.
+ */
+static
+uint32_t
+pass2_dirprobe(const struct sfs_dinode *sfi,
+	       const struct sfs_direntry *d, uint32_t nd)
+{
+	const unsigned atonce = SFS_BLOCKSIZE/sizeof(struct sfs_direntry);
+	uint32_t nbuckets = sfi->sfi_dirhash;
+	uint32_t i, home, dist, maxprobe = 0;
+
+	for (i=0; i<nd; i++) {
+		if (d[i].sfd_ino == SFS_NOINO) {
+			continue;
+		}
+		home = sfsdir_hash(d[i].sfd_name) & (nbuckets - 1);
+		dist = (i/atonce - home) & (nbuckets - 1);
+		if (dist > maxprobe) {
+			maxprobe = dist;
+		}
+	}
+	return maxprobe;
+}
+
 /*
  * Process a directory. INO is the inode number; PARENTINO is the
  * parent's inode number; PATHSOFAR is the path to this directory.
@@ -225,6 +251,28 @@ pass2_dir(uint32_t ino, uint32_t parentino, const char *pathsofar)
 		}
 	}
 
+	/*
+	 * In a hashed directory, anything renamed or added above, or
+	 * written by a kernel that doesn't know about hashing, may be
+	 * further from its home bucket than the inode says lookups
+	 * need to look. (Pass 1 has already checked the table size.)
+	 */
+
+	if (sfi.sfi_dirhash != 0) {
+		uint32_t maxprobe = pass2_dirprobe(&sfi, direntries,
+						   ndirentries);
+
+		if (maxprobe > sfi.sfi_dirmaxprobe) {
+			setbadness(EXIT_RECOV);
+			warnx("Directory %s: Hash probe length %lu should be "
+			      "%lu (fixed)", pathsofar,
+			      (unsigned long) sfi.sfi_dirmaxprobe,
+			      (unsigned long) maxprobe);
+			sfi.sfi_dirmaxprobe = maxprobe;
+			ichanged = 1;
+		}
+	}
+
 	/*
 	 * Now load each inode in the directory.
 	 *
@@ -81,6 +81,8 @@ swapinode(struct sfs_dinode *sfi)
 	sfi->sfi_size = SWAP32(sfi->sfi_size);
 	sfi->sfi_type = SWAP16(sfi->sfi_type);
 	sfi->sfi_linkcount = SWAP16(sfi->sfi_linkcount);
+	sfi->sfi_dirhash = SWAP32(sfi->sfi_dirhash);
+	sfi->sfi_dirmaxprobe = SWAP32(sfi->sfi_dirmaxprobe);
 
 	for (i=0; i<NUM_D; i++) {
 		SET_D(sfi, i) = SWAP32(GET_D(sfi, i));
@@ -394,6 +396,21 @@ sfs_writedir(const struct sfs_dinode *sfi, struct sfs_direntry *d, unsigned nd)
 ////////////////////////////////////////////////////////////
 // directory utilities
 
+/*
+ * Hash a name for a hashed directory; see kern/sfs.h.
+ */
+uint32_t
+sfsdir_hash(const char *name)
+{
+	uint32_t h = SFS_DIRHASH_BASIS;
+
+	for (; *name != 0; name++) {
+		h ^= (unsigned char)*name;
+		h *= SFS_DIRHASH_PRIME;
+	}
+	return h;
+}
+
 /* this exists because qsort() doesn't pass a context pointer through */
 static struct sfs_direntry *global_sortdirs;
 
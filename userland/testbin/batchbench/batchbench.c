@@ -0,0 +1,209 @@
+/*
+ * batchbench - batched vs. plain system calls.
+ *
+ * Usage: batchbench [file [count [size]]]
+ *
+ * Writes COUNT records of SIZE bytes to FILE and reads them back,
+ * once with one write()/read() call per record and once by queueing
+ * the same calls in a batch ring and submitting them a ring at a
+ * time, and reports the time for each. The data read back is checked
+ * both ways.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define DEFAULT_FILE	"batchbench.dat"
+#define DEFAULT_COUNT	4096
+#define DEFAULT_SIZE	16
+#define MAXSIZE		512
+
+static char wbuf[BATCH_RINGSIZE][MAXSIZE];
+static char rbuf[BATCH_RINGSIZE][MAXSIZE];
+static struct batch_ring ring;
+
+static
+void
+fill(char *buf, size_t size, unsigned rec)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		buf[i] = 'A' + (rec + i) % 26;
+	}
+}
+
+static
+void
+check(const char *buf, size_t size, unsigned rec)
+{
+	char expect[MAXSIZE];
+
+	fill(expect, size, rec);
+	if (memcmp(buf, expect, size) != 0) {
+		errx(1, "record %u: bad data", rec);
+	}
+}
+
+static
+unsigned long
+elapsed_us(time_t s0, unsigned long ns0)
+{
+	time_t s1;
+	unsigned long ns1;
+
+	__time(&s1, &ns1);
+	if (ns1 < ns0) {
+		ns1 += 1000000000;
+		s1--;
+	}
+	return (s1 - s0) * 1000000 + (ns1 - ns0) / 1000;
+}
+
+static
+void
+report(const char *what, unsigned count, unsigned long us)
+{
+	printf("%-14s %6u calls in %8lu us (%lu ns/call)\n",
+	       what, count, us, count ? us * 1000 / count : 0);
+}
+
+static
+int
+openfile(const char *file, int flags)
+{
+	int fd;
+
+	fd = open(file, flags, 0664);
+	if (fd < 0) {
+		err(1, "%s", file);
+	}
+	return fd;
+}
+
+static
+void
+plain(const char *file, unsigned count, size_t size)
+{
+	time_t s;
+	unsigned long ns;
+	unsigned i;
+	int fd;
+
+	fd = openfile(file, O_WRONLY|O_CREAT|O_TRUNC);
+	__time(&s, &ns);
+	for (i = 0; i < count; i++) {
+		fill(wbuf[0], size, i);
+		if (write(fd, wbuf[0], size) != (ssize_t)size) {
+			err(1, "write");
+		}
+	}
+	report("plain write", count, elapsed_us(s, ns));
+	close(fd);
+
+	fd = openfile(file, O_RDONLY);
+	__time(&s, &ns);
+	for (i = 0; i < count; i++) {
+		if (read(fd, rbuf[0], size) != (ssize_t)size) {
+			err(1, "read");
+		}
+		check(rbuf[0], size, i);
+	}
+	report("plain read", count, elapsed_us(s, ns));
+	close(fd);
+}
+
+/*
+ * Submit the ring and check that every entry moved SIZE bytes.
+ */
+static
+void
+submit(size_t size)
+{
+	unsigned i, n;
+	struct batch_ent *be;
+
+	n = ring.br_tail - ring.br_head;
+	if (batch_submit(&ring) != (int)n) {
+		err(1, "batch_submit");
+	}
+	for (i = ring.br_tail - n; i != ring.br_tail; i++) {
+		be = &ring.br_ents[i % BATCH_RINGSIZE];
+		if (be->be_error) {
+			errx(1, "batch entry %u: error %d", i, be->be_error);
+		}
+		if (be->be_result != (off_t)size) {
+			errx(1, "batch entry %u: short transfer", i);
+		}
+	}
+}
+
+static
+void
+batched(const char *file, unsigned count, size_t size)
+{
+	time_t s;
+	unsigned long ns;
+	unsigned i, j, base;
+	int fd;
+
+	batch_init(&ring);
+
+	fd = openfile(file, O_WRONLY|O_CREAT|O_TRUNC);
+	__time(&s, &ns);
+	for (i = 0; i < count; i++) {
+		j = i % BATCH_RINGSIZE;
+		fill(wbuf[j], size, i);
+		if (batch_write(&ring, fd, wbuf[j], size) == NULL) {
+			err(1, "batch_write");
+		}
+		if (j == BATCH_RINGSIZE - 1 || i == count - 1) {
+			submit(size);
+		}
+	}
+	report("batched write", count, elapsed_us(s, ns));
+	close(fd);
+
+	fd = openfile(file, O_RDONLY);
+	__time(&s, &ns);
+	for (i = 0; i < count; i++) {
+		j = i % BATCH_RINGSIZE;
+		if (batch_read(&ring, fd, rbuf[j], size) == NULL) {
+			err(1, "batch_read");
+		}
+		if (j == BATCH_RINGSIZE - 1 || i == count - 1) {
+			submit(size);
+			base = i - j;
+			for (j = 0; base + j <= i; j++) {
+				check(rbuf[j], size, base + j);
+			}
+		}
+	}
+	report("batched read", count, elapsed_us(s, ns));
+	close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *file;
+	unsigned count;
+	size_t size;
+
+	file = argc > 1 ? argv[1] : DEFAULT_FILE;
+	count = argc > 2 ? (unsigned)atoi(argv[2]) : DEFAULT_COUNT;
+	size = argc > 3 ? (size_t)atoi(argv[3]) : DEFAULT_SIZE;
+	if (count == 0 || size == 0 || size > MAXSIZE) {
+		errx(1, "Usage: batchbench [file [count [size]]] "
+		     "(size 1-%d)", MAXSIZE);
+	}
+
+	plain(file, count, size);
+	batched(file, count, size);
+	remove(file);
+	return 0;
+}
@@ -0,0 +1,204 @@
+/*
+ * pipebench - pipe throughput.
+ *
+ * Usage: pipebench [total [chunksize]]
+ *
+ * Forks a child that writes TOTAL bytes into a pipe in CHUNKSIZE
+ * pieces while the parent reads them back and checks them, then
+ * reports the throughput. With no chunk size, runs a range of sizes
+ * from well under PIPE_BUF to several times the pipe buffer.
+ *
+ * Also checks that reading an empty non-blocking pipe fails with
+ * EAGAIN instead of hanging, and that the reader sees EOF when the
+ * writer exits.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define DEFAULT_TOTAL	(1024*1024)
+#define MAXCHUNK	16384
+
+static char wbuf[MAXCHUNK];
+static char rbuf[MAXCHUNK];
+
+/* The byte at stream offset POS. */
+static
+char
+pattern(size_t pos)
+{
+	return 'a' + pos % 23;
+}
+
+static
+void
+writer(int fd, size_t total, size_t chunk)
+{
+	size_t done, len, i;
+	ssize_t r;
+
+	done = 0;
+	while (done < total) {
+		len = total - done < chunk ? total - done : chunk;
+		for (i = 0; i < len; i++) {
+			wbuf[i] = pattern(done + i);
+		}
+		r = write(fd, wbuf, len);
+		if (r < 0) {
+			err(1, "write");
+		}
+		if ((size_t)r != len) {
+			errx(1, "short write: %d of %u", (int)r, len);
+		}
+		done += len;
+	}
+	close(fd);
+	_exit(0);
+}
+
+/* Milliseconds from (s0, ns0) to (s1, ns1). */
+static
+unsigned long
+elapsed_ms(time_t s0, unsigned long ns0, time_t s1, unsigned long ns1)
+{
+	if (ns1 < ns0) {
+		ns1 += 1000000000;
+		s1--;
+	}
+	return (s1 - s0) * 1000 + (ns1 - ns0) / 1000000;
+}
+
+static
+void
+run(size_t total, size_t chunk)
+{
+	int fds[2];
+	pid_t pid;
+	size_t done, i;
+	ssize_t r;
+	int status;
+	time_t s0, s1;
+	unsigned long ns0, ns1, ms;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	__time(&s0, &ns0);
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		writer(fds[1], total, chunk);
+	}
+	close(fds[1]);
+
+	done = 0;
+	while (1) {
+		r = read(fds[0], rbuf, chunk);
+		if (r < 0) {
+			err(1, "read");
+		}
+		if (r == 0) {
+			break;
+		}
+		for (i = 0; i < (size_t)r; i++) {
+			if (rbuf[i] != pattern(done + i)) {
+				errx(1, "data mismatch at offset %u",
+				     done + i);
+			}
+		}
+		done += r;
+	}
+
+	__time(&s1, &ns1);
+
+	close(fds[0]);
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "writer failed");
+	}
+	if (done != total) {
+		errx(1, "got %u bytes, expected %u", done, total);
+	}
+
+	ms = elapsed_ms(s0, ns0, s1, ns1);
+	if (ms == 0) {
+		ms = 1;
+	}
+	printf("%6u-byte chunks: %u bytes in %lu ms, %lu KB/s\n",
+	       chunk, total, ms, (unsigned long)(total / ms) * 1000 / 1024);
+}
+
+static
+void
+nonblocktest(void)
+{
+	int fds[2];
+	char c;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	if (fcntl(fds[0], F_SETFL, O_NONBLOCK) < 0) {
+		err(1, "fcntl");
+	}
+	if (read(fds[0], &c, 1) >= 0 || errno != EAGAIN) {
+		errx(1, "empty non-blocking read did not fail with EAGAIN");
+	}
+	if (write(fds[1], "x", 1) != 1) {
+		err(1, "write");
+	}
+	if (read(fds[0], &c, 1) != 1 || c != 'x') {
+		errx(1, "non-blocking read lost data");
+	}
+	close(fds[1]);
+	if (read(fds[0], &c, 1) != 0) {
+		errx(1, "no EOF after writer closed");
+	}
+	close(fds[0]);
+	printf("Non-blocking read ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const size_t chunks[] = { 1, 64, 512, 4096, 16384 };
+	size_t total, chunk;
+	unsigned i;
+
+	total = argc > 1 ? (size_t)atoi(argv[1]) : DEFAULT_TOTAL;
+	if (total == 0) {
+		errx(1, "Usage: pipebench [total [chunksize]]");
+	}
+
+	nonblocktest();
+
+	if (argc > 2) {
+		chunk = atoi(argv[2]);
+		if (chunk == 0 || chunk > MAXCHUNK) {
+			errx(1, "chunksize must be 1-%d", MAXCHUNK);
+		}
+		run(total, chunk);
+		return 0;
+	}
+
+	for (i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+		/* one-byte writes are slow; don't wait all day for them */
+		run(chunks[i] == 1 && total > 65536 ? 65536 : total,
+		    chunks[i]);
+	}
+	return 0;
+}
@@ -0,0 +1,315 @@
+/*
+ * strbench - memory and string function throughput.
+ *
+ * Usage: strbench [loops [mhz]]
+ *
+ * Times libc's memset, bzero, memcpy, memcmp and strlen against
+ * plain byte-at-a-time loops, at a few sizes and with the buffers
+ * both word-aligned and not, and reports bytes per CPU cycle. The
+ * cycle count is worked out from elapsed time and the clock rate,
+ * which is 25 MHz unless sys161.conf says otherwise; pass the right
+ * value as MHZ if it does.
+ *
+ * Each result is also checked against the byte loop's.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define MAXLEN		16384
+#define DEFAULT_LOOPS	16
+#define DEFAULT_MHZ	25
+
+static unsigned long mhz = DEFAULT_MHZ;
+
+/* Extra room so the buffers can be offset from word alignment. */
+static unsigned char buf1[MAXLEN + 8];
+static unsigned char buf2[MAXLEN + 8];
+
+/*
+ * The byte-at-a-time versions to compare against. The volatile keeps
+ * the compiler from turning them back into calls to the real thing.
+ */
+
+static
+void
+byte_memset(void *p, int ch, size_t len)
+{
+	volatile unsigned char *d = p;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		d[i] = ch;
+	}
+}
+
+static
+void
+byte_memcpy(void *dst, const void *src, size_t len)
+{
+	volatile unsigned char *d = dst;
+	const volatile unsigned char *s = src;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		d[i] = s[i];
+	}
+}
+
+static
+int
+byte_memcmp(const void *av, const void *bv, size_t len)
+{
+	const volatile unsigned char *a = av;
+	const volatile unsigned char *b = bv;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (a[i] != b[i]) {
+			return (int)(a[i] - b[i]);
+		}
+	}
+	return 0;
+}
+
+static
+size_t
+byte_strlen(const char *str)
+{
+	const volatile char *s = str;
+	size_t i;
+
+	for (i = 0; s[i]; i++) {
+		/* nothing */
+	}
+	return i;
+}
+
+/*
+ * Timing. Everything is measured in nanoseconds and converted to
+ * cycles at the end.
+ */
+
+static time_t start_s;
+static unsigned long start_ns;
+
+static
+void
+timer_start(void)
+{
+	__time(&start_s, &start_ns);
+}
+
+static
+unsigned long long
+timer_stop(void)
+{
+	time_t s;
+	unsigned long ns;
+
+	__time(&s, &ns);
+	if (ns < start_ns) {
+		ns += 1000000000;
+		s--;
+	}
+	return (unsigned long long)(s - start_s) * 1000000000 +
+		(ns - start_ns);
+}
+
+/*
+ * Print bytes per cycle for the byte loop and for libc, with two
+ * decimal places.
+ */
+static
+void
+report(const char *what, size_t len, unsigned off, unsigned loops,
+       unsigned long long bytens, unsigned long long libcns)
+{
+	unsigned long long bytes, bytecyc, libccyc;
+	unsigned long b100, l100;
+
+	bytes = (unsigned long long)len * loops;
+	bytecyc = bytens * mhz / 1000;
+	libccyc = libcns * mhz / 1000;
+	b100 = bytecyc ? (unsigned long)(bytes * 100 / bytecyc) : 0;
+	l100 = libccyc ? (unsigned long)(bytes * 100 / libccyc) : 0;
+
+	printf("%-7s %5u +%u: bytes %lu.%02lu, libc %lu.%02lu bytes/cycle\n",
+	       what, len, off, b100 / 100, b100 % 100, l100 / 100, l100 % 100);
+}
+
+static
+void
+bench_memset(size_t len, unsigned off, unsigned loops)
+{
+	unsigned long long bytens, libcns;
+	unsigned i;
+
+	timer_start();
+	for (i = 0; i < loops; i++) {
+		byte_memset(buf1 + off, i, len);
+	}
+	bytens = timer_stop();
+
+	timer_start();
+	for (i = 0; i < loops; i++) {
+		memset(buf2 + off, i, len);
+	}
+	libcns = timer_stop();
+
+	if (memcmp(buf1 + off, buf2 + off, len) != 0) {
+		errx(1, "memset %u +%u: wrong result", len, off);
+	}
+	report("memset", len, off, loops, bytens, libcns);
+}
+
+static
+void
+bench_bzero(size_t len, unsigned off, unsigned loops)
+{
+	unsigned long long bytens, libcns;
+	unsigned i;
+
+	timer_start();
+	for (i = 0; i < loops; i++) {
+		byte_memset(buf1 + off, 0, len);
+	}
+	bytens = timer_stop();
+
+	byte_memset(buf2, 0xff, sizeof(buf2));
+	timer_start();
+	for (i = 0; i < loops; i++) {
+		bzero(buf2 + off, len);
+	}
+	libcns = timer_stop();
+
+	for (i = 0; i < len; i++) {
+		if (buf2[off + i] != 0) {
+			errx(1, "bzero %u +%u: wrong result", len, off);
+		}
+	}
+	report("bzero", len, off, loops, bytens, libcns);
+}
+
+static
+void
+bench_memcpy(size_t len, unsigned off, unsigned loops)
+{
+	unsigned long long bytens, libcns;
+	unsigned i;
+
+	for (i = 0; i < len; i++) {
+		buf2[i] = random();
+	}
+
+	timer_start();
+	for (i = 0; i < loops; i++) {
+		byte_memcpy(buf1 + off, buf2, len);
+	}
+	bytens = timer_stop();
+
+	timer_start();
+	for (i = 0; i < loops; i++) {
+		memcpy(buf1 + off, buf2, len);
+	}
+	libcns = timer_stop();
+
+	if (byte_memcmp(buf1 + off, buf2, len) != 0) {
+		errx(1, "memcpy %u +%u: wrong result", len, off);
+	}
+	report("memcpy", len, off, loops, bytens, libcns);
+}
+
+static
+void
+bench_memcmp(size_t len, unsigned off, unsigned loops)
+{
+	unsigned long long bytens, libcns;
+	unsigned i;
+	int r1 = 0, r2 = 0;
+
+	/* Equal all the way, except the last byte, so both go the distance. */
+	for (i = 0; i < len; i++) {
+		buf1[off + i] = buf2[off + i] = random();
+	}
+	buf2[off + len - 1] = buf1[off + len - 1] + 1;
+
+	timer_start();
+	for (i = 0; i < loops; i++) {
+		r1 = byte_memcmp(buf1 + off, buf2 + off, len);
+	}
+	bytens = timer_stop();
+
+	timer_start();
+	for (i = 0; i < loops; i++) {
+		r2 = memcmp(buf1 + off, buf2 + off, len);
+	}
+	libcns = timer_stop();
+
+	if ((r1 < 0) != (r2 < 0) || (r1 > 0) != (r2 > 0)) {
+		errx(1, "memcmp %u +%u: wrong result", len, off);
+	}
+	report("memcmp", len, off, loops, bytens, libcns);
+}
+
+static
+void
+bench_strlen(size_t len, unsigned off, unsigned loops)
+{
+	unsigned long long bytens, libcns;
+	size_t l1 = 0, l2 = 0;
+	unsigned i;
+
+	byte_memset(buf1 + off, 'x', len - 1);
+	buf1[off + len - 1] = 0;
+
+	timer_start();
+	for (i = 0; i < loops; i++) {
+		l1 = byte_strlen((char *)buf1 + off);
+	}
+	bytens = timer_stop();
+
+	timer_start();
+	for (i = 0; i < loops; i++) {
+		l2 = strlen((char *)buf1 + off);
+	}
+	libcns = timer_stop();
+
+	if (l1 != len - 1 || l2 != len - 1) {
+		errx(1, "strlen %u +%u: wrong result", len, off);
+	}
+	report("strlen", len, off, loops, bytens, libcns);
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const size_t sizes[] = { 16, 256, 4096, MAXLEN };
+	static const unsigned offs[] = { 0, 1, 3 };
+	unsigned loops, s, o, n;
+
+	loops = argc > 1 ? (unsigned)atoi(argv[1]) : DEFAULT_LOOPS;
+	if (argc > 2) {
+		mhz = atoi(argv[2]);
+	}
+	if (loops == 0 || mhz == 0) {
+		errx(1, "Usage: strbench [loops [mhz]]");
+	}
+
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		/* Keep the total work per size roughly the same. */
+		n = loops * (MAXLEN / sizes[s]);
+		for (o = 0; o < sizeof(offs) / sizeof(offs[0]); o++) {
+			bench_memset(sizes[s], offs[o], n);
+			bench_bzero(sizes[s], offs[o], n);
+			bench_memcpy(sizes[s], offs[o], n);
+			bench_memcmp(sizes[s], offs[o], n);
+			bench_strlen(sizes[s], offs[o], n);
+		}
+	}
+	return 0;
+}